@@ -34,7 +34,16 @@ static char *cmdlist[] = {
 	"--nonewprivs",
 	"--trace",
 	"--shell=none",
-	"/usr/bin/strace", // also used as a marker in build_profile()
+};
+
+// syscall tracers, both of them write an strace -c summary in STRACE_OUTPUT
+static char *seccomp_tracer[] = {
+	LIBDIR "/firejail/fbuilder",
+	"--seccomp-trace=" STRACE_OUTPUT,
+};
+
+static char *strace_tracer[] = {
+	"/usr/bin/strace",
 	"-c",
 	"-f",
 	"-o" STRACE_OUTPUT,
@@ -66,26 +75,33 @@ void build_profile(int argc, char **argv, int index, FILE *fp) {
 	// clean /tmp files
 	clear_tmp_files();
 
-	// detect strace
-	int have_strace = 0;
-	if (access("/usr/bin/strace", X_OK) == 0)
-		have_strace = 1;
+	// detect the syscall tracer: a seccomp filter if the kernel supports user
+	// notifications, it is a lot faster than strace, otherwise strace if installed
+	char **tracer = NULL;
+	unsigned tracer_len = 0;
+	if (seccomp_trace_supported()) {
+		tracer = seccomp_tracer;
+		tracer_len = sizeof(seccomp_tracer) / sizeof(char*);
+	}
+	else if (access("/usr/bin/strace", X_OK) == 0) {
+		tracer = strace_tracer;
+		tracer_len = sizeof(strace_tracer) / sizeof(char*);
+	}
 
 	// calculate command length
-	unsigned len = (int) sizeof(cmdlist) / sizeof(char*) + argc - index + 1;
+	unsigned cmdlist_len = sizeof(cmdlist) / sizeof(char*);
+	unsigned len = cmdlist_len + tracer_len + argc - index + 1;
 	if (arg_debug)
-		printf("command len %d + %d + 1\n", (int) (sizeof(cmdlist) / sizeof(char*)), argc - index);
+		printf("command len %d + %d + %d + 1\n", cmdlist_len, tracer_len, argc - index);
 	char *cmd[len];
-	cmd[0] = cmdlist[0];	// explicit assignemnt to clean scan-build error
 
 	// build command
 	unsigned i = 0;
-	for (i = 0; i < (int) sizeof(cmdlist) / sizeof(char*); i++) {
-		// skip strace if not installed
-		if (have_strace == 0 && strcmp(cmdlist[i], "/usr/bin/strace") == 0)
-			break;
-		cmd[i] = cmdlist[i];
-	}
+	unsigned j;
+	for (j = 0; j < cmdlist_len; j++)
+		cmd[i++] = cmdlist[j];
+	for (j = 0; j < tracer_len; j++)
+		cmd[i++] = tracer[j];
 
 	int i2 = index;
 	for (; i < (len - 1); i++, i2++)
@@ -147,7 +163,7 @@ void build_profile(int argc, char **argv, int index, FILE *fp) {
 		fprintf(fp, "caps.drop all\n");
 		fprintf(fp, "nonewprivs\n");
 		fprintf(fp, "seccomp\n");
-		if (have_strace)
+		if (tracer)
 			build_seccomp(STRACE_OUTPUT, fp);
 		else {
 			fprintf(fp, "# If you install strace on your system, Firejail will also create a\n");
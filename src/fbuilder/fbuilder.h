@@ -21,6 +21,7 @@
 #ifndef FBUILDER_H
 #define FBUILDER_H
 #include "../include/common.h"
+#include "../include/syscall_list.h"
 #include <sys/types.h>
 #include <pwd.h>
 #include <sys/types.h>
@@ -51,6 +52,10 @@ void build_bin(const char *fname, FILE *fp);
 // build_home.c
 void build_home(const char *fname, FILE *fp);
 
+// seccomp_trace.c
+int seccomp_trace_supported(void);
+int seccomp_trace(const char *fname, char **argv);
+
 // utils.c
 int is_dir(const char *fname);
 char *extract_dir(char *fname);
@@ -49,6 +49,14 @@ printf("\n");
 		}
 		else if (strcmp(argv[i], "--debug") == 0)
 			arg_debug = 1;
+		else if (strncmp(argv[i], "--seccomp-trace=", 16) == 0) {
+			// internal option, used to trace the program inside the sandbox
+			if (i + 1 >= argc) {
+				fprintf(stderr, "Error fbuilder: program and arguments required\n");
+				exit(1);
+			}
+			return seccomp_trace(argv[i] + 16, argv + i + 1);
+		}
 		else if (strcmp(argv[i], "--build") == 0)
 			; // do nothing, this is passed down from firejail
 		else if (strncmp(argv[i], "--build=", 8) == 0) {
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fbuilder.h"
+#include "../include/seccomp.h"
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <poll.h>
+
+// Syscall tracing using a seccomp filter: every syscall of the program generates a user
+// notification, the syscall number is counted, and the syscall is allowed to continue.
+// There are no ptrace stops and no registers or memory are read from the traced processes.
+// The result is written in the format of strace -c summaries, used by build_seccomp().
+#if defined(SECCOMP_RET_USER_NOTIF) && defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE) && \
+    defined(SYS_pidfd_open) && defined(SYS_pidfd_getfd) && defined(SYS_futex)
+#define HAVE_USER_NOTIF 1
+#endif
+
+#ifdef HAVE_USER_NOTIF
+// low and high 32 bits of a syscall argument in struct seccomp_data
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define ARG_LO(i) (offsetof(struct seccomp_data, args[(i)]))
+#define ARG_HI(i) (offsetof(struct seccomp_data, args[(i)]) + sizeof(uint32_t))
+#else
+#define ARG_LO(i) (offsetof(struct seccomp_data, args[(i)]) + sizeof(uint32_t))
+#define ARG_HI(i) (offsetof(struct seccomp_data, args[(i)]))
+#endif
+
+// Return the listener file descriptor, or -1 if error.
+// The futex wake on handover, used by the child to pass the listener to the parent,
+// is the only syscall not traced.
+static int install_filter(int notify, volatile int *handover) {
+	uint64_t addr = (uintptr_t) handover;
+	struct sock_filter filter[] = {
+		// syscalls for other architectures are not traced
+		BPF_STMT(BPF_LD+BPF_W+BPF_ABS, (offsetof(struct seccomp_data, arch))),
+		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, ARCH_NR, 1, 0),
+		RETURN_ALLOW,
+		EXAMINE_SYSCALL,
+#if defined(__x86_64__)
+		BPF_JUMP(BPF_JMP+BPF_JGE+BPF_K, X32_SYSCALL_BIT, 0, 1),
+		RETURN_ALLOW,
+#endif
+		// futex(handover, FUTEX_WAKE, ...)
+		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_futex, 0, 6),
+		BPF_STMT(BPF_LD+BPF_W+BPF_ABS, ARG_LO(0)),
+		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, (uint32_t) addr, 0, 4),
+		BPF_STMT(BPF_LD+BPF_W+BPF_ABS, ARG_HI(0)),
+		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, (uint32_t) (addr >> 32), 0, 2),
+		BPF_STMT(BPF_LD+BPF_W+BPF_ABS, ARG_LO(1)),
+		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, FUTEX_WAKE, 1, 0),
+		BPF_STMT(BPF_RET+BPF_K, (notify) ? SECCOMP_RET_USER_NOTIF : SECCOMP_RET_ALLOW),
+		RETURN_ALLOW
+	};
+	struct sock_fprog prog = {
+		.len = (unsigned short) (sizeof(filter) / sizeof(filter[0])),
+		.filter = filter,
+	};
+
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1)
+		return -1;
+	return syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+}
+
+// get a copy of a file descriptor of another process
+static int get_fd(pid_t pid, int fd) {
+	int pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfd == -1)
+		return -1;
+	int rv = syscall(SYS_pidfd_getfd, pidfd, fd, 0);
+	close(pidfd);
+	return rv;
+}
+
+// check kernel support in a child process
+int seccomp_trace_supported(void) {
+	pid_t child = fork();
+	if (child == -1)
+		errExit("fork");
+	if (child == 0) {
+		int fd = install_filter(0, NULL);
+		if (fd == -1 || get_fd(getpid(), fd) == -1)
+			_exit(1);
+		_exit(0);
+	}
+
+	int status;
+	if (waitpid(child, &status, 0) != child)
+		errExit("waitpid");
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void write_summary(const char *fname, unsigned long long *calls, int size) {
+	FILE *fp = fopen(fname, "w");
+	if (!fp) {
+		fprintf(stderr, "Error fbuilder: cannot open %s\n", fname);
+		exit(1);
+	}
+
+	unsigned long long total = 0;
+	int i;
+	for (i = 0; i < size; i++)
+		total += calls[i];
+
+	// most frequent syscalls first, the same as strace
+	fprintf(fp, "%% time     seconds  usecs/call     calls    errors syscall\n");
+	fprintf(fp, "------ ----------- ----------- --------- --------- ----------------\n");
+	while (1) {
+		int max = -1;
+		for (i = 0; i < size; i++) {
+			if (calls[i] && (max == -1 || calls[i] > calls[max]))
+				max = i;
+		}
+		if (max == -1)
+			break;
+
+		const char *name = syscall_find_nr(max);
+		if (name)
+			fprintf(fp, "%6.2f %11.6f %11u %9llu %9s %s\n",
+				100.0 * calls[max] / total, 0.0, 0, calls[max], "", name);
+		calls[max] = 0;
+	}
+	fprintf(fp, "------ ----------- ----------- --------- --------- ----------------\n");
+	fprintf(fp, "100.00 %11.6f %11s %9llu %9s total\n", 0.0, "", total, "");
+	fclose(fp);
+}
+
+// reap the processes, return -1 if there are no processes left
+static int reap(pid_t child, int *exit_status, int options) {
+	int status;
+	pid_t pid;
+	while ((pid = waitpid(-1, &status, options)) > 0) {
+		if (pid == child)
+			*exit_status = (WIFEXITED(status)) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+	}
+	return (pid == -1 && errno == ECHILD) ? -1 : 0;
+}
+
+// run the program and write the syscalls summary in fname; return the exit status of the program
+int seccomp_trace(const char *fname, char **argv) {
+	assert(fname);
+	assert(argv && argv[0]);
+
+	// the traced processes are reparented to us, we know when all of them are gone
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0) == -1)
+		errExit("prctl");
+
+	// the processes are reaped when SIGCHLD is reported on a signalfd
+	sigset_t mask, oldmask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	if (sigprocmask(SIG_BLOCK, &mask, &oldmask) == -1)
+		errExit("sigprocmask");
+	int sfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (sfd == -1)
+		errExit("signalfd");
+
+	// the listener file descriptor is passed in shared memory: any syscall made by
+	// the child after installing the filter waits for us to pick up the descriptor,
+	// except the futex wake on the shared memory
+	volatile int *shared = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+		errExit("mmap");
+	*shared = -1;
+
+	pid_t child = fork();
+	if (child == -1)
+		errExit("fork");
+	if (child == 0) {
+		if (sigprocmask(SIG_SETMASK, &oldmask, NULL) == -1)
+			errExit("sigprocmask");
+		int fd = install_filter(1, shared);
+		__sync_synchronize();
+		*shared = (fd == -1) ? -2 : fd;
+		syscall(SYS_futex, shared, FUTEX_WAKE, 1, NULL, NULL, 0);
+		if (fd == -1) {
+			fprintf(stderr, "Error fbuilder: cannot install the seccomp filter\n");
+			_exit(1);
+		}
+		execvp(argv[0], argv);
+		errExit("execvp");
+	}
+
+	while (*shared == -1) {
+		if (syscall(SYS_futex, shared, FUTEX_WAIT, -1, NULL, NULL, 0) == -1 &&
+		    errno != EAGAIN && errno != EINTR)
+			errExit("futex");
+	}
+	if (*shared == -2)
+		exit(1);
+	int listener = get_fd(child, *shared);
+	if (listener == -1)
+		errExit("pidfd_getfd");
+
+	struct seccomp_notif_sizes sizes;
+	if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) == -1)
+		errExit("seccomp");
+	struct seccomp_notif *req = malloc(sizes.seccomp_notif > sizeof(*req) ? sizes.seccomp_notif : sizeof(*req));
+	struct seccomp_notif_resp *resp = malloc(sizes.seccomp_notif_resp > sizeof(*resp) ? sizes.seccomp_notif_resp : sizeof(*resp));
+	int size = syscall_nr_max() + 1;
+	unsigned long long *calls = calloc(size, sizeof(unsigned long long));
+	if (!req || !resp || !calls)
+		errExit("malloc");
+
+	int exit_status = 1;
+	struct pollfd pfd[2] = {
+		{ .fd = listener, .events = POLLIN },
+		{ .fd = sfd, .events = POLLIN }
+	};
+	while (1) {
+		int rv = poll(pfd, 2, -1);
+		if (rv == -1 && errno != EINTR)
+			errExit("poll");
+		if (rv <= 0)
+			continue;
+
+		if (pfd[1].revents & POLLIN) {
+			// several SIGCHLD signals are merged, reap all the processes that are gone
+			struct signalfd_siginfo si;
+			while (read(sfd, &si, sizeof(si)) == sizeof(si))
+				;
+			if (reap(child, &exit_status, WNOHANG) == -1)
+				break;
+		}
+		if (pfd[0].revents & POLLHUP)
+			break;	// no process is using the filter
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+
+		memset(req, 0, sizes.seccomp_notif);
+		if (ioctl(listener, SECCOMP_IOCTL_NOTIF_RECV, req) == -1) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			errExit("ioctl");
+		}
+		if (req->data.nr >= 0 && req->data.nr < size)
+			calls[req->data.nr]++;
+
+		memset(resp, 0, sizes.seccomp_notif_resp);
+		resp->id = req->id;
+		resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+		if (ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, resp) == -1 && errno != ENOENT)
+			errExit("ioctl");	// ENOENT: the process was killed in the meantime
+	}
+
+	// wait for the remaining processes
+	reap(child, &exit_status, 0);
+	close(sfd);
+	if (sigprocmask(SIG_SETMASK, &oldmask, NULL) == -1)
+		errExit("sigprocmask");
+
+	write_summary(fname, calls, size);
+	free(calls);
+	free(req);
+	free(resp);
+	close(listener);
+	return exit_status;
+}
+
+#else
+int seccomp_trace_supported(void) {
+	return 0;
+}
+
+int seccomp_trace(const char *fname, char **argv) {
+	(void) fname;
+	(void) argv;
+	fprintf(stderr, "Error fbuilder: seccomp user notifications are not supported\n");
+	exit(1);
+}
+#endif
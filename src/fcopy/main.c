@@ -19,12 +19,14 @@
  */
 
 #include "../include/common.h"
+#include "../include/copy_utils.h"
 #include <fcntl.h>
 #include <ftw.h>
 #include <errno.h>
 #include <pwd.h>
 
 int arg_quiet = 0;
+static int arg_debug = 0;
 static int arg_follow_link = 0;
 
 #define COPY_LIMIT (500 * 1024 *1024)
@@ -64,19 +66,8 @@ static void copy_file(const char *srcname, const char *destname, mode_t mode, ui
 	}
 
 	// copy
-	ssize_t len;
-	static const int BUFLEN = 1024;
-	unsigned char buf[BUFLEN];
-	while ((len = read(src, buf, BUFLEN)) > 0) {
-		int done = 0;
-		while (done != len) {
-			int rv = write(dst, buf + done, len - done);
-			if (rv == -1)
-				goto errexit;
-			done += rv;
-		}
-	}
-	fflush(0);
+	if (copy_fd(src, dst) == -1)
+		goto errexit;
 
 	if (fchown(dst, uid, gid) == -1)
 		goto errexit;
@@ -237,31 +228,46 @@ static char *check(const char *src) {
 
 errexit:
 	fprintf(stderr, "Error fcopy: invalid file %s\n", src);
-	exit(1);
+	free(rsrc);
+	return NULL;
 }
 
 
-static void duplicate_dir(const char *src, const char *dest, struct stat *s) {
+static int duplicate_dir(const char *src, const char *dest, struct stat *s) {
 	(void) s;
 	char *rsrc = check(src);
-	char *rdest = check(dest);
+	char *rdest = (rsrc) ? check(dest) : NULL;
+	if (!rdest) {
+		free(rsrc);
+		return -1;
+	}
 	inpath = rsrc;
 	outpath = rdest;
+	first = 1;
+	size_limit_reached = 0;
+	file_cnt = 0;
+	size_cnt = 0;
 
 	// walk
+	int rv = 0;
 	if(nftw(rsrc, fs_copydir, 1, FTW_PHYS) != 0) {
 		fprintf(stderr, "Error: unable to copy file\n");
-		exit(1);
+		rv = -1;
 	}
 
 	free(rsrc);
 	free(rdest);
+	return rv;
 }
 
 
-static void duplicate_file(const char *src, const char *dest, struct stat *s) {
+static int duplicate_file(const char *src, const char *dest, struct stat *s) {
 	char *rsrc = check(src);
-	char *rdest = check(dest);
+	char *rdest = (rsrc) ? check(dest) : NULL;
+	if (!rdest) {
+		free(rsrc);
+		return -1;
+	}
 	uid_t uid = s->st_uid;
 	gid_t gid = s->st_gid;
 	mode_t mode = s->st_mode;
@@ -279,12 +285,17 @@ static void duplicate_file(const char *src, const char *dest, struct stat *s) {
 	free(name);
 	free(rsrc);
 	free(rdest);
+	return 0;
 }
 
 
-static void duplicate_link(const char *src, const char *dest, struct stat *s) {
+static int duplicate_link(const char *src, const char *dest, struct stat *s) {
 	char *rsrc = check(src);		  // we drop the result and use the original name
-	char *rdest = check(dest);
+	char *rdest = (rsrc) ? check(dest) : NULL;
+	if (!rdest) {
+		free(rsrc);
+		return -1;
+	}
 	uid_t uid = s->st_uid;
 	gid_t gid = s->st_gid;
 	mode_t mode = s->st_mode;
@@ -303,51 +314,15 @@ static void duplicate_link(const char *src, const char *dest, struct stat *s) {
 	free(name);
 	free(rsrc);
 	free(rdest);
+	return 0;
 }
 
 
-static void usage(void) {
-	fputs("Usage: fcopy [--follow-link] src dest\n"
-		"\n"
-		"Copy SRC to DEST/SRC. SRC may be a file, directory, or symbolic link.\n"
-		"If SRC is a directory it is copied recursively.  If it is a symlink,\n"
-		"the link itself is duplicated, unless --follow-link is given,\n"
-		"in which case the destination of the link is copied.\n"
-		"DEST must already exist and must be a directory.\n", stderr);
-}
-
-
-int main(int argc, char **argv) {
-#if 0
-	{
-		//system("cat /proc/self/status");
-		int i;
-		for (i = 0; i < argc; i++)
-			printf("*%s* ", argv[i]);
-		printf("\n");
-	}
-#endif
-	char *quiet = getenv("FIREJAIL_QUIET");
-	if (quiet && strcmp(quiet, "yes") == 0)
-		arg_quiet = 1;
-
-	char *src;
-	char *dest;
-
-	if (argc == 3) {
-		src = argv[1];
-		dest = argv[2];
-		arg_follow_link = 0;
-	}
-	else if (argc == 4 && !strcmp(argv[1], "--follow-link")) {
-		src = argv[2];
-		dest = argv[3];
-		arg_follow_link = 1;
-	}
-	else {
-		fprintf(stderr, "Error: arguments missing\n");
-		usage();
-		exit(1);
+// copy one src/dest pair; returns 0 if ok, -1 if the pair was rejected
+static int copy_entry(char *src, char *dest) {
+	if (*src == '\0' || *dest == '\0') {
+		fprintf(stderr, "Error fcopy: empty file name\n");
+		return -1;
 	}
 
 	// trim trailing chars
@@ -362,7 +337,7 @@ int main(int argc, char **argv) {
 		src[len - 1] = '\0';
 	if (strcspn(src, "\\*&!?\"'<>%^(){}[];,") != (size_t)len) {
 		fprintf(stderr, "Error fcopy: invalid source file name %s\n", src);
-		exit(1);
+		return -1;
 	}
 
 	len = strlen(dest);
@@ -370,36 +345,143 @@ int main(int argc, char **argv) {
 		dest[len - 1] = '\0';
 	if (strcspn(dest, "\\*&!?\"'<>%^(){}[];,~") != (size_t)len) {
 		fprintf(stderr, "Error fcopy: invalid dest file name %s\n", dest);
-		exit(1);
+		return -1;
 	}
 
 	// the destination should be a directory;
 	struct stat s;
 	if (stat(dest, &s) == -1) {
 		fprintf(stderr, "Error fcopy: dest dir %s: %s\n", dest, strerror(errno));
-		exit(1);
+		return -1;
 	}
 	if (!S_ISDIR(s.st_mode)) {
 		fprintf(stderr, "Error fcopy: dest %s is not a directory\n", dest);
-		exit(1);
+		return -1;
 	}
 
 	// copy files
 	if ((arg_follow_link ? stat : lstat)(src, &s) == -1) {
 		fprintf(stderr, "Error fcopy: src %s: %s\n", src, strerror(errno));
-		exit(1);
+		return -1;
 	}
 
 	if (S_ISDIR(s.st_mode))
-		duplicate_dir(src, dest, &s);
+		return duplicate_dir(src, dest, &s);
 	else if (S_ISREG(s.st_mode))
-		duplicate_file(src, dest, &s);
+		return duplicate_file(src, dest, &s);
 	else if (S_ISLNK(s.st_mode))
-		duplicate_link(src, dest, &s);
+		return duplicate_link(src, dest, &s);
 	else {
 		fprintf(stderr, "Error fcopy: src %s is an unsupported type of file\n", src);
+		return -1;
+	}
+}
+
+
+// Read src/dest pairs from stdin; each file name is terminated by a '\0'.
+// A pair that can't be copied doesn't stop the batch, the remaining pairs are still copied.
+// return -1 if any pair failed; firejail stops the sandbox if fcopy exits with an error
+static int copy_batch(void) {
+	size_t size = 4096;
+	size_t len = 0;
+	char *buf = malloc(size);
+	if (!buf)
+		errExit("malloc");
+
+	ssize_t rv;
+	while ((rv = read(STDIN_FILENO, buf + len, size - len)) != 0) {
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("read");
+		}
+		len += rv;
+		if (len == size) {
+			size *= 2;
+			buf = realloc(buf, size);
+			if (!buf)
+				errExit("realloc");
+		}
+	}
+	if (len && buf[len - 1] != '\0') {
+		fprintf(stderr, "Error fcopy: invalid batch\n");
 		exit(1);
 	}
 
-	return 0;
+	int failed = 0;
+	char *ptr = buf;
+	char *end = buf + len;
+	while (ptr < end) {
+		char *src = ptr;
+		ptr += strlen(ptr) + 1;
+		if (ptr >= end) {
+			fprintf(stderr, "Error fcopy: invalid batch, destination missing for %s\n", src);
+			exit(1);
+		}
+		char *dest = ptr;
+		ptr += strlen(ptr) + 1;
+		if (copy_entry(src, dest) == -1) {
+			fprintf(stderr, "Error fcopy: %s not copied\n", src);
+			failed = 1;
+		}
+	}
+	free(buf);
+	return (failed) ? -1 : 0;
+}
+
+
+static void usage(void) {
+	fputs("Usage: fcopy [--follow-link] src dest\n"
+		"       fcopy --batch [--follow-link]\n"
+		"\n"
+		"Copy SRC to DEST/SRC. SRC may be a file, directory, or symbolic link.\n"
+		"If SRC is a directory it is copied recursively.  If it is a symlink,\n"
+		"the link itself is duplicated, unless --follow-link is given,\n"
+		"in which case the destination of the link is copied.\n"
+		"DEST must already exist and must be a directory.\n"
+		"With --batch, SRC and DEST pairs are read from stdin, each file name\n"
+		"terminated by a null character, and copied in order.\n", stderr);
+}
+
+
+int main(int argc, char **argv) {
+#if 0
+	{
+		//system("cat /proc/self/status");
+		int i;
+		for (i = 0; i < argc; i++)
+			printf("*%s* ", argv[i]);
+		printf("\n");
+	}
+#endif
+	char *quiet = getenv("FIREJAIL_QUIET");
+	if (quiet && strcmp(quiet, "yes") == 0)
+		arg_quiet = 1;
+	char *debug = getenv("FIREJAIL_DEBUG");
+	if (debug && strcmp(debug, "yes") == 0)
+		arg_debug = 1;
+
+	int rv = 0;
+	if (argc == 2 && !strcmp(argv[1], "--batch"))
+		rv = copy_batch();
+	else if (argc == 3 && !strcmp(argv[1], "--batch") && !strcmp(argv[2], "--follow-link")) {
+		arg_follow_link = 1;
+		rv = copy_batch();
+	}
+	else if (argc == 3)
+		rv = copy_entry(argv[1], argv[2]);
+	else if (argc == 4 && !strcmp(argv[1], "--follow-link")) {
+		arg_follow_link = 1;
+		rv = copy_entry(argv[2], argv[3]);
+	}
+	else {
+		fprintf(stderr, "Error: arguments missing\n");
+		usage();
+		exit(1);
+	}
+
+	if (arg_debug)
+		copy_stats_print("fcopy");
+
+	return (rv == -1) ? 1 : 0;
 }
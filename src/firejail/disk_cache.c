@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+// On-disk caches in root-owned directories under /run/firejail. An entry is a file named
+// after the user and a hash of the key. The file holds a header, the full key and the data
+// saved with it. The caller runs with root privileges, only root can write the entries.
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t key_len;	// bytes, followed by the key, padded to 8 bytes
+	uint32_t data_len;	// bytes, followed by the data
+	uint64_t checksum;	// key and data
+} DiskCacheHeader;
+
+#define PAD8(x) (((x) + 7) & ~((size_t) 7))
+
+static char *entry_fname(const DiskCache *cache, const char *key) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d-%016llx", cache->dir, getuid(),
+		     (unsigned long long) fnv1a(FNV1A_INIT, key, strlen(key))) == -1)
+		errExit("asprintf");
+	return fname;
+}
+
+static uint64_t checksum(const char *key, size_t key_len, const void *data, size_t data_len) {
+	static const char zero[8] = {0};
+	uint64_t h = fnv1a(FNV1A_INIT, key, key_len);
+	h = fnv1a(h, zero, PAD8(key_len) - key_len);
+	return fnv1a(h, data, data_len);
+}
+
+// Map the entry for key in memory; the mapping is private and writable.
+// return 0 if found, -1 if not found or not valid
+int disk_cache_load(const DiskCache *cache, const char *key, DiskCacheEntry *entry) {
+	assert(cache);
+	assert(key);
+	assert(entry);
+	memset(entry, 0, sizeof(DiskCacheEntry));
+
+	char *fname = entry_fname(cache, key);
+	int fd = open(fname, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	free(fname);
+	if (fd == -1)
+		return -1;
+
+	// the file is trusted only if it was written by root
+	struct stat s;
+	size_t key_len = strlen(key);
+	char *map = MAP_FAILED;
+	if (fstat(fd, &s) == -1 || !S_ISREG(s.st_mode) || s.st_uid != 0 || (s.st_mode & 022) ||
+	    s.st_size < (off_t) (sizeof(DiskCacheHeader) + PAD8(key_len)) ||
+	    (size_t) s.st_size > sizeof(DiskCacheHeader) + PAD8(key_len) + cache->data_max)
+		goto errout;
+
+	map = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		goto errout;
+
+	DiskCacheHeader *hdr = (DiskCacheHeader *) map;
+	char *payload = map + sizeof(DiskCacheHeader);
+	if (hdr->magic != cache->magic || hdr->version != cache->version || hdr->key_len != key_len ||
+	    (size_t) s.st_size != sizeof(DiskCacheHeader) + PAD8(key_len) + hdr->data_len ||
+	    memcmp(payload, key, key_len) != 0 ||
+	    checksum(payload, key_len, payload + PAD8(key_len), hdr->data_len) != hdr->checksum)
+		goto errout;
+
+	// the entry was used, it is removed last
+	futimens(fd, NULL);
+	close(fd);
+
+	entry->map = map;
+	entry->size = s.st_size;
+	entry->data = payload + PAD8(key_len);
+	entry->len = hdr->data_len;
+	return 0;
+
+errout:
+	if (arg_debug)
+		printf("%s cache entry rejected\n", cache->name);
+	if (map != MAP_FAILED)
+		munmap(map, s.st_size);
+	close(fd);
+	return -1;
+}
+
+void disk_cache_unmap(DiskCacheEntry *entry) {
+	assert(entry);
+	if (entry->map)
+		munmap(entry->map, entry->size);
+	memset(entry, 0, sizeof(DiskCacheEntry));
+}
+
+static int older(const struct timespec *t1, const struct timespec *t2) {
+	return t1->tv_sec < t2->tv_sec || (t1->tv_sec == t2->tv_sec && t1->tv_nsec < t2->tv_nsec);
+}
+
+// remove the least recently used entries of the user above cache->entries or cache->size bytes, except keep
+static void cache_trim(const DiskCache *cache, const char *keep) {
+	char prefix[32];
+	snprintf(prefix, sizeof(prefix), "%d-", getuid());
+	size_t prefix_len = strlen(prefix);
+	keep = strrchr(keep, '/') + 1;
+
+	unsigned cnt;
+	off_t total;
+	do {
+		DIR *dir = opendir(cache->dir);
+		if (!dir)
+			return;
+
+		cnt = 0;
+		total = 0;
+		char *oldest = NULL;
+		struct timespec oldest_time;
+		off_t oldest_size = 0;
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (strncmp(entry->d_name, prefix, prefix_len) != 0)
+				continue;
+			struct stat s;
+			if (fstatat(dirfd(dir), entry->d_name, &s, AT_SYMLINK_NOFOLLOW) == -1)
+				continue;
+			cnt++;
+			total += s.st_size;
+			if (strcmp(entry->d_name, keep) == 0)
+				continue;
+			if (!oldest || older(&s.st_mtim, &oldest_time)) {
+				free(oldest);
+				oldest = strdup(entry->d_name);
+				if (!oldest)
+					errExit("strdup");
+				oldest_time = s.st_mtim;
+				oldest_size = s.st_size;
+			}
+		}
+
+		if ((cnt > cache->entries || total > cache->size) && oldest) {
+			if (unlinkat(dirfd(dir), oldest, 0) == 0) {
+				if (arg_debug)
+					printf("%s cache entry %s removed\n", cache->name, oldest);
+				cnt--;
+				total -= oldest_size;
+			}
+			else
+				cnt = total = 0;	// give up
+		}
+		else
+			cnt = total = 0;	// nothing left to remove
+		free(oldest);
+		closedir(dir);
+	}
+	while (cnt > cache->entries || total > cache->size);
+}
+
+// Save the data for key; errors are not fatal, the caller builds the data again next time.
+// The entry is written in a temporary file and renamed, a sandbox starting at the same time
+// sees either the old entry or the new one.
+void disk_cache_save(const DiskCache *cache, const char *key, const void *data, size_t len) {
+	assert(cache);
+	assert(key);
+	assert(data || len == 0);
+	if (geteuid() != 0 || len > cache->data_max)
+		return;
+
+	static const char zero[8] = {0};
+	size_t key_len = strlen(key);
+	DiskCacheHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = cache->magic;
+	hdr.version = cache->version;
+	hdr.key_len = key_len;
+	hdr.data_len = len;
+	hdr.checksum = checksum(key, key_len, data, len);
+	struct iovec iov[4] = {
+		{ .iov_base = &hdr, .iov_len = sizeof(hdr) },
+		{ .iov_base = (void *) key, .iov_len = key_len },
+		{ .iov_base = (void *) zero, .iov_len = PAD8(key_len) - key_len },
+		{ .iov_base = (void *) data, .iov_len = len }
+	};
+	ssize_t size = sizeof(hdr) + PAD8(key_len) + len;
+
+	char *tmp;
+	if (asprintf(&tmp, "%s/.tmp-XXXXXX", cache->dir) == -1)
+		errExit("asprintf");
+	// mkstemp creates the file 0600, the data can come from files private to the user
+	int fd = mkstemp(tmp);
+	if (fd == -1) {
+		free(tmp);
+		return;
+	}
+	int rv = (writev(fd, iov, 4) != size);
+	close(fd);
+
+	char *fname = entry_fname(cache, key);
+	if (rv || rename(tmp, fname) == -1)
+		unlink(tmp);
+	else {
+		if (arg_debug)
+			printf("%s cache entry saved in %s\n", cache->name, fname);
+		cache_trim(cache, fname);
+	}
+	free(fname);
+	free(tmp);
+}
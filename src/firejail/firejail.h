@@ -36,6 +36,8 @@
 #define RUN_FIREJAIL_NETWORK_DIR	"/run/firejail/network"
 #define RUN_FIREJAIL_BANDWIDTH_DIR	"/run/firejail/bandwidth"
 #define RUN_FIREJAIL_PROFILE_DIR		"/run/firejail/profile"
+#define RUN_FIREJAIL_SECCOMP_DIR	"/run/firejail/seccomp"	// cache of seccomp filters built by fseccomp
+#define RUN_FIREJAIL_PROFILE_CACHE_DIR	"/run/firejail/profile-cache"	// cache of compiled profiles
 #define RUN_NETWORK_LOCK_FILE	"/run/firejail/firejail-network.lock"
 #define RUN_DIRECTORY_LOCK_FILE	"/run/firejail/firejail-run.lock"
 #define RUN_RO_DIR	"/run/firejail/firejail.ro.dir"
@@ -62,11 +64,13 @@
 #define RUN_SECCOMP_MDWX	"/run/firejail/mnt/seccomp.mdwx"		// filter for memory-deny-write-execute
 #define RUN_SECCOMP_BLOCK_SECONDARY	"/run/firejail/mnt/seccomp.block_secondary"	// secondary arch blocking filter
 #define RUN_SECCOMP_POSTEXEC	"/run/firejail/mnt/seccomp.postexec"		// filter for post-exec library
+#define RUN_SECCOMP_LINKED	"/run/firejail/mnt/seccomp.linked"		// filters linked in a single program
 #define PATH_SECCOMP_DEFAULT (LIBDIR "/firejail/seccomp")			// default filter built during make
 #define PATH_SECCOMP_DEFAULT_DEBUG (LIBDIR "/firejail/seccomp.debug")	// default filter built during make
 #define PATH_SECCOMP_32 (LIBDIR "/firejail/seccomp.32")			// 32bit arch filter built during make
 #define PATH_SECCOMP_MDWX (LIBDIR "/firejail/seccomp.mdwx")		// filter for memory-deny-write-execute built during make
 #define PATH_SECCOMP_BLOCK_SECONDARY (LIBDIR "/firejail/seccomp.block_secondary")	// secondary arch blocking filter built during make
+#define PATH_SECCOMP_SBOX (LIBDIR "/firejail/seccomp.sbox")		// filter for sbox_run helpers built during make
 
 
 #define RUN_DEV_DIR		"/run/firejail/mnt/dev"
@@ -190,9 +194,37 @@ typedef struct interface_t {
 	uint8_t configured;
 } Interface;
 
+#define EMPTY_STRING ("")
+
+// filesystem commands in profile entries, classified once by profile_add()
+typedef enum {
+	PROFILE_NONE = 0,	// entry removed from processing
+	PROFILE_BIND,
+	PROFILE_BLACKLIST,
+	PROFILE_BLACKLIST_NOLOG,
+	PROFILE_NOBLACKLIST,
+	PROFILE_READ_ONLY,
+	PROFILE_READ_WRITE,
+	PROFILE_NOEXEC,
+	PROFILE_TMPFS,
+	PROFILE_MKDIR,
+	PROFILE_MKFILE,
+	PROFILE_WHITELIST,
+	PROFILE_NOWHITELIST,
+	PROFILE_OTHER
+} ProfileCmd;
+
+// index lists, in profile order: commands handled by fs_blacklist() and by fs_whitelist()
+#define PROFILE_INDEX_BLACKLIST 0
+#define PROFILE_INDEX_WHITELIST 1
+#define PROFILE_INDEX_MAX 2
+
 typedef struct profile_entry_t {
 	struct profile_entry_t *next;
+	struct profile_entry_t *next_index;	// next entry in the same index list
 	char *data;	// command
+	char *arg;	// command argument, inside data
+	ProfileCmd cmd;
 
 	// whitelist command parameters
 	char *link;	// link name - set if the file is a link
@@ -216,6 +248,9 @@ typedef struct config_t {
 
 	// filesystem
 	ProfileEntry *profile;
+	ProfileEntry *profile_tail;
+	ProfileEntry *profile_index[PROFILE_INDEX_MAX];
+	ProfileEntry *profile_index_tail[PROFILE_INDEX_MAX];
 #define MAX_PROFILE_IGNORE 32
 	char *profile_ignore[MAX_PROFILE_IGNORE];
 	char *chrootdir;	// chroot directory
@@ -435,6 +470,8 @@ void preproc_clean_run(void);
 // fs.c
 // blacklist files or directoies by mounting empty files on top of them
 void fs_blacklist(void);
+// mount flags of the filesystem holding path, as MS_* flags; return 0 if OK, -errno if not
+int get_mount_flags(const char *path, unsigned long *flags);
 // remount a directory read-only
 void fs_rdonly(const char *dir);
 // remount a directory noexec, nodev and nosuid
@@ -464,7 +501,23 @@ void profile_read(const char *fname);
 int profile_check_line(char *ptr, int lineno, const char *fname);
 // add a profile entry in cfg.profile list; use str to populate the list
 void profile_add(char *str);
+// remove the entry from further processing
+void profile_entry_clear(ProfileEntry *entry);
+// replace the command string in the entry
+void profile_entry_set(ProfileEntry *entry, char *str);
+void profile_free(void);
 void profile_add_ignore(const char *str);
+int is_in_ignore_list(char *ptr);
+
+// profile_cache.c
+void profile_cache_start(void);
+int profile_cache_file(const char *fname);
+void profile_cache_msg(int file);
+void profile_cache_quiet(int file, int lineno, const char *ptr);
+void profile_cache_line(int file, int lineno, const char *ptr, int entry);
+int profile_cache_load(const char *fname);
+void profile_cache_save(const char *fname);
+int profile_cache_owns(const char *ptr);
 
 // list.c
 void list(void);
@@ -536,6 +589,8 @@ unsigned extract_timeout(const char *str);
 void disable_file_or_dir(const char *fname);
 void disable_file_path(const char *path, const char *file);
 int safe_fd(const char *path, int flags);
+#define FNV1A_INIT 0xcbf29ce484222325ULL
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len);
 
 // Get info regarding the last kernel mount operation from /proc/self/mountinfo
 // The return value points to a static area, and will be overwritten by subsequent calls.
@@ -580,12 +635,38 @@ void fs_private_home_list(void);
 
 // seccomp.c
 char *seccomp_check_list(const char *str);
+void seccomp_save_linked(void);
 int seccomp_install_filters(void);
 int seccomp_load(const char *fname);
 int seccomp_filter_drop(void);
 int seccomp_filter_keep(void);
 void seccomp_print_filter(pid_t pid);
 
+// disk_cache.c
+typedef struct {
+	const char *dir;	// root-owned directory, one file for each user and key
+	const char *name;	// used in debug messages
+	uint32_t magic;
+	uint32_t version;
+	size_t data_max;	// bytes of data in an entry
+	unsigned entries;	// the least recently used entries of a user above entries
+	off_t size;		// or size bytes in total are removed
+} DiskCache;
+typedef struct {
+	char *map;		// the entry mapped in memory
+	size_t size;
+	char *data;		// the data saved with the key
+	size_t len;
+} DiskCacheEntry;
+int disk_cache_load(const DiskCache *cache, const char *key, DiskCacheEntry *entry);
+void disk_cache_unmap(DiskCacheEntry *entry);
+void disk_cache_save(const DiskCache *cache, const char *key, const void *data, size_t len);
+
+// seccomp_cache.c
+char *seccomp_cache_key(const char *cmd, const char *list);
+int seccomp_cache_load(const char *key);
+void seccomp_cache_save(const char *key);
+
 // caps.c
 int caps_default_filter(void);
 void caps_print(void);
@@ -664,6 +745,34 @@ void env_ibus_load(void);
 // fs_whitelist.c
 void fs_whitelist(void);
 
+// fs_glob.c
+typedef struct glob_batch_t GlobBatch;
+GlobBatch *glob_batch_new(void);
+int glob_batch_add(GlobBatch *batch, const char *pattern);
+void glob_batch_resolve(GlobBatch *batch);
+char **glob_batch_paths(GlobBatch *batch, int index, size_t *count);
+void glob_batch_free(GlobBatch *batch);
+
+// path_set.c
+typedef struct path_set_t PathSet;
+PathSet *path_set_new(void);
+void path_set_add(PathSet *set, const char *pattern);
+void path_set_add_literal(PathSet *set, const char *path);
+size_t path_set_count(PathSet *set);
+const char *path_set_entry(PathSet *set, size_t index);
+ssize_t path_set_match(PathSet *set, const char *path, size_t limit);
+void path_set_free(PathSet *set);
+
+// fs_plan.c
+void fs_plan_begin(void);
+int fs_plan_active(void);
+int fs_plan_hidden(const char *path);
+int fs_plan_blacklisted(const char *path);
+void fs_plan_blacklist(const char *path, int dir);
+int fs_plan_remount(const char *path, unsigned long flags);
+void fs_plan_apply(void);
+void fs_plan_end(void);
+
 // pulseaudio.c
 void pulseaudio_init(void);
 void pulseaudio_disable(void);
@@ -805,6 +914,8 @@ void build_appimage_cmdline(char **command_line, char **window_title, int argc,
 
 // run sbox
 int sbox_run(unsigned filter, int num, ...);
+void sbox_fcopy_add(const char *src, const char *dest);
+void sbox_fcopy_run(unsigned filter, int follow_link);
 
 // run_files.c
 void delete_run_files(pid_t pid);
@@ -24,7 +24,6 @@
 #include <sys/wait.h>
 #include <linux/limits.h>
 #include <fnmatch.h>
-#include <glob.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -62,6 +61,10 @@ static void disable_file(OPERATION op, const char *filename) {
 	assert(op <OPERATION_MAX);
 	last_disable = UNSUCCESSFUL;
 
+	// tmpfs and read-write mounts are not planned, they need the planned mounts in place
+	if (op == MOUNT_TMPFS || op == MOUNT_RDWR)
+		fs_plan_apply();
+
 	// Resolve all symlinks
 	char* fname = realpath(filename, NULL);
 	if (fname == NULL && errno != EACCES) {
@@ -73,6 +76,7 @@ static void disable_file(OPERATION op, const char *filename) {
 		// realpath and stat funtions will fail on FUSE filesystems
 		// they don't seem to like a uid of 0
 		// force mounting
+		fs_plan_apply();
 		int rv = mount(RUN_RO_DIR, filename, "none", MS_BIND, "mode=400,gid=0");
 		if (rv == 0)
 			last_disable = SUCCESSFUL;
@@ -101,6 +105,11 @@ static void disable_file(OPERATION op, const char *filename) {
 	struct stat s;
 	if (fname == NULL)
 		return;
+	// a directory waiting to be blacklisted hides the file, as if it was already mounted
+	if (fs_plan_hidden(fname) || fs_plan_hidden(filename)) {
+		free(fname);
+		return;
+	}
 	if (stat(fname, &s) == -1) {
 		if (arg_debug)
 			fwarning("%s does not exist, skipping...\n", fname);
@@ -116,6 +125,10 @@ static void disable_file(OPERATION op, const char *filename) {
 		      S_ISDIR(s.st_mode)) {
 			fwarning("%s directory link was not blacklisted\n", filename);
 		}
+		else if (fs_plan_blacklisted(fname)) {
+			// already disabled by an earlier command
+			last_disable = SUCCESSFUL;
+		}
 		else {
 			if (arg_debug) {
 				if (strcmp(filename, fname))
@@ -131,7 +144,9 @@ static void disable_file(OPERATION op, const char *filename) {
 					printf(" - no logging\n");
 			}
 
-			if (S_ISDIR(s.st_mode)) {
+			if (fs_plan_active())
+				fs_plan_blacklist(fname, S_ISDIR(s.st_mode));
+			else if (S_ISDIR(s.st_mode)) {
 				if (mount(RUN_RO_DIR, fname, "none", MS_BIND, "mode=400,gid=0") < 0)
 					errExit("disable file");
 			}
@@ -149,7 +164,10 @@ static void disable_file(OPERATION op, const char *filename) {
 	else if (op == MOUNT_READONLY) {
 		if (arg_debug)
 			printf("Mounting read-only %s\n", fname);
-		fs_rdonly(fname);
+		if (!fs_plan_active())
+			fs_rdonly(fname);
+		else if (fs_plan_remount(fname, MS_RDONLY))
+			fs_logger2("read-only", fname);
 // todo: last_disable = SUCCESSFUL;
 	}
 	else if (op == MOUNT_RDWR) {
@@ -161,7 +179,10 @@ static void disable_file(OPERATION op, const char *filename) {
 	else if (op == MOUNT_NOEXEC) {
 		if (arg_debug)
 			printf("Mounting noexec %s\n", fname);
-		fs_noexec(fname);
+		if (!fs_plan_active())
+			fs_noexec(fname);
+		else if (fs_plan_remount(fname, MS_NOEXEC|MS_NODEV|MS_NOSUID))
+			fs_logger2("noexec", fname);
 // todo: last_disable = SUCCESSFUL;
 	}
 	else if (op == MOUNT_TMPFS) {
@@ -194,9 +215,10 @@ static size_t nbcheck_size = 0;
 static int *nbcheck = NULL;
 #endif
 
-// Treat pattern as a shell glob pattern and blacklist matching files
-static void globbing(OPERATION op, const char *pattern, const char *noblacklist[], size_t noblacklist_len) {
-	assert(pattern);
+// Blacklist the paths a pattern globbed to, except the ones matching a noblacklist entry
+static void globbing(OPERATION op, char **paths, size_t paths_cnt, PathSet *noblacklist, size_t noblacklist_len) {
+	assert(paths);
+	assert(noblacklist);
 
 #ifdef TEST_NO_BLACKLIST_MATCHING
 	if (nbcheck_start == 0) {
@@ -209,89 +231,108 @@ static void globbing(OPERATION op, const char *pattern, const char *noblacklist[
 	}
 #endif
 
-	glob_t globbuf;
-	// Profiles contain blacklists for files that might not exist on a user's machine.
-	// GLOB_NOCHECK makes that okay.
-	int globerr = glob(pattern, GLOB_NOCHECK | GLOB_NOSORT | GLOB_PERIOD, NULL, &globbuf);
-	if (globerr) {
-		fprintf(stderr, "Error: failed to glob pattern %s\n", pattern);
-		exit(1);
-	}
-
-	size_t i, j;
-	for (i = 0; i < globbuf.gl_pathc; i++) {
-		char *path = globbuf.gl_pathv[i];
+	size_t i;
+	for (i = 0; i < paths_cnt; i++) {
+		char *path = paths[i];
 		assert(path);
 		// /home/me/.* can glob to /home/me/.. which would blacklist /home/
 		const char *base = gnu_basename(path);
 		if (strcmp(base, ".") == 0 || strcmp(base, "..") == 0)
 			continue;
-		// noblacklist is expected to be short in normal cases, so stupid and correct brute force is okay
-		bool okay_to_blacklist = true;
-		for (j = 0; j < noblacklist_len; j++) {
-			int result = fnmatch(noblacklist[j], path, FNM_PATHNAME);
-			if (result == FNM_NOMATCH)
-				continue;
-			else if (result == 0) {
-				okay_to_blacklist = false;
+
+		// only the noblacklist entries preceding the command apply
+		ssize_t j = path_set_match(noblacklist, path, noblacklist_len);
+		if (j == -1)
+			disable_file(op, path);
+		else {
 #ifdef TEST_NO_BLACKLIST_MATCHING
-				if (j < nbcheck_size)	// noblacklist checking
-					nbcheck[j] = 1;
+			if ((size_t) j < nbcheck_size)	// noblacklist checking
+				nbcheck[j] = 1;
 #endif
-				break;
-			}
-			else {
-				fprintf(stderr, "Error: failed to compare path %s with pattern %s\n", path, noblacklist[j]);
-				exit(1);
-			}
+			if (arg_debug)
+				printf("Not blacklist %s\n", path);
 		}
+	}
+}
 
-		if (okay_to_blacklist)
-			disable_file(op, path);
-		else if (arg_debug)
-			printf("Not blacklist %s\n", path);
+// blacklist commands waiting for their patterns to be resolved
+typedef struct pending_op_t {
+	OPERATION op;
+	int pattern;		// index in the glob batch
+	size_t noblacklist_len;	// noblacklist entries preceding the command
+} PendingOp;
+
+static GlobBatch *pending_batch = NULL;
+static PendingOp *pending = NULL;
+static size_t pending_cnt = 0;
+static size_t pending_max = 0;
+
+static void pending_add(OPERATION op, const char *pattern, size_t noblacklist_len) {
+	if (!pending_batch)
+		pending_batch = glob_batch_new();
+	if (pending_cnt == pending_max) {
+		pending_max = (pending_max) ? pending_max * 2 : 256;
+		pending = realloc(pending, pending_max * sizeof(PendingOp));
+		if (!pending)
+			errExit("realloc");
 	}
-	globfree(&globbuf);
+	pending[pending_cnt].op = op;
+	pending[pending_cnt].pattern = glob_batch_add(pending_batch, pattern);
+	pending[pending_cnt].noblacklist_len = noblacklist_len;
+	pending_cnt++;
 }
 
+// Resolve all pending patterns in one pass and apply the commands in profile order.
+// Mounts done by earlier commands are taken into account by disable_file(), which
+// resolves every path again and checks it against the mount plan before mounting
+// on top of it.
+static void pending_flush(PathSet *noblacklist) {
+	if (!pending_batch)
+		return;
+
+	glob_batch_resolve(pending_batch);
+	fs_plan_begin();
+	size_t i;
+	for (i = 0; i < pending_cnt; i++) {
+		size_t cnt;
+		char **paths = glob_batch_paths(pending_batch, pending[i].pattern, &cnt);
+		globbing(pending[i].op, paths, cnt, noblacklist, pending[i].noblacklist_len);
+	}
+	fs_plan_end();
+
+	glob_batch_free(pending_batch);
+	pending_batch = NULL;
+	free(pending);
+	pending = NULL;
+	pending_cnt = 0;
+	pending_max = 0;
+}
 
 // blacklist files or directories by mounting empty files on top of them
 void fs_blacklist(void) {
 	char *homedir = cfg.homedir;
 	assert(homedir);
-	ProfileEntry *entry = cfg.profile;
+	ProfileEntry *entry = cfg.profile_index[PROFILE_INDEX_BLACKLIST];
 	if (!entry)
 		return;
 
-	size_t noblacklist_c = 0;
-	size_t noblacklist_m = 32;
-	char **noblacklist = calloc(noblacklist_m, sizeof(*noblacklist));
-
-	if (noblacklist == NULL)
-		errExit("failed allocating memory for noblacklist entries");
+	PathSet *noblacklist = path_set_new();
 
 	while (entry) {
 		OPERATION op = OPERATION_MAX;
-		char *ptr;
-
-		// whitelist commands handled by fs_whitelist()
-		if (strncmp(entry->data, "whitelist ", 10) == 0 ||
-		    strncmp(entry->data, "nowhitelist ", 12) == 0 ||
-		   *entry->data == '\0') {
-			entry = entry->next;
-			continue;
-		}
+		char *ptr = entry->arg;
 
 		// process bind command
-		if (strncmp(entry->data, "bind ", 5) == 0)  {
+		if (entry->cmd == PROFILE_BIND)  {
+			pending_flush(noblacklist);
 			struct stat s;
-			char *dname1 = entry->data + 5;
+			char *dname1 = entry->arg;
 			char *dname2 = split_comma(dname1);
 			if (dname2 == NULL ||
 			    stat(dname1, &s) == -1 ||
 			    stat(dname2, &s) == -1) {
 				fprintf(stderr, "Error: invalid bind command, directory missing\n");
-				entry = entry->next;
+				entry = entry->next_index;
 				continue;
 			}
 
@@ -305,16 +346,16 @@ void fs_blacklist(void) {
 			if (set_perms(dname2,  s.st_uid, s.st_gid,s.st_mode))
 				errExit("set_perms");
 
-			entry = entry->next;
+			entry = entry->next_index;
 			continue;
 		}
 
 		// Process noblacklist command
-		if (strncmp(entry->data, "noblacklist ", 12) == 0) {
+		if (entry->cmd == PROFILE_NOBLACKLIST) {
 			char **enames;
 			int i;
 
-			if (strncmp(entry->data + 12, "${PATH}", 7) == 0) {
+			if (strncmp(entry->arg, "${PATH}", 7) == 0) {
 				// expand ${PATH} macro
 				char **paths = build_paths();
 				unsigned int npaths = count_paths();
@@ -324,7 +365,7 @@ void fs_blacklist(void) {
 
 				for (i = 0; paths[i]; i++) {
 					if (asprintf(&enames[i], "%s%s", paths[i],
-						entry->data + 19) == -1)
+						entry->arg + 7) == -1)
 						errExit("asprintf");
 				}
 				assert(enames[npaths-1] == 0);
@@ -335,68 +376,59 @@ void fs_blacklist(void) {
 				enames = calloc(2, sizeof(char *));
 				if (!enames)
 					errExit("calloc");
-				enames[0] = expand_home(entry->data + 12, homedir);
+				enames[0] = expand_home(entry->arg, homedir);
 				assert(enames[1] == 0);
 			}
 
 			for (i = 0; enames[i]; i++) {
-				if (noblacklist_c >= noblacklist_m) {
-					noblacklist_m *= 2;
-					noblacklist = realloc(noblacklist, sizeof(*noblacklist) * noblacklist_m);
-					if (noblacklist == NULL)
-						errExit("failed increasing memory for noblacklist entries");
-				}
-				noblacklist[noblacklist_c++] = enames[i];
+				path_set_add(noblacklist, enames[i]);
+				free(enames[i]);
 			}
 
 			free(enames);
 
-			entry = entry->next;
+			entry = entry->next_index;
 			continue;
 		}
 
 		// process blacklist command
-		if (strncmp(entry->data, "blacklist ", 10) == 0)  {
-			ptr = entry->data + 10;
+		switch (entry->cmd) {
+		case PROFILE_BLACKLIST:
 			op = BLACKLIST_FILE;
-		}
-		else if (strncmp(entry->data, "blacklist-nolog ", 16) == 0)  {
-			ptr = entry->data + 16;
+			break;
+		case PROFILE_BLACKLIST_NOLOG:
 			op = BLACKLIST_NOLOG;
-		}
-		else if (strncmp(entry->data, "read-only ", 10) == 0) {
-			ptr = entry->data + 10;
+			break;
+		case PROFILE_READ_ONLY:
 			op = MOUNT_READONLY;
-		}
-		else if (strncmp(entry->data, "read-write ", 11) == 0) {
-			ptr = entry->data + 11;
+			break;
+		case PROFILE_READ_WRITE:
 			op = MOUNT_RDWR;
-		}
-		else if (strncmp(entry->data, "noexec ", 7) == 0) {
-			ptr = entry->data + 7;
+			break;
+		case PROFILE_NOEXEC:
 			op = MOUNT_NOEXEC;
-		}
-		else if (strncmp(entry->data, "tmpfs ", 6) == 0) {
-			ptr = entry->data + 6;
+			break;
+		case PROFILE_TMPFS:
 			op = MOUNT_TMPFS;
-		}
-		else if (strncmp(entry->data, "mkdir ", 6) == 0) {
+			break;
+		case PROFILE_MKDIR:
+			// the new directory might be matched by the patterns that follow
+			pending_flush(noblacklist);
 			EUID_USER();
-			fs_mkdir(entry->data + 6);
+			fs_mkdir(entry->arg);
 			EUID_ROOT();
-			entry = entry->next;
+			entry = entry->next_index;
 			continue;
-		}
-		else if (strncmp(entry->data, "mkfile ", 7) == 0) {
+		case PROFILE_MKFILE:
+			pending_flush(noblacklist);
 			EUID_USER();
-			fs_mkfile(entry->data + 7);
+			fs_mkfile(entry->arg);
 			EUID_ROOT();
-			entry = entry->next;
+			entry = entry->next_index;
 			continue;
-		}
-		else {
+		default:
 			fprintf(stderr, "Error: invalid profile line %s\n", entry->data);
-			entry = entry->next;
+			entry = entry->next_index;
 			continue;
 		}
 
@@ -416,25 +448,26 @@ void fs_blacklist(void) {
 					i++;
 					char newname[strlen(path) + fname_len + 1];
 					sprintf(newname, "%s%s", path, fname);
-					globbing(op, newname, (const char**)noblacklist, noblacklist_c);
+					pending_add(op, newname, path_set_count(noblacklist));
 				}
 			}
 			else
-				globbing(op, ptr, (const char**)noblacklist, noblacklist_c);
+				pending_add(op, ptr, path_set_count(noblacklist));
 		}
 
 		if (new_name)
 			free(new_name);
-		entry = entry->next;
+		entry = entry->next_index;
 	}
+	pending_flush(noblacklist);
 
-	size_t i;
 #ifdef TEST_NO_BLACKLIST_MATCHING
 	// noblacklist checking
+	size_t i;
 	for (i = 0; i < nbcheck_size; i++)
 		if (!arg_quiet && !nbcheck[i])
 			printf("TESTING warning: noblacklist %s not matched by a proper blacklist command in disable*.inc\n",
-				 noblacklist[i]);
+				 path_set_entry(noblacklist, i));
 
 	// free memory
 	if (nbcheck) {
@@ -443,17 +476,43 @@ void fs_blacklist(void) {
 		nbcheck_size = 0;
 	}
 #endif
-	for (i = 0; i < noblacklist_c; i++)
-		free(noblacklist[i]);
-	free(noblacklist);
+	path_set_free(noblacklist);
 }
 
-static int get_mount_flags(const char *path, unsigned long *flags) {
+#ifndef ST_NOSYMFOLLOW
+#define ST_NOSYMFOLLOW 8192
+#endif
+#ifndef MS_NOSYMFOLLOW
+#define MS_NOSYMFOLLOW 256
+#endif
+
+// mount flags of the filesystem holding path; statvfs() reports ST_* flags, mount() takes MS_* flags
+int get_mount_flags(const char *path, unsigned long *flags) {
+	static const struct {
+		unsigned long st;
+		unsigned long ms;
+	} map[] = {
+		{ ST_RDONLY, MS_RDONLY },
+		{ ST_NOSUID, MS_NOSUID },
+		{ ST_NODEV, MS_NODEV },
+		{ ST_NOEXEC, MS_NOEXEC },
+		{ ST_SYNCHRONOUS, MS_SYNCHRONOUS },
+		{ ST_MANDLOCK, MS_MANDLOCK },
+		{ ST_NOATIME, MS_NOATIME },
+		{ ST_NODIRATIME, MS_NODIRATIME },
+		{ ST_RELATIME, MS_RELATIME },
+		{ ST_NOSYMFOLLOW, MS_NOSYMFOLLOW }
+	};
 	struct statvfs buf;
 
 	if (statvfs(path, &buf) < 0)
 		return -errno;
-	*flags = buf.f_flag;
+	*flags = 0;
+	size_t i;
+	for (i = 0; i < sizeof(map) / sizeof(map[0]); i++) {
+		if (buf.f_flag & map[i].st)
+			*flags |= map[i].ms;
+	}
 	return 0;
 }
 
@@ -124,11 +124,11 @@ static void duplicate(const char *fname, const char *private_dir, const char *pr
 		if (asprintf(&dirname, "%s/%s", private_run_dir, fname) == -1)
 			errExit("asprintf");
 		create_empty_dir_as_root(dirname, s.st_mode);
-		sbox_run(SBOX_ROOT| SBOX_SECCOMP, 3, PATH_FCOPY, src, dirname);
+		sbox_fcopy_add(src, dirname);
 		free(dirname);
 	}
 	else
-		sbox_run(SBOX_ROOT| SBOX_SECCOMP, 3, PATH_FCOPY, src, private_run_dir);
+		sbox_fcopy_add(src, private_run_dir);
 
 	fs_logger2("clone", src);
 	free(src);
@@ -167,6 +167,9 @@ void fs_private_dir_list(const char *private_dir, const char *private_run_dir, c
 		while ((ptr = strtok(NULL, ",")) != NULL)
 			duplicate(ptr, private_dir, private_run_dir);
 		free(dlist);
+
+		// copy all the files using a single fcopy process
+		sbox_fcopy_run(SBOX_ROOT | SBOX_SECCOMP, 0);
 		fs_logger_print();
 	}
 
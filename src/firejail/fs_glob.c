@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Batched glob resolver for fs_blacklist.
+//
+// Instead of calling glob(3) once per profile pattern, all patterns are
+// registered first and then resolved together: every pattern is split into
+// path components, the patterns are grouped by the directory they are
+// waiting on, and each directory is read only once. The directory entries
+// are matched against all the pending components of that directory in a
+// single pass. The results follow glob(pattern, GLOB_NOCHECK | GLOB_NOSORT |
+// GLOB_PERIOD) semantics; patterns the resolver does not handle are passed
+// to glob(3) directly.
+#include "firejail.h"
+#include <fnmatch.h>
+#include <glob.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define GLOB_HASH_SIZE 256
+#define GLOB_DENTS_BUF (32 * 1024)
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+typedef struct glob_pattern_t {
+	char *pattern;
+	char **comp;		// path components
+	int comp_cnt;
+	char **paths;		// resolved paths
+	size_t paths_cnt;
+	size_t paths_max;
+} GlobPattern;
+
+// a pattern waiting for a component to be matched in a directory
+typedef struct glob_item_t {
+	struct glob_item_t *next;
+	int pattern;
+	int comp;
+} GlobItem;
+
+typedef struct glob_dir_t {
+	struct glob_dir_t *next;	// hash chain
+	char *path;
+	int depth;
+	int done;
+	GlobItem *items;
+} GlobDir;
+
+struct glob_batch_t {
+	GlobPattern *patterns;
+	int patterns_cnt;
+	int patterns_max;
+	GlobDir *hash[GLOB_HASH_SIZE];
+	GlobDir **dirs;		// in creation order
+	int dirs_cnt;
+	int dirs_max;
+	int max_depth;
+};
+
+GlobBatch *glob_batch_new(void) {
+	GlobBatch *batch = calloc(1, sizeof(GlobBatch));
+	if (!batch)
+		errExit("calloc");
+	return batch;
+}
+
+static void add_path(GlobPattern *p, char *path) {
+	if (p->paths_cnt == p->paths_max) {
+		p->paths_max = (p->paths_max) ? p->paths_max * 2 : 4;
+		p->paths = realloc(p->paths, p->paths_max * sizeof(char *));
+		if (!p->paths)
+			errExit("realloc");
+	}
+	p->paths[p->paths_cnt++] = path;
+}
+
+// glob special characters, same rules as glob(3): a bracket is special only if it is closed
+static int has_magic(const char *str) {
+	const char *ptr;
+	for (ptr = str; *ptr; ptr++) {
+		if (*ptr == '*' || *ptr == '?')
+			return 1;
+		if (*ptr == '[' && strchr(ptr + 1, ']'))
+			return 1;
+	}
+	return 0;
+}
+
+// patterns left to glob(3): relative paths, escapes, empty components and trailing slashes
+static int unsupported(const char *pattern) {
+	return *pattern != '/' ||
+		strchr(pattern, '\\') ||
+		strstr(pattern, "//") ||
+		(strlen(pattern) > 1 && pattern[strlen(pattern) - 1] == '/');
+}
+
+static char *join_path(const char *dir, const char *name) {
+	char *rv;
+	if (asprintf(&rv, "%s%s%s", dir, (strcmp(dir, "/") == 0) ? "" : "/", name) == -1)
+		errExit("asprintf");
+	return rv;
+}
+
+// queue a component match in a directory; the directory is created if necessary
+static void queue_item(GlobBatch *batch, char *path, int depth, int pattern, int comp) {
+	unsigned h = fnv1a(FNV1A_INIT, path, strlen(path)) % GLOB_HASH_SIZE;
+	GlobDir *dir = batch->hash[h];
+	while (dir && strcmp(dir->path, path))
+		dir = dir->next;
+
+	if (dir)
+		free(path);
+	else {
+		dir = calloc(1, sizeof(GlobDir));
+		if (!dir)
+			errExit("calloc");
+		dir->path = path;
+		dir->depth = depth;
+		dir->next = batch->hash[h];
+		batch->hash[h] = dir;
+
+		if (batch->dirs_cnt == batch->dirs_max) {
+			batch->dirs_max = (batch->dirs_max) ? batch->dirs_max * 2 : 64;
+			batch->dirs = realloc(batch->dirs, batch->dirs_max * sizeof(GlobDir *));
+			if (!batch->dirs)
+				errExit("realloc");
+		}
+		batch->dirs[batch->dirs_cnt++] = dir;
+		if (depth > batch->max_depth)
+			batch->max_depth = depth;
+	}
+
+	// directories are processed from the top down, an item never lands in a processed directory
+	assert(!dir->done);
+	GlobItem *item = malloc(sizeof(GlobItem));
+	if (!item)
+		errExit("malloc");
+	item->pattern = pattern;
+	item->comp = comp;
+	item->next = dir->items;
+	dir->items = item;
+}
+
+// register a pattern; returns the index used to retrieve the results
+int glob_batch_add(GlobBatch *batch, const char *pattern) {
+	assert(batch);
+	assert(pattern);
+
+	if (batch->patterns_cnt == batch->patterns_max) {
+		batch->patterns_max = (batch->patterns_max) ? batch->patterns_max * 2 : 64;
+		batch->patterns = realloc(batch->patterns, batch->patterns_max * sizeof(GlobPattern));
+		if (!batch->patterns)
+			errExit("realloc");
+	}
+	int index = batch->patterns_cnt++;
+	GlobPattern *p = &batch->patterns[index];
+	memset(p, 0, sizeof(GlobPattern));
+	p->pattern = strdup(pattern);
+	if (!p->pattern)
+		errExit("strdup");
+
+	if (unsupported(pattern) || !has_magic(pattern))
+		return index;
+
+	// split in components
+	char *dup = strdup(pattern + 1);
+	if (!dup)
+		errExit("strdup");
+	char *saveptr;
+	char *tok = strtok_r(dup, "/", &saveptr);
+	while (tok) {
+		p->comp = realloc(p->comp, (p->comp_cnt + 1) * sizeof(char *));
+		if (!p->comp)
+			errExit("realloc");
+		p->comp[p->comp_cnt] = strdup(tok);
+		if (!p->comp[p->comp_cnt])
+			errExit("strdup");
+		p->comp_cnt++;
+		tok = strtok_r(NULL, "/", &saveptr);
+	}
+	free(dup);
+
+	// the literal prefix is the directory the pattern waits on
+	int i = 0;
+	char *prefix = strdup("/");
+	if (!prefix)
+		errExit("strdup");
+	while (!has_magic(p->comp[i])) {
+		char *tmp = join_path(prefix, p->comp[i]);
+		free(prefix);
+		prefix = tmp;
+		i++;
+	}
+	queue_item(batch, prefix, i, index, i);
+	return index;
+}
+
+// match the pending items of a directory against its entries
+static void process_dir(GlobBatch *batch, GlobDir *dir, char *buf) {
+	int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return;	// glob(3) ignores unreadable directories
+
+	// literal components don't need the directory listing
+	int need_list = 0;
+	GlobItem *item;
+	for (item = dir->items; item; item = item->next) {
+		GlobPattern *p = &batch->patterns[item->pattern];
+		const char *comp = p->comp[item->comp];
+		int last = (item->comp == p->comp_cnt - 1);
+
+		if (has_magic(comp))
+			need_list = 1;
+		else if (last) {
+			struct stat s;
+			if (fstatat(fd, comp, &s, AT_SYMLINK_NOFOLLOW) == 0)
+				add_path(p, join_path(dir->path, comp));
+		}
+		else
+			queue_item(batch, join_path(dir->path, comp), dir->depth + 1, item->pattern, item->comp + 1);
+	}
+
+	if (!need_list) {
+		close(fd);
+		return;
+	}
+
+	for (;;) {
+		long len = syscall(SYS_getdents64, fd, buf, GLOB_DENTS_BUF);
+		if (len <= 0)
+			break;
+
+		long pos = 0;
+		while (pos < len) {
+			struct linux_dirent64 *d = (struct linux_dirent64 *) (buf + pos);
+			pos += d->d_reclen;
+
+			// /home/me/.* would match /home/me/.. and blacklist /home/
+			if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+				continue;
+
+			for (item = dir->items; item; item = item->next) {
+				GlobPattern *p = &batch->patterns[item->pattern];
+				const char *comp = p->comp[item->comp];
+				int last = (item->comp == p->comp_cnt - 1);
+				if (!has_magic(comp))
+					continue;
+
+				if (last) {
+					// GLOB_PERIOD: a leading dot can be matched by a wildcard
+					if (fnmatch(comp, d->d_name, 0) == 0)
+						add_path(p, join_path(dir->path, d->d_name));
+				}
+				else if (d->d_type == DT_DIR || d->d_type == DT_LNK || d->d_type == DT_UNKNOWN) {
+					// glob(3) does not apply GLOB_PERIOD to directory components
+					if (fnmatch(comp, d->d_name, FNM_PERIOD) == 0)
+						queue_item(batch, join_path(dir->path, d->d_name), dir->depth + 1,
+							item->pattern, item->comp + 1);
+				}
+			}
+		}
+	}
+	close(fd);
+}
+
+void glob_batch_resolve(GlobBatch *batch) {
+	assert(batch);
+	char *buf = malloc(GLOB_DENTS_BUF);
+	if (!buf)
+		errExit("malloc");
+
+	// all items of a directory are known once the directories above it were processed
+	int depth;
+	for (depth = 0; depth <= batch->max_depth; depth++) {
+		int i;
+		for (i = 0; i < batch->dirs_cnt; i++) {
+			GlobDir *dir = batch->dirs[i];
+			if (dir->depth == depth && !dir->done) {
+				dir->done = 1;
+				process_dir(batch, dir, buf);
+			}
+		}
+	}
+	free(buf);
+
+	int i;
+	for (i = 0; i < batch->patterns_cnt; i++) {
+		GlobPattern *p = &batch->patterns[i];
+		if (unsupported(p->pattern)) {
+			glob_t globbuf;
+			int globerr = glob(p->pattern, GLOB_NOCHECK | GLOB_NOSORT | GLOB_PERIOD, NULL, &globbuf);
+			if (globerr) {
+				fprintf(stderr, "Error: failed to glob pattern %s\n", p->pattern);
+				exit(1);
+			}
+			size_t j;
+			for (j = 0; j < globbuf.gl_pathc; j++) {
+				char *path = strdup(globbuf.gl_pathv[j]);
+				if (!path)
+					errExit("strdup");
+				add_path(p, path);
+			}
+			globfree(&globbuf);
+		}
+		else if (p->paths_cnt == 0) {
+			// GLOB_NOCHECK: profiles contain blacklists for files that might not exist on a user's machine
+			char *path = strdup(p->pattern);
+			if (!path)
+				errExit("strdup");
+			add_path(p, path);
+		}
+	}
+}
+
+char **glob_batch_paths(GlobBatch *batch, int index, size_t *count) {
+	assert(batch);
+	assert(index >= 0 && index < batch->patterns_cnt);
+	assert(count);
+	*count = batch->patterns[index].paths_cnt;
+	return batch->patterns[index].paths;
+}
+
+void glob_batch_free(GlobBatch *batch) {
+	if (!batch)
+		return;
+
+	int i;
+	for (i = 0; i < batch->patterns_cnt; i++) {
+		GlobPattern *p = &batch->patterns[i];
+		int j;
+		for (j = 0; j < p->comp_cnt; j++)
+			free(p->comp[j]);
+		free(p->comp);
+		size_t k;
+		for (k = 0; k < p->paths_cnt; k++)
+			free(p->paths[k]);
+		free(p->paths);
+		free(p->pattern);
+	}
+	free(batch->patterns);
+
+	for (i = 0; i < batch->dirs_cnt; i++) {
+		GlobDir *dir = batch->dirs[i];
+		GlobItem *item = dir->items;
+		while (item) {
+			GlobItem *next = item->next;
+			free(item);
+			item = next;
+		}
+		free(dir->path);
+		free(dir);
+	}
+	free(batch->dirs);
+	free(batch);
+}
@@ -450,11 +450,11 @@ static void duplicate(char *name) {
 		if (asprintf(&name, "%s/%s", RUN_HOME_DIR, ptr) == -1)
 			errExit("asprintf");
 		mkdir_attr(name, 0755, getuid(), getgid());
-		sbox_run(SBOX_USER| SBOX_CAPS_NONE | SBOX_SECCOMP, 3, PATH_FCOPY, fname, name);
+		sbox_fcopy_add(fname, name);
 		free(name);
 	}
 	else
-		sbox_run(SBOX_USER| SBOX_CAPS_NONE | SBOX_SECCOMP, 3, PATH_FCOPY, fname, RUN_HOME_DIR);
+		sbox_fcopy_add(fname, RUN_HOME_DIR);
 	fs_logger2("clone", fname);
 	fs_logger_print();	// save the current log
 
@@ -498,6 +498,8 @@ void fs_private_home_list(void) {
 	while ((ptr = strtok(NULL, ",")) != NULL)
 		duplicate(ptr);
 
+	// copy all the files using a single fcopy process
+	sbox_fcopy_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 0);
 	fs_logger_print();	// save the current log
 	free(dlist);
 
@@ -33,6 +33,30 @@ extern void fslib_install_system(void);
 static int lib_cnt = 0;
 static int dir_cnt = 0;
 
+// destination files queued for the fcopy batch, they are not present yet in RUN_LIB_DIR
+static char **queued = NULL;
+static int queued_cnt = 0;
+static int queued_size = 0;
+
+static int is_queued(const char *name) {
+	int i;
+	for (i = 0; i < queued_cnt; i++) {
+		if (strcmp(queued[i], name) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static void queue(char *name) {
+	if (queued_cnt == queued_size) {
+		queued_size = (queued_size) ? 2 * queued_size : 256;
+		queued = realloc(queued, queued_size * sizeof(char *));
+		if (!queued)
+			errExit("realloc");
+	}
+	queued[queued_cnt++] = name;
+}
+
 static void report_duplication(const char *full_path) {
 	char *fname = strrchr(full_path, '/');
 	if (fname && *(++fname) != '\0') {
@@ -77,16 +101,16 @@ void fslib_duplicate(const char *full_path) {
 	char *name;
 	if (asprintf(&name, "%s/%s", dest_dir, ptr) == -1)
 		errExit("asprintf");
-	if (stat(name, &s) == 0) {
+	if (stat(name, &s) == 0 || is_queued(name)) {
 		free(name);
 		return;
 	}
-	free(name);
+	queue(name);
 
 	if (arg_debug || arg_debug_private_lib)
 		printf("    copying %s to private %s\n", full_path, dest_dir);
 
-	sbox_run(SBOX_ROOT| SBOX_SECCOMP, 4, PATH_FCOPY, "--follow-link", full_path, dest_dir);
+	sbox_fcopy_add(full_path, dest_dir);
 	report_duplication(full_path);
 	lib_cnt++;
 }
@@ -370,8 +394,11 @@ void fs_private_lib(void) {
 	// bring in firejail executable libraries in case we are redirected here by a firejail symlink from /usr/local/bin/firejail
 	fslib_install_list("/usr/bin/firejail,firejail"); // todo: use the installed path for the executable
 
-	fmessage("Installed %d %s and %d %s\n", lib_cnt, (lib_cnt == 1)? "library": "libraries",
-		dir_cnt, (dir_cnt == 1)? "directory": "directories");
+	// copy all the libraries using a single fcopy process
+	timetrace_start();
+	sbox_fcopy_run(SBOX_ROOT | SBOX_SECCOMP, 1);
+	fmessage("Installed %d %s and %d %s in %0.2f ms\n", lib_cnt, (lib_cnt == 1)? "library": "libraries",
+		dir_cnt, (dir_cnt == 1)? "directory": "directories", timetrace_end());
 
 	// mount lib filesystem
 	mount_directories();
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Mount planner for fs_blacklist.
+//
+// While a plan is active, blacklist, read-only and noexec mounts are collected
+// instead of being executed, and the plan is applied in one go. On the way in:
+//	- a file blacklisted by several commands is mounted only once (with
+//	  ${PATH} expansion and a symlinked /bin this is most of them)
+//	- read-only and noexec requests for the same path are merged in a
+//	  single mount
+//	- anything planned on a directory or below it is dropped when the
+//	  directory itself gets blacklisted, the mounts would be hidden anyway
+//	- paths below a planned blacklisted directory are reported as hidden,
+//	  exactly as if the directory was already mounted
+// Read-only and noexec mounts are built with open_tree/mount_setattr/move_mount
+// where the kernel supports them: the tree is cloned, only the requested
+// attributes are set on the clone, and the clone is moved in place. On older
+// kernels the usual bind mount and remount are used.
+#include "firejail.h"
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#define MOUNT_ATTR_NOSUID 0x00000002
+#define MOUNT_ATTR_NODEV 0x00000004
+#define MOUNT_ATTR_NOEXEC 0x00000008
+#endif
+
+#define PLAN_HASH_SIZE 1024
+
+typedef enum {
+	PLAN_BLACKLIST_DIR,
+	PLAN_BLACKLIST_FILE,
+	PLAN_REMOUNT,
+	PLAN_DROPPED
+} PlanType;
+
+typedef struct plan_op_t {
+	struct plan_op_t *next;		// hash chain
+	PlanType type;
+	char *path;
+	unsigned long flags;		// MS_RDONLY, MS_NOEXEC, MS_NODEV, MS_NOSUID for PLAN_REMOUNT
+} PlanOp;
+
+static int plan_active = 0;
+static PlanOp **plan = NULL;		// operations in the order they were requested
+static size_t plan_cnt = 0;
+static size_t plan_max = 0;
+static PlanOp *plan_hash[PLAN_HASH_SIZE];
+
+// find a blacklist operation (remount == 0) or a remount operation for the first len bytes of path
+static PlanOp *plan_find(const char *path, size_t len, int remount) {
+	PlanOp *op = plan_hash[fnv1a(FNV1A_INIT, path, len) % PLAN_HASH_SIZE];
+	for (; op; op = op->next) {
+		if (op->type == PLAN_DROPPED)
+			continue;
+		if ((op->type == PLAN_REMOUNT) != remount)
+			continue;
+		if (strncmp(op->path, path, len) == 0 && op->path[len] == '\0')
+			return op;
+	}
+	return NULL;
+}
+
+static PlanOp *plan_add(PlanType type, const char *path, unsigned long flags) {
+	PlanOp *op = malloc(sizeof(PlanOp));
+	if (!op)
+		errExit("malloc");
+	op->type = type;
+	op->path = strdup(path);
+	if (!op->path)
+		errExit("strdup");
+	op->flags = flags;
+
+	unsigned h = fnv1a(FNV1A_INIT, path, strlen(path)) % PLAN_HASH_SIZE;
+	op->next = plan_hash[h];
+	plan_hash[h] = op;
+
+	if (plan_cnt == plan_max) {
+		plan_max = (plan_max) ? plan_max * 2 : 256;
+		plan = realloc(plan, plan_max * sizeof(PlanOp *));
+		if (!plan)
+			errExit("realloc");
+	}
+	plan[plan_cnt++] = op;
+	return op;
+}
+
+void fs_plan_begin(void) {
+	assert(!plan_active);
+	plan_active = 1;
+}
+
+int fs_plan_active(void) {
+	return plan_active;
+}
+
+// the path is below a directory waiting to be blacklisted
+int fs_plan_hidden(const char *path) {
+	assert(path);
+	if (!plan_active || *path != '/')
+		return 0;
+
+	size_t len = strlen(path);
+	while (len > 1) {
+		// strip the last component
+		while (len > 0 && path[len - 1] != '/')
+			len--;
+		while (len > 1 && path[len - 1] == '/')
+			len--;
+		if (len == 0)
+			break;
+
+		PlanOp *op = plan_find(path, len, 0);
+		if (op && op->type == PLAN_BLACKLIST_DIR)
+			return 1;
+	}
+	return 0;
+}
+
+// the same file was already blacklisted
+int fs_plan_blacklisted(const char *path) {
+	assert(path);
+	return plan_active && plan_find(path, strlen(path), 0) != NULL;
+}
+
+void fs_plan_blacklist(const char *path, int dir) {
+	assert(path);
+	assert(plan_active);
+
+	if (dir) {
+		// everything planned on the directory or below it ends up under the new mount
+		size_t len = strlen(path);
+		size_t i;
+		for (i = 0; i < plan_cnt; i++) {
+			PlanOp *op = plan[i];
+			if (op->type != PLAN_DROPPED &&
+			    strncmp(op->path, path, len) == 0 &&
+			    (op->path[len] == '\0' || op->path[len] == '/' || len == 1))
+				op->type = PLAN_DROPPED;
+		}
+	}
+	plan_add((dir) ? PLAN_BLACKLIST_DIR : PLAN_BLACKLIST_FILE, path, 0);
+}
+
+// Plan a remount of path with the extra flags; returns 0 if the flags are already in place.
+int fs_plan_remount(const char *path, unsigned long flags) {
+	assert(path);
+	assert(plan_active);
+
+	unsigned long current;
+	if (get_mount_flags(path, &current))
+		return 0;
+	PlanOp *op = plan_find(path, strlen(path), 1);
+	if (op)
+		current |= op->flags;
+	if ((current & flags) == flags)
+		return 0;
+
+	if (op)
+		op->flags |= flags;
+	else
+		plan_add(PLAN_REMOUNT, path, flags);
+	return 1;
+}
+
+static void remount_legacy(const char *path, unsigned long flags) {
+	// mount --bind /bin /bin
+	// mount --bind -o remount,ro /bin
+	unsigned long current;
+	if (get_mount_flags(path, &current))
+		errExit("statvfs");
+	if (mount(path, path, NULL, MS_BIND|MS_REC, NULL) < 0 ||
+	    mount(NULL, path, NULL, current|flags|MS_BIND|MS_REMOUNT|MS_REC, NULL) < 0)
+		errExit((flags & MS_NOEXEC) ? "mount noexec" : "mount read-only");
+}
+
+#if defined(SYS_open_tree) && defined(SYS_mount_setattr) && defined(SYS_move_mount)
+struct plan_mount_attr {
+	uint64_t attr_set;
+	uint64_t attr_clr;
+	uint64_t propagation;
+	uint64_t userns_fd;
+};
+
+// clone the tree, set the attributes on the clone and move the clone on top of the original
+static int remount_tree(const char *path, unsigned long flags) {
+	struct plan_mount_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	if (flags & MS_RDONLY)
+		attr.attr_set |= MOUNT_ATTR_RDONLY;
+	if (flags & MS_NOEXEC)
+		attr.attr_set |= MOUNT_ATTR_NOEXEC;
+	if (flags & MS_NODEV)
+		attr.attr_set |= MOUNT_ATTR_NODEV;
+	if (flags & MS_NOSUID)
+		attr.attr_set |= MOUNT_ATTR_NOSUID;
+
+	int fd = syscall(SYS_open_tree, AT_FDCWD, path, OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+	if (fd == -1)
+		return -1;
+	if (syscall(SYS_mount_setattr, fd, "", AT_EMPTY_PATH, &attr, sizeof(attr)) == -1 ||
+	    syscall(SYS_move_mount, fd, "", AT_FDCWD, path, MOVE_MOUNT_F_EMPTY_PATH) == -1) {
+		int err = errno;
+		close(fd);	// the detached tree goes away with the descriptor
+		errno = err;
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+#endif
+
+static void remount(const char *path, unsigned long flags) {
+#if defined(SYS_open_tree) && defined(SYS_mount_setattr) && defined(SYS_move_mount)
+	static int new_api = 1;
+	if (new_api) {
+		if (remount_tree(path, flags) == 0)
+			return;
+		// not available on kernels older than 5.12
+		if (errno == ENOSYS)
+			new_api = 0;
+		if (arg_debug)
+			printf("Debug: mount API not usable for %s (%s), remounting\n", path, strerror(errno));
+	}
+#endif
+	remount_legacy(path, flags);
+}
+
+// mount everything planned so far; the plan stays active
+void fs_plan_apply(void) {
+	if (!plan_active)
+		return;
+
+	size_t i;
+	size_t mounts = 0;
+	for (i = 0; i < plan_cnt; i++) {
+		PlanOp *op = plan[i];
+		switch (op->type) {
+		case PLAN_BLACKLIST_DIR:
+			if (mount(RUN_RO_DIR, op->path, "none", MS_BIND, "mode=400,gid=0") < 0)
+				errExit("disable file");
+			mounts++;
+			break;
+		case PLAN_BLACKLIST_FILE:
+			if (mount(RUN_RO_FILE, op->path, "none", MS_BIND, "mode=400,gid=0") < 0)
+				errExit("disable file");
+			mounts++;
+			break;
+		case PLAN_REMOUNT:
+			remount(op->path, op->flags);
+			mounts++;
+			break;
+		case PLAN_DROPPED:
+			break;
+		}
+	}
+	if (arg_debug && plan_cnt)
+		printf("Mount plan: %zu operations, %zu mounts\n", plan_cnt, mounts);
+
+	for (i = 0; i < plan_cnt; i++) {
+		free(plan[i]->path);
+		free(plan[i]);
+	}
+	free(plan);
+	plan = NULL;
+	plan_cnt = 0;
+	plan_max = 0;
+	memset(plan_hash, 0, sizeof(plan_hash));
+}
+
+void fs_plan_end(void) {
+	fs_plan_apply();
+	plan_active = 0;
+}
@@ -32,7 +32,6 @@
 // 2. run firejail --whitelist=/any/directory
 //#define TEST_MOUNTINFO
 
-#define EMPTY_STRING ("")
 #define MAXBUF 4098
 
 // returns mallocated memory
@@ -124,7 +123,7 @@ static int mkpath(const char* path, mode_t mode) {
 
 static void whitelist_path(ProfileEntry *entry) {
 	assert(entry);
-	const char *path = entry->data + 10;
+	const char *path = entry->arg;
 	assert(path);
 	const char *fname;
 	char *wfile = NULL;
@@ -331,7 +330,7 @@ static void whitelist_path(ProfileEntry *entry) {
 void fs_whitelist(void) {
 	char *homedir = cfg.homedir;
 	assert(homedir);
-	ProfileEntry *entry = cfg.profile;
+	ProfileEntry *entry = cfg.profile_index[PROFILE_INDEX_WHITELIST];
 	if (!entry)
 		return;
 
@@ -348,11 +347,7 @@ void fs_whitelist(void) {
 	int share_dir = 0;                // /usr/share directory flag
 	int module_dir = 0;                // /sys/module directory flag
 
-	size_t nowhitelist_c = 0;
-	size_t nowhitelist_m = 32;
-	char **nowhitelist = calloc(nowhitelist_m, sizeof(*nowhitelist));
-	if (nowhitelist == NULL)
-		errExit("failed allocating memory for nowhitelist entries");
+	PathSet *nowhitelist = path_set_new();
 
 	// verify whitelist files, extract symbolic links, etc.
 	EUID_USER();
@@ -360,16 +355,16 @@ void fs_whitelist(void) {
 	while (entry) {
 		int nowhitelist_flag = 0;
 
-		// handle only whitelist and nowhitelist commands
-		if (strncmp(entry->data, "whitelist ", 10) == 0)
+		// skip the entries removed from the list
+		if (entry->cmd == PROFILE_WHITELIST)
 			nowhitelist_flag = 0;
-		else if (strncmp(entry->data, "nowhitelist ", 12) == 0)
+		else if (entry->cmd == PROFILE_NOWHITELIST)
 			nowhitelist_flag = 1;
 		else {
-			entry = entry->next;
+			entry = entry->next_index;
 			continue;
 		}
-		char *dataptr = (nowhitelist_flag)? entry->data + 12: entry->data + 10;
+		char *dataptr = entry->arg;
 
 		// resolve macros
 		if (is_macro(dataptr)) {
@@ -378,8 +373,8 @@ void fs_whitelist(void) {
 				tmp = parse_nowhitelist(nowhitelist_flag, tmp);
 
 			if (tmp) {
-				entry->data = tmp;
-				dataptr = (nowhitelist_flag)? entry->data + 12: entry->data + 10;
+				profile_entry_set(entry, tmp);
+				dataptr = entry->arg;
 			}
 			else {
 				if (!nowhitelist_flag && !arg_quiet && !arg_private) {
@@ -388,7 +383,7 @@ void fs_whitelist(void) {
 					fprintf(stderr, "*** Any file saved in this directory will be lost when the sandbox is closed.\n");
 					fprintf(stderr, "***\n");
 				}
-				entry->data = EMPTY_STRING;
+				profile_entry_clear(entry);
 				continue;
 			}
 		}
@@ -474,25 +469,20 @@ void fs_whitelist(void) {
 					module_dir = 1;
 			}
 
-			entry->data = EMPTY_STRING;
+			profile_entry_clear(entry);
 			continue;
 		}
 		else if (arg_debug_whitelists)
 			printf("real path %s\n", fname);
 
 		if (nowhitelist_flag) {
-			// store the path in nowhitelist array
+			// store the path in nowhitelist set
 			if (arg_debug || arg_debug_whitelists)
 				printf("Storing nowhitelist %s\n", fname);
 
-			if (nowhitelist_c >= nowhitelist_m) {
-				nowhitelist_m *= 2;
-				nowhitelist = realloc(nowhitelist, sizeof(*nowhitelist) * nowhitelist_m);
-				if (nowhitelist == NULL)
-					errExit("failed increasing memory for nowhitelist entries");
-			}
-			nowhitelist[nowhitelist_c++] = fname;
-			entry->data = EMPTY_STRING;
+			path_set_add_literal(nowhitelist, fname);
+			free(fname);
+			profile_entry_clear(entry);
 			continue;
 		}
 
@@ -503,7 +493,7 @@ void fs_whitelist(void) {
 				if (arg_debug || arg_debug_whitelists)
 					printf("\"%s\" disabled by --private\n", entry->data);
 
-				entry->data = EMPTY_STRING;
+				profile_entry_clear(entry);
 				continue;
 			}
 
@@ -634,22 +624,12 @@ void fs_whitelist(void) {
 			goto errexit;
 		}
 
-		// check if the path is in nowhitelist array
+		// check if the path is in nowhitelist set
 		if (nowhitelist_flag == 0) {
-			size_t i;
-			int found = 0;
-			for (i = 0; i < nowhitelist_c; i++) {
-				if (nowhitelist[i] == NULL)
-					break;
-				if (strcmp(nowhitelist[i], fname) == 0) {
-					found = 1;
-					break;
-				}
-			}
-			if (found) {
+			if (path_set_match(nowhitelist, fname, SIZE_MAX) != -1) {
 				if (arg_debug || arg_debug_whitelists)
 					printf("Skip nowhitelisted path %s\n", fname);
-				entry->data = EMPTY_STRING;
+				profile_entry_clear(entry);
 				free(fname);
 				continue;
 			}
@@ -664,21 +644,20 @@ void fs_whitelist(void) {
 		}
 
 		// change file name in entry->data
-		if (strcmp(fname, entry->data + 10) != 0) {
+		if (strcmp(fname, entry->arg) != 0) {
 			char *newdata;
 			if (asprintf(&newdata, "whitelist %s", fname) == -1)
 				errExit("asprintf");
-			entry->data = newdata;
+			profile_entry_set(entry, newdata);
 			if (arg_debug || arg_debug_whitelists)
 				printf("Replaced whitelist path: %s\n", entry->data);
 		}
 		free(fname);
-		entry = entry->next;
+		entry = entry->next_index;
 	}
 
 	// release nowhitelist memory
-	assert(nowhitelist);
-	free(nowhitelist);
+	path_set_free(nowhitelist);
 
 	EUID_ROOT();
 	// /home/user mountpoint
@@ -885,11 +864,11 @@ void fs_whitelist(void) {
 
 
 	// go through profile rules again, and interpret whitelist commands
-	entry = cfg.profile;
+	entry = cfg.profile_index[PROFILE_INDEX_WHITELIST];
 	while (entry) {
 		// handle only whitelist commands
-		if (strncmp(entry->data, "whitelist ", 10)) {
-			entry = entry->next;
+		if (entry->cmd != PROFILE_WHITELIST) {
+			entry = entry->next_index;
 			continue;
 		}
 
@@ -907,13 +886,13 @@ void fs_whitelist(void) {
 					if (arg_debug || arg_debug_whitelists)
 						printf("Debug %d: cannot create symbolic link %s\n", __LINE__, entry->link);
 					free(entry->link);
-					entry = entry->next;
+					entry = entry->next_index;
 					continue;
 				}
 				// get file name of symlink
 				const char *file = gnu_basename(entry->link);
 				// create the link
-				int rv = symlinkat(entry->data + 10, fd, file);
+				int rv = symlinkat(entry->arg, fd, file);
 				if (rv) {
 					if (arg_debug || arg_debug_whitelists) {
 						perror("symlink");
@@ -921,13 +900,13 @@ void fs_whitelist(void) {
 					}
 				}
 				else if (arg_debug || arg_debug_whitelists)
-					printf("Created symbolic link %s -> %s\n", entry->link, entry->data + 10);
+					printf("Created symbolic link %s -> %s\n", entry->link, entry->arg);
 				close(fd);
 			}
 			free(entry->link);
 		}
 
-		entry = entry->next;
+		entry = entry->next_index;
 	}
 
 	// mask the real home directory, currently mounted on RUN_WHITELIST_HOME_DIR
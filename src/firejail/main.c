@@ -2567,16 +2567,7 @@ int main(int argc, char **argv) {
 	waitpid(child, &status, 0);
 
 	// free globals
-	if (cfg.profile) {
-		ProfileEntry *prf = cfg.profile;
-		while (prf != NULL) {
-			ProfileEntry *next = prf->next;
-			free(prf->data);
-			free(prf->link);
-			free(prf);
-			prf = next;
-		}
-	}
+	profile_free();
 
 	if (WIFEXITED(status)){
 		myexit(WEXITSTATUS(status));
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Compiled set of noblacklist/nowhitelist entries.
+//
+// The entries are stored in a trie of path components. Literal entries mark
+// the node of their last component. A glob pattern is attached to the node
+// of its literal directory prefix, and only the rest of the pattern is checked
+// with fnmatch(FNM_PATHNAME) when a path walks through that node. A path is
+// checked by walking the trie once, so only the patterns sharing its directory
+// prefix are ever tried. Entries that can't be split in components (relative
+// paths, empty components, trailing slashes) are checked on every path, and
+// paths that can't be split in components are checked against every entry.
+//
+// Every entry has the index it was added with; a lookup returns the lowest
+// matching index, the same entry a linear scan of the list would find first.
+#include "firejail.h"
+#include <fnmatch.h>
+
+typedef struct path_pattern_t {
+	struct path_pattern_t *next;
+	char *pattern;		// the entry, or the part of it below the trie node
+	size_t index;
+	int literal;
+} PathPattern;
+
+typedef struct path_node_t {
+	char *name;
+	struct path_node_t **child;	// sorted by name
+	size_t child_cnt;
+	size_t child_max;
+	size_t index;			// literal entry ending here, or SIZE_MAX
+	PathPattern *patterns;		// glob patterns relative to this node
+} PathNode;
+
+struct path_set_t {
+	PathNode *root;
+	PathPattern *fallback;
+	PathPattern **entry;	// all the entries, by index
+	size_t cnt;
+	size_t max;
+};
+
+static PathNode *node_new(const char *name, size_t len) {
+	PathNode *node = calloc(1, sizeof(PathNode));
+	if (!node)
+		errExit("calloc");
+	node->name = strndup(name, len);
+	if (!node->name)
+		errExit("strndup");
+	node->index = SIZE_MAX;
+	return node;
+}
+
+static void node_free(PathNode *node) {
+	size_t i;
+	for (i = 0; i < node->child_cnt; i++)
+		node_free(node->child[i]);
+	free(node->child);
+
+	PathPattern *p = node->patterns;
+	while (p) {
+		PathPattern *next = p->next;
+		free(p->pattern);
+		free(p);
+		p = next;
+	}
+	free(node->name);
+	free(node);
+}
+
+static int compare_name(const char *name, size_t len, const char *node_name) {
+	int rv = strncmp(name, node_name, len);
+	if (rv == 0 && node_name[len] != '\0')
+		rv = -1;
+	return rv;
+}
+
+// binary search; returns the position where the child is or should be inserted
+static size_t node_search(PathNode *node, const char *name, size_t len, int *found) {
+	size_t lo = 0;
+	size_t hi = node->child_cnt;
+	*found = 0;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		int rv = compare_name(name, len, node->child[mid]->name);
+		if (rv == 0) {
+			*found = 1;
+			return mid;
+		}
+		if (rv < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+static PathNode *node_child(PathNode *node, const char *name, size_t len, int create) {
+	int found;
+	size_t pos = node_search(node, name, len, &found);
+	if (found)
+		return node->child[pos];
+	if (!create)
+		return NULL;
+
+	if (node->child_cnt == node->child_max) {
+		node->child_max = (node->child_max) ? node->child_max * 2 : 4;
+		node->child = realloc(node->child, node->child_max * sizeof(PathNode *));
+		if (!node->child)
+			errExit("realloc");
+	}
+	memmove(&node->child[pos + 1], &node->child[pos], (node->child_cnt - pos) * sizeof(PathNode *));
+	node->child_cnt++;
+	node->child[pos] = node_new(name, len);
+	return node->child[pos];
+}
+
+static PathPattern *pattern_new(const char *pattern, size_t index, int literal) {
+	PathPattern *p = malloc(sizeof(PathPattern));
+	if (!p)
+		errExit("malloc");
+	p->pattern = strdup(pattern);
+	if (!p->pattern)
+		errExit("strdup");
+	p->index = index;
+	p->literal = literal;
+	p->next = NULL;
+	return p;
+}
+
+static void pattern_append(PathPattern **list, PathPattern *p) {
+	while (*list)
+		list = &(*list)->next;
+	*list = p;
+}
+
+// absolute path without empty components and without a trailing slash
+static int is_clean(const char *path) {
+	if (*path != '/')
+		return 0;
+	if (strstr(path, "//"))
+		return 0;
+	size_t len = strlen(path);
+	if (len > 1 && path[len - 1] == '/')
+		return 0;
+	return 1;
+}
+
+// fnmatch special characters, including escapes
+static int has_magic(const char *str, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (str[i] == '*' || str[i] == '?' || str[i] == '[' || str[i] == '\\')
+			return 1;
+	return 0;
+}
+
+PathSet *path_set_new(void) {
+	PathSet *set = calloc(1, sizeof(PathSet));
+	if (!set)
+		errExit("calloc");
+	set->root = node_new("", 0);
+	return set;
+}
+
+static void add_entry(PathSet *set, const char *entry, int literal) {
+	assert(set);
+	assert(entry);
+	if (set->cnt == set->max) {
+		set->max = (set->max) ? set->max * 2 : 32;
+		set->entry = realloc(set->entry, set->max * sizeof(PathPattern *));
+		if (!set->entry)
+			errExit("realloc");
+	}
+	size_t index = set->cnt++;
+	set->entry[index] = pattern_new(entry, index, literal);
+
+	if (!is_clean(entry)) {
+		pattern_append(&set->fallback, pattern_new(entry, index, literal));
+		return;
+	}
+
+	// walk down the literal components
+	PathNode *node = set->root;
+	const char *ptr = entry + 1;
+	while (*ptr) {
+		const char *end = strchrnul(ptr, '/');
+		size_t len = end - ptr;
+		if (!literal && has_magic(ptr, len)) {
+			pattern_append(&node->patterns, pattern_new(ptr, index, 0));
+			return;
+		}
+		node = node_child(node, ptr, len, 1);
+		ptr = (*end) ? end + 1 : end;
+	}
+
+	// the first entry wins
+	if (node->index == SIZE_MAX)
+		node->index = index;
+}
+
+// add a glob pattern, matched with fnmatch(FNM_PATHNAME)
+void path_set_add(PathSet *set, const char *pattern) {
+	add_entry(set, pattern, 0);
+}
+
+// add a path, matched with strcmp
+void path_set_add_literal(PathSet *set, const char *path) {
+	add_entry(set, path, 1);
+}
+
+size_t path_set_count(PathSet *set) {
+	assert(set);
+	return set->cnt;
+}
+
+// the entry with the given index, as it was added
+const char *path_set_entry(PathSet *set, size_t index) {
+	assert(set);
+	assert(index < set->cnt);
+	return set->entry[index]->pattern;
+}
+
+static int pattern_match(PathSet *set, PathPattern *p, const char *path) {
+	if (p->literal)
+		return strcmp(p->pattern, path) == 0;
+
+	int result = fnmatch(p->pattern, path, FNM_PATHNAME);
+	if (result == 0)
+		return 1;
+	if (result != FNM_NOMATCH) {
+		fprintf(stderr, "Error: failed to compare path %s with pattern %s\n", path, set->entry[p->index]->pattern);
+		exit(1);
+	}
+	return 0;
+}
+
+// Return the index of the first entry matching path, considering only the
+// first limit entries, or -1 if there is no match.
+ssize_t path_set_match(PathSet *set, const char *path, size_t limit) {
+	assert(set);
+	assert(path);
+	size_t best = SIZE_MAX;
+	if (limit > set->cnt)
+		limit = set->cnt;
+	if (limit == 0)
+		return -1;
+
+	PathPattern *p;
+	if (!is_clean(path)) {
+		// a wildcard can match an empty component, all the entries have to be checked
+		size_t i;
+		for (i = 0; i < limit; i++)
+			if (pattern_match(set, set->entry[i], path))
+				return i;
+		return -1;
+	}
+
+	PathNode *node = set->root;
+	const char *ptr = path + 1;
+	while (node) {
+		// the patterns of a node match below it, at the root they match / as well
+		if (*ptr != '\0' || node == set->root) {
+			for (p = node->patterns; p; p = p->next)
+				if (p->index < limit && p->index < best && pattern_match(set, p, ptr))
+					best = p->index;
+		}
+		if (*ptr == '\0') {
+			if (node->index < limit && node->index < best)
+				best = node->index;
+			break;
+		}
+
+		const char *end = strchrnul(ptr, '/');
+		node = node_child(node, ptr, end - ptr, 0);
+		ptr = (*end) ? end + 1 : end;
+	}
+
+	for (p = set->fallback; p; p = p->next)
+		if (p->index < limit && p->index < best && pattern_match(set, p, path))
+			best = p->index;
+
+	return (best == SIZE_MAX) ? -1 : (ssize_t) best;
+}
+
+void path_set_free(PathSet *set) {
+	if (!set)
+		return;
+	node_free(set->root);
+	size_t i;
+	for (i = 0; i < set->cnt; i++) {
+		free(set->entry[i]->pattern);
+		free(set->entry[i]);
+	}
+	free(set->entry);
+	PathPattern *p = set->fallback;
+	while (p) {
+		PathPattern *next = p->next;
+		free(p->pattern);
+		free(p);
+		p = next;
+	}
+	free(set);
+}
@@ -58,6 +58,14 @@ void preproc_build_firejail_dir(void) {
 		create_empty_dir_as_root(RUN_FIREJAIL_X11_DIR, 0755);
 	}
 
+	if (stat(RUN_FIREJAIL_SECCOMP_DIR, &s)) {
+		create_empty_dir_as_root(RUN_FIREJAIL_SECCOMP_DIR, 0755);
+	}
+
+	if (stat(RUN_FIREJAIL_PROFILE_CACHE_DIR, &s)) {
+		create_empty_dir_as_root(RUN_FIREJAIL_PROFILE_CACHE_DIR, 0755);
+	}
+
 	if (stat(RUN_FIREJAIL_APPIMAGE_DIR, &s)) {
 		create_empty_dir_as_root(RUN_FIREJAIL_APPIMAGE_DIR, 0755);
 	}
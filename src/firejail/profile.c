@@ -69,7 +69,7 @@ static void warning_feature_disabled(const char *feature) {
 }
 
 
-static int is_in_ignore_list(char *ptr) {
+int is_in_ignore_list(char *ptr) {
 	// check ignore list
 	int i;
 	for (i = 0; i < MAX_PROFILE_IGNORE; i++) {
@@ -1216,26 +1216,140 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 	return 1;
 }
 
+// filesystem commands and the index lists they go in
+typedef struct {
+	const char *prefix;
+	size_t len;
+	ProfileCmd cmd;
+	int index;
+} ProfileCmdDesc;
+
+static const ProfileCmdDesc profile_cmds[] = {
+	{ "blacklist ", 10, PROFILE_BLACKLIST, PROFILE_INDEX_BLACKLIST },
+	{ "blacklist-nolog ", 16, PROFILE_BLACKLIST_NOLOG, PROFILE_INDEX_BLACKLIST },
+	{ "noblacklist ", 12, PROFILE_NOBLACKLIST, PROFILE_INDEX_BLACKLIST },
+	{ "whitelist ", 10, PROFILE_WHITELIST, PROFILE_INDEX_WHITELIST },
+	{ "nowhitelist ", 12, PROFILE_NOWHITELIST, PROFILE_INDEX_WHITELIST },
+	{ "read-only ", 10, PROFILE_READ_ONLY, PROFILE_INDEX_BLACKLIST },
+	{ "read-write ", 11, PROFILE_READ_WRITE, PROFILE_INDEX_BLACKLIST },
+	{ "noexec ", 7, PROFILE_NOEXEC, PROFILE_INDEX_BLACKLIST },
+	{ "tmpfs ", 6, PROFILE_TMPFS, PROFILE_INDEX_BLACKLIST },
+	{ "mkdir ", 6, PROFILE_MKDIR, PROFILE_INDEX_BLACKLIST },
+	{ "mkfile ", 7, PROFILE_MKFILE, PROFILE_INDEX_BLACKLIST },
+	{ "bind ", 5, PROFILE_BIND, PROFILE_INDEX_BLACKLIST },
+	{ NULL, 0, PROFILE_OTHER, -1 }
+};
+
+static const ProfileCmdDesc *profile_classify(const char *str) {
+	const ProfileCmdDesc *desc = profile_cmds;
+	while (desc->prefix && strncmp(str, desc->prefix, desc->len) != 0)
+		desc++;
+	return desc;
+}
+
+// filesystem entries: profile_check_line() only validates the file name
+static int is_fs_entry(const char *ptr) {
+	switch (profile_classify(ptr)->cmd) {
+	case PROFILE_BLACKLIST:
+	case PROFILE_BLACKLIST_NOLOG:
+	case PROFILE_NOBLACKLIST:
+	case PROFILE_NOWHITELIST:
+	case PROFILE_READ_ONLY:
+	case PROFILE_READ_WRITE:
+	case PROFILE_NOEXEC:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+// the entries are allocated in blocks, and they are never released before the program exits
+#define PROFILE_BLOCK 256
+typedef struct profile_block_t {
+	struct profile_block_t *next;
+	int used;
+	ProfileEntry entries[PROFILE_BLOCK];
+} ProfileBlock;
+static ProfileBlock *profile_blocks = NULL;
+
+static ProfileEntry *profile_entry_new(void) {
+	if (!profile_blocks || profile_blocks->used == PROFILE_BLOCK) {
+		ProfileBlock *blk = malloc(sizeof(ProfileBlock));
+		if (!blk)
+			errExit("malloc");
+		blk->next = profile_blocks;
+		blk->used = 0;
+		profile_blocks = blk;
+	}
+
+	ProfileEntry *prf = &profile_blocks->entries[profile_blocks->used++];
+	memset(prf, 0, sizeof(ProfileEntry));
+	return prf;
+}
+
 // add a profile entry in cfg.profile list; use str to populate the list
 void profile_add(char *str) {
 	EUID_ASSERT();
 
-	ProfileEntry *prf = malloc(sizeof(ProfileEntry));
-	if (!prf)
-		errExit("malloc");
-	memset(prf, 0, sizeof(ProfileEntry));
-	prf->next = NULL;
+	ProfileEntry *prf = profile_entry_new();
+	const ProfileCmdDesc *desc = profile_classify(str);
 	prf->data = str;
+	prf->arg = str + desc->len;
+	prf->cmd = desc->cmd;
 
 	// add prf to the list
-	if (cfg.profile == NULL) {
+	if (cfg.profile == NULL)
 		cfg.profile = prf;
-		return;
+	else
+		cfg.profile_tail->next = prf;
+	cfg.profile_tail = prf;
+
+	// ... and to the index list
+	if (desc->index != -1) {
+		if (cfg.profile_index[desc->index] == NULL)
+			cfg.profile_index[desc->index] = prf;
+		else
+			cfg.profile_index_tail[desc->index]->next_index = prf;
+		cfg.profile_index_tail[desc->index] = prf;
 	}
-	ProfileEntry *ptr = cfg.profile;
-	while (ptr->next != NULL)
-		ptr = ptr->next;
-	ptr->next = prf;
+}
+
+// remove the entry from further processing; the entry stays in the lists
+void profile_entry_clear(ProfileEntry *entry) {
+	assert(entry);
+	entry->data = EMPTY_STRING;
+	entry->arg = EMPTY_STRING;
+	entry->cmd = PROFILE_NONE;
+}
+
+// replace the command string in the entry, the command stays the same
+void profile_entry_set(ProfileEntry *entry, char *str) {
+	assert(entry);
+	assert(str);
+	const ProfileCmdDesc *desc = profile_classify(str);
+	assert(desc->cmd == entry->cmd);
+	entry->data = str;
+	entry->arg = str + desc->len;
+}
+
+void profile_free(void) {
+	ProfileEntry *prf = cfg.profile;
+	while (prf != NULL) {
+		if (!profile_cache_owns(prf->data))
+			free(prf->data);
+		free(prf->link);
+		prf = prf->next;
+	}
+
+	while (profile_blocks) {
+		ProfileBlock *next = profile_blocks->next;
+		free(profile_blocks);
+		profile_blocks = next;
+	}
+	cfg.profile = NULL;
+	cfg.profile_tail = NULL;
+	memset(cfg.profile_index, 0, sizeof(cfg.profile_index));
+	memset(cfg.profile_index_tail, 0, sizeof(cfg.profile_index_tail));
 }
 
 // read a profile file
@@ -1249,6 +1363,16 @@ void profile_read(const char *fname) {
 		exit(1);
 	}
 
+	// top level profile: use the compiled profile if available, otherwise record this one
+	if (include_level == 0) {
+		if (profile_cache_load(fname) == 0) {
+			set_profile_run_file(getpid(), fname);
+			return;
+		}
+		profile_cache_start();
+	}
+	int file_idx = profile_cache_file(fname);
+
 	// check file
 	invalid_filename(fname, 0); // no globbing
 	if (strlen(fname) == 0 || is_dir(fname)) {
@@ -1308,6 +1432,7 @@ void profile_read(const char *fname) {
 		// process quiet
 		// todo: a quiet in the profile file cannot be disabled by --ignore on command line
 		if (strcmp(ptr, "quiet") == 0) {
+			profile_cache_quiet(file_idx, lineno, ptr);
 			if (is_in_ignore_list(ptr))
 				arg_quiet = 0;
 			else
@@ -1316,6 +1441,7 @@ void profile_read(const char *fname) {
 			continue;
 		}
 		if (!msg_printed) {
+			profile_cache_msg(file_idx);
 			fmessage("Reading profile %s\n", fname);
 			msg_printed = 1;
 		}
@@ -1339,7 +1465,9 @@ void profile_read(const char *fname) {
 			continue;
 		}
 
-		// verify syntax, exit in case of error
+		// verify syntax, exit in case of error; the line is recorded before profile_check_line()
+		// has a chance to modify it
+		profile_cache_line(file_idx, lineno, ptr, is_fs_entry(ptr) && !is_in_ignore_list(ptr));
 		if (profile_check_line(ptr, lineno, fname))
 			profile_add(ptr);
 // we cannot free ptr here, data is extracted from ptr and linked as a pointer in cfg structure
@@ -1351,4 +1479,7 @@ void profile_read(const char *fname) {
 #endif
 	}
 	fclose(fp);
+
+	if (include_level == 0)
+		profile_cache_save(fname);
 }
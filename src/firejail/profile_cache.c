@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include <sys/stat.h>
+
+// Cache of compiled profiles. While profile_read() parses a profile and its include tree, the
+// lines are recorded in the order they were processed, with the files they came from. The next
+// time the same profile is read, the recording is mapped in memory and replayed: the profile
+// files are not opened, and the filesystem entries (blacklist, read-only etc.) validated when the
+// recording was made go straight to the profile list. There is one cache entry for each user
+// and profile. An entry is used only if all the profile files, including the missing .local
+// files, have the same inode, size and times.
+static const DiskCache cache = {
+	.dir = RUN_FIREJAIL_PROFILE_CACHE_DIR,
+	.name = "Profile",
+	.magic = 0x50534a46,	// "FJSP"
+	.version = 2,
+	.data_max = 4 * 1024 * 1024,
+	.entries = 32,
+	.size = 4 * 1024 * 1024
+};
+
+enum {
+	REC_FILE = 1,	// profile file read, followed by CacheFile and the file name
+	REC_MSG,	// "Reading profile" message
+	REC_QUIET,	// quiet command
+	REC_LINE,	// command processed by profile_check_line()
+	REC_ENTRY,	// filesystem entry already validated by profile_check_line()
+	REC_MAX
+};
+
+typedef struct {
+	uint32_t type;
+	uint32_t file;		// index of the REC_FILE record
+	uint32_t lineno;
+	uint32_t len;		// string length; the string is NUL terminated and padded to 8 bytes
+} CacheRecord;
+
+typedef struct {
+	uint64_t ino;
+	uint64_t size;
+	uint64_t mtime;
+	uint64_t ctime;
+} CacheFile;
+
+// recording
+static char *rec_buf = NULL;
+static size_t rec_len = 0;
+static size_t rec_size = 0;
+static int rec_active = 0;
+static unsigned rec_files = 0;
+
+// cache files mapped in memory, never unmapped: the profile entries point inside
+typedef struct {
+	char *start;
+	size_t len;
+} CacheMap;
+static CacheMap *maps = NULL;
+static int maps_cnt = 0;
+
+#define PAD8(x) (((x) + 7) & ~((size_t) 7))
+
+// everything the recording depends on, besides the profile files
+static char *cache_key(const char *fname) {
+	char *key;
+	if (asprintf(&key, "firejail %s\nuid %d\nhome %s\nprofile %s\nallow-debuggers %d\n",
+		     VERSION, getuid(), cfg.homedir, fname, arg_allow_debuggers) == -1)
+		errExit("asprintf");
+	return key;
+}
+
+static void file_stat(const char *fname, CacheFile *cf) {
+	struct stat s;
+	memset(cf, 0, sizeof(CacheFile));
+	if (stat(fname, &s) == 0) {
+		cf->ino = s.st_ino;
+		cf->size = s.st_size;
+		cf->mtime = s.st_mtime;
+		cf->ctime = s.st_ctime;
+	}
+}
+
+static void rec_append(const void *data, size_t len) {
+	if (rec_len + len > rec_size) {
+		rec_size = (rec_size) ? rec_size * 2 : 64 * 1024;
+		while (rec_len + len > rec_size)
+			rec_size *= 2;
+		rec_buf = realloc(rec_buf, rec_size);
+		if (!rec_buf)
+			errExit("realloc");
+	}
+	memcpy(rec_buf + rec_len, data, len);
+	rec_len += len;
+}
+
+static void rec_add(int type, int file, int lineno, const CacheFile *cf, const char *str) {
+	if (!rec_active)
+		return;
+
+	static const char zero[8] = {0};
+	CacheRecord rec;
+	rec.type = type;
+	rec.file = file;
+	rec.lineno = lineno;
+	rec.len = strlen(str);
+	rec_append(&rec, sizeof(rec));
+	if (cf)
+		rec_append(cf, sizeof(CacheFile));
+	rec_append(str, rec.len);
+	rec_append(zero, PAD8(rec.len + 1) - rec.len);
+}
+
+// start recording a profile
+void profile_cache_start(void) {
+	rec_len = 0;
+	rec_files = 0;
+	rec_active = 1;
+}
+
+// record a profile file, return the index used for the lines read from it
+int profile_cache_file(const char *fname) {
+	assert(fname);
+	if (!rec_active)
+		return 0;
+
+	// the file is found again by name
+	if (*fname != '/') {
+		rec_active = 0;
+		return 0;
+	}
+
+	CacheFile cf;
+	file_stat(fname, &cf);
+	rec_add(REC_FILE, rec_files, 0, &cf, fname);
+	return rec_files++;
+}
+
+void profile_cache_msg(int file) {
+	rec_add(REC_MSG, file, 0, NULL, "");
+}
+
+void profile_cache_quiet(int file, int lineno, const char *ptr) {
+	rec_add(REC_QUIET, file, lineno, NULL, ptr);
+}
+
+void profile_cache_line(int file, int lineno, const char *ptr, int entry) {
+	rec_add((entry) ? REC_ENTRY : REC_LINE, file, lineno, NULL, ptr);
+}
+
+// check the records and the profile files; return the number of records, or -1 if the cache is not valid
+static int cache_check(char *data, size_t len) {
+	size_t off = 0;
+	unsigned files = 0;
+	int cnt = 0;
+	while (off < len) {
+		if (len - off < sizeof(CacheRecord))
+			return -1;
+		CacheRecord *rec = (CacheRecord *) (data + off);
+		off += sizeof(CacheRecord);
+		if (rec->type == 0 || rec->type >= REC_MAX)
+			return -1;
+
+		CacheFile *cf = NULL;
+		if (rec->type == REC_FILE) {
+			if (rec->file != files || len - off < sizeof(CacheFile))
+				return -1;
+			cf = (CacheFile *) (data + off);
+			off += sizeof(CacheFile);
+			files++;
+		}
+		else if (rec->file >= files)
+			return -1;
+
+		if (rec->len >= len - off || PAD8(rec->len + 1) > len - off)
+			return -1;
+		char *str = data + off;
+		if (str[rec->len] != '\0' || strlen(str) != rec->len)
+			return -1;
+		off += PAD8(rec->len + 1);
+
+		if (cf) {
+			CacheFile now;
+			file_stat(str, &now);
+			if (memcmp(cf, &now, sizeof(CacheFile)) != 0) {
+				if (arg_debug)
+					printf("Profile cache: %s was modified\n", str);
+				return -1;
+			}
+		}
+		cnt++;
+	}
+
+	return (files) ? cnt : -1;
+}
+
+// run the recorded commands
+static void cache_replay(char *data, size_t len) {
+	const char **fnames = NULL;
+	unsigned files = 0;
+	size_t off = 0;
+	while (off < len) {
+		CacheRecord *rec = (CacheRecord *) (data + off);
+		off += sizeof(CacheRecord);
+		if (rec->type == REC_FILE)
+			off += sizeof(CacheFile);
+		char *str = data + off;
+		off += PAD8(rec->len + 1);
+
+		switch (rec->type) {
+		case REC_FILE:
+			fnames = realloc(fnames, (files + 1) * sizeof(char *));
+			if (!fnames)
+				errExit("realloc");
+			fnames[files++] = str;
+			break;
+		case REC_MSG:
+			fmessage("Reading profile %s\n", fnames[rec->file]);
+			break;
+		case REC_QUIET:
+			arg_quiet = (is_in_ignore_list(str)) ? 0 : 1;
+			break;
+		case REC_LINE:
+			if (profile_check_line(str, rec->lineno, fnames[rec->file]))
+				profile_add(str);
+			break;
+		case REC_ENTRY:
+			if (!is_in_ignore_list(str))
+				profile_add(str);
+			break;
+		}
+	}
+	free(fnames);
+}
+
+// read the profile from the cache; return -1 if not found
+int profile_cache_load(const char *fname) {
+	assert(fname);
+	if (*fname != '/')
+		return -1;
+
+	// the private writable mapping is kept, profile_check_line() keeps pointers inside the lines
+	char *key = cache_key(fname);
+	DiskCacheEntry entry;
+	EUID_ROOT();
+	int rv = disk_cache_load(&cache, key, &entry);
+	EUID_USER();
+	free(key);
+	if (rv == -1)
+		return -1;
+
+	int cnt = cache_check(entry.data, entry.len);
+	if (cnt == -1) {
+		if (arg_debug)
+			printf("Profile cache entry for %s rejected\n", fname);
+		disk_cache_unmap(&entry);
+		return -1;
+	}
+
+	if (arg_debug)
+		printf("Profile %s loaded from cache, %d records\n", fname, cnt);
+	maps = realloc(maps, (maps_cnt + 1) * sizeof(CacheMap));
+	if (!maps)
+		errExit("realloc");
+	maps[maps_cnt].start = entry.map;
+	maps[maps_cnt].len = entry.size;
+	maps_cnt++;
+	cache_replay(entry.data, entry.len);
+	return 0;
+}
+
+// save the recording; the entry can hold lines from private .local files
+void profile_cache_save(const char *fname) {
+	assert(fname);
+	if (rec_active && rec_files) {
+		char *key = cache_key(fname);
+		EUID_ROOT();
+		disk_cache_save(&cache, key, rec_buf, rec_len);
+		EUID_USER();
+		free(key);
+	}
+
+	rec_active = 0;
+	rec_len = 0;
+}
+
+// return 1 if the string is stored in the memory of a cached profile
+int profile_cache_owns(const char *ptr) {
+	int i;
+	for (i = 0; i < maps_cnt; i++) {
+		if (ptr >= maps[i].start && ptr < maps[i].start + maps[i].len)
+			return 1;
+	}
+	return 0;
+}
@@ -29,6 +29,9 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 #include <sched.h>
 #ifndef CLONE_NEWUSER
@@ -206,97 +209,200 @@ static void chk_chroot(void) {
 	exit(1);
 }
 
+// find a process still running in the sandbox, other than the sandbox monitor
+static pid_t monitor_find_process(void) {
+	DIR *dir;
+	if (!(dir = opendir("/proc"))) {
+		// sleep 2 seconds and try again
+		sleep(2);
+		if (!(dir = opendir("/proc"))) {
+			fprintf(stderr, "Error: cannot open /proc directory\n");
+			exit(1);
+		}
+	}
+
+	struct dirent *entry;
+	pid_t rv = 0;
+	while ((entry = readdir(dir)) != NULL) {
+		unsigned pid;
+		if (sscanf(entry->d_name, "%u", &pid) != 1)
+			continue;
+		if (pid == 1)
+			continue;
+
+		// todo: make this generic
+		// Dillo browser leaves a dpid process running, we need to shut it down
+		int found = 0;
+		if (strcmp(cfg.command_name, "dillo") == 0) {
+			char *pidname = pid_proc_comm(pid);
+			if (pidname && strcmp(pidname, "dpid") == 0)
+				found = 1;
+			free(pidname);
+		}
+		if (found)
+			break;
+
+		rv = pid;
+		break;
+	}
+	closedir(dir);
+	return rv;
+}
+
+// open a pidfd for a process we are not the parent of (processes joining the sandbox);
+// return -1 if the kernel doesn't support pidfds (Linux < 5.3)
+static int monitor_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void) pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+// The monitor is running as pid 1 in the new pid namespace, all orphaned processes are
+// reparented to it. Instead of polling, we sleep in poll() on a signalfd for SIGCHLD,
+// a timerfd for --timeout, and a pidfd for processes we cannot wait for.
 static int monitor_application(pid_t app_pid) {
 	monitored_pid = app_pid;
 	signal (SIGTERM, sandbox_handler);
 	EUID_USER();
 
+	// SIGCHLD is delivered through a signalfd
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+		errExit("sigprocmask");
+	int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sfd == -1)
+		errExit("signalfd");
+
 	// handle --timeout
-	int options = 0;;
-	unsigned timeout = 0;
+	int tfd = -1;
 	if (cfg.timeout) {
-		options = WNOHANG;
-		timeout = cfg.timeout;
+		tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (tfd == -1)
+			errExit("timerfd_create");
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = cfg.timeout;
+		if (timerfd_settime(tfd, 0, &its, NULL) == -1)
+			errExit("timerfd_settime");
 	}
 
+	char *msg;
+	if (asprintf(&msg, "monitoring pid %d\n", monitored_pid) == -1)
+		errExit("asprintf");
+	logmsg(msg);
+	if (arg_debug)
+		printf("%s\n", msg);
+	free(msg);
+
 	int status = 0;
+	int pfd = -1;		// pidfd for a process we are not the parent of
+	pid_t pfd_pid = 0;
+	pid_t exited_pid = 0;	// non-child process reported as terminated by its pidfd
 	while (monitored_pid) {
-		usleep(20000);
-		char *msg;
-		if (asprintf(&msg, "monitoring pid %d\n", monitored_pid) == -1)
-			errExit("asprintf");
-		logmsg(msg);
-		if (arg_debug)
-			printf("%s\n", msg);
-		free(msg);
-
+		// reap all terminated children, including orphans reparented to us
 		pid_t rv;
-		do {
-			rv = waitpid(-1, &status, options);
-			if (rv == -1)
+		int wstatus;
+		int children = 1;
+		while ((rv = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+			status = wstatus;
+			if (arg_debug)
+				printf("Sandbox monitor: waitpid %u retval %d status %d\n", monitored_pid, rv, status);
+		}
+		if (rv == -1) {
+			// we can get here if we have processes joining the sandbox (ECHILD)
+			if (arg_debug && errno != ECHILD)
+				perror("waitpid");
+			children = 0;
+		}
+
+		// with no children left, look for processes that joined the sandbox
+		int poll_timeout = -1;
+		if (!children) {
+			pid_t pid = monitor_find_process();
+			if (pid == 0)
 				break;
 
-			// handle --timeout
-			if (options) {
-				if (--timeout == 0)  {
-					kill(-1, SIGTERM);
-					flush_stdin();
-					sleep(1);
-					_exit(1);
+			if (pid != monitored_pid && arg_debug)
+				printf("Sandbox monitor: monitoring %u\n", pid);
+			monitored_pid = pid;
+
+			if (pid == exited_pid)
+				// the process is a zombie waiting for its parent outside the sandbox
+				poll_timeout = 1000;
+			else if (pid != pfd_pid) {
+				if (pfd != -1)
+					close(pfd);
+				pfd = monitor_pidfd(pid);
+				pfd_pid = pid;
+				if (pfd == -1) {
+					if (arg_debug)
+						perror("pidfd_open");
+					poll_timeout = 1000;
 				}
-				else
-					sleep(1);
 			}
-		}
-		while(rv != monitored_pid);
-		if (arg_debug)
-			printf("Sandbox monitor: waitpid %u retval %d status %d\n", monitored_pid, rv, status);
-		if (rv == -1) { // we can get here if we have processes joining the sandbox (ECHILD)
-			if (arg_debug)
-				perror("waitpid");
-			sleep(1);
+			else if (pfd == -1)
+				poll_timeout = 1000;
 		}
 
-		DIR *dir;
-		if (!(dir = opendir("/proc"))) {
-			// sleep 2 seconds and try again
-			sleep(2);
-			if (!(dir = opendir("/proc"))) {
-				fprintf(stderr, "Error: cannot open /proc directory\n");
-				exit(1);
-			}
+		struct pollfd fds[3];
+		int nfds = 0;
+		fds[nfds].fd = sfd;
+		fds[nfds++].events = POLLIN;
+		if (tfd != -1) {
+			fds[nfds].fd = tfd;
+			fds[nfds++].events = POLLIN;
+		}
+		if (!children && pfd != -1 && monitored_pid != exited_pid) {
+			fds[nfds].fd = pfd;
+			fds[nfds++].events = POLLIN;
 		}
 
-		struct dirent *entry;
-		monitored_pid = 0;
-		while ((entry = readdir(dir)) != NULL) {
-			unsigned pid;
-			if (sscanf(entry->d_name, "%u", &pid) != 1)
+		int nready = poll(fds, nfds, poll_timeout);
+		if (nready == -1) {
+			if (errno == EINTR)
 				continue;
-			if (pid == 1)
+			errExit("poll");
+		}
+
+		int i;
+		for (i = 0; i < nfds; i++) {
+			if (!fds[i].revents)
 				continue;
 
-			// todo: make this generic
-			// Dillo browser leaves a dpid process running, we need to shut it down
-			int found = 0;
-			if (strcmp(cfg.command_name, "dillo") == 0) {
-				char *pidname = pid_proc_comm(pid);
-				if (pidname && strcmp(pidname, "dpid") == 0)
-					found = 1;
-				free(pidname);
+			if (fds[i].fd == sfd) {
+				// drain the signalfd, children are reaped at the top of the loop
+				struct signalfd_siginfo si;
+				while (read(sfd, &si, sizeof(si)) == sizeof(si));
+			}
+			else if (fds[i].fd == tfd) {
+				// handle --timeout
+				kill(-1, SIGTERM);
+				flush_stdin();
+				sleep(1);
+				_exit(1);
+			}
+			else if (fds[i].fd == pfd) {
+				exited_pid = pfd_pid;
+				close(pfd);
+				pfd = -1;
+				pfd_pid = 0;
 			}
-			if (found)
-				break;
-
-			monitored_pid = pid;
-			break;
 		}
-		closedir(dir);
-
-		if (monitored_pid != 0 && arg_debug)
-			printf("Sandbox monitor: monitoring %u\n", monitored_pid);
 	}
 
+	if (pfd != -1)
+		close(pfd);
+	if (tfd != -1)
+		close(tfd);
+	close(sfd);
+	sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
 	// return the latest exit status.
 	return status;
 }
@@ -1066,6 +1172,9 @@ int sandbox(void* sandbox_arg) {
 		int rv = unlink(RUN_SECCOMP_MDWX);
 		(void) rv;
 	}
+
+	// all the filters are loaded
+	seccomp_save_linked();
 #endif
 
 	//****************************************
@@ -23,9 +23,11 @@
 #include <unistd.h>
 #include <net/if.h>
 #include <stdarg.h>
+#include <fcntl.h>
  #include <sys/wait.h>
 #include "../include/seccomp.h"
 
+// fallback filter, used if seccomp.sbox was not built or installed
 static struct sock_filter filter[] = {
 	VALIDATE_ARCHITECTURE,
 	EXAMINE_SYSCALL,
@@ -78,9 +80,6 @@ static struct sock_filter filter[] = {
 #ifdef 	SYS_ioperm
 	BLACKLIST(SYS_ioperm),
 #endif
-#ifdef SYS_iopl
-	BLACKLIST(SYS_iopl), // io permissions
-#endif
 #ifdef 	SYS_ioprio_set
 	BLACKLIST(SYS_ioprio_set),
 #endif
@@ -104,6 +103,34 @@ static struct sock_fprog prog = {
 	.filter = filter,
 };
 
+// load the tree-shaped filter built during make; return 0 if OK, -1 if not available or not valid
+static int load_filter(struct sock_fprog *fprog, struct sock_filter *code, int max) {
+	int fd = open(PATH_SECCOMP_SBOX, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	ssize_t len = 0;
+	while (len < (ssize_t) (max * sizeof(struct sock_filter))) {
+		ssize_t rv = read(fd, (char *) code + len, max * sizeof(struct sock_filter) - len);
+		if (rv <= 0)
+			break;
+		len += rv;
+	}
+
+	// a filter longer than max instructions is not truncated
+	char c;
+	int too_big = (len == (ssize_t) (max * sizeof(struct sock_filter)) && read(fd, &c, 1) == 1);
+	close(fd);
+	if (len == 0 || len % sizeof(struct sock_filter) || too_big) {
+		fwarning("invalid %s filter, using the default filter\n", PATH_SECCOMP_SBOX);
+		return -1;
+	}
+
+	fprog->len = (unsigned short) (len / sizeof(struct sock_filter));
+	fprog->filter = code;
+	return 0;
+}
+
 int sbox_run(unsigned filter, int num, ...) {
 	EUID_ROOT();
 
@@ -178,8 +205,15 @@ int sbox_run(unsigned filter, int num, ...) {
 			if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0)) {
 				perror("prctl(NO_NEW_PRIVS)");
 			}
-			if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog)) {
-				perror("prctl(PR_SET_SECCOMP)");
+			struct sock_filter code[BPF_MAXINSNS];
+			struct sock_fprog fprog;
+			if (load_filter(&fprog, code, BPF_MAXINSNS) == -1)
+				fprog = prog;
+			if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &fprog)) {
+				// the kernel rejected the filter built during make, fall back to the default one
+				if (fprog.filter == prog.filter ||
+				    prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog))
+					perror("prctl(PR_SET_SECCOMP)");
 			}
 		}
 
@@ -198,6 +232,9 @@ int sbox_run(unsigned filter, int num, ...) {
 		// --quiet is passed as an environment variable
 		if (arg_quiet)
 			setenv("FIREJAIL_QUIET", "yes", 1);
+		// --debug is passed as an environment variable
+		if (arg_debug)
+			setenv("FIREJAIL_DEBUG", "yes", 1);
 
 		if (arg[0])	// get rid of scan-build warning
 			execvp(arg[0], arg);
@@ -218,3 +255,54 @@ int sbox_run(unsigned filter, int num, ...) {
 
 	return status;
 }
+
+// fcopy batch: the files queued by a private-* stage are copied by a single fcopy process
+static char *fcopy_batch = NULL;
+static size_t fcopy_batch_len = 0;
+static size_t fcopy_batch_size = 0;
+
+void sbox_fcopy_add(const char *src, const char *dest) {
+	assert(src);
+	assert(dest);
+	size_t srclen = strlen(src) + 1;
+	size_t destlen = strlen(dest) + 1;
+	if (fcopy_batch_len + srclen + destlen > fcopy_batch_size) {
+		fcopy_batch_size = 2 * (fcopy_batch_len + srclen + destlen);
+		fcopy_batch = realloc(fcopy_batch, fcopy_batch_size);
+		if (!fcopy_batch)
+			errExit("realloc");
+	}
+	memcpy(fcopy_batch + fcopy_batch_len, src, srclen);
+	fcopy_batch_len += srclen;
+	memcpy(fcopy_batch + fcopy_batch_len, dest, destlen);
+	fcopy_batch_len += destlen;
+}
+
+// run fcopy --batch on the queued files
+void sbox_fcopy_run(unsigned filter, int follow_link) {
+	if (fcopy_batch_len == 0)
+		return;
+
+	// the list is passed on stdin
+	int fd = open(SBOX_STDIN_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1)
+		errExit("open");
+	size_t done = 0;
+	while (done < fcopy_batch_len) {
+		ssize_t rv = write(fd, fcopy_batch + done, fcopy_batch_len - done);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("write");
+		}
+		done += rv;
+	}
+	close(fd);
+	fcopy_batch_len = 0;
+
+	if (follow_link)
+		sbox_run(filter | SBOX_STDIN_FROM_FILE, 3, PATH_FCOPY, "--batch", "--follow-link");
+	else
+		sbox_run(filter | SBOX_STDIN_FROM_FILE, 2, PATH_FCOPY, "--batch");
+	unlink(SBOX_STDIN_FILE);
+}
@@ -60,6 +60,210 @@ char *seccomp_check_list(const char *str) {
 	return rv;
 }
 
+//**********************************
+// filter linking
+//**********************************
+// The kernel runs all the stacked filters on every syscall and keeps the action with the highest
+// precedence. The filters are linked into a single program doing the same thing: the return
+// instructions of each filter jump to a small block saving the best action so far in the scratch
+// memory, and the program returns as soon as the remaining filters cannot change the result.
+#ifndef SECCOMP_RET_ACTION_FULL
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
+#endif
+// smaller key, higher precedence; the kernel compares the actions as signed integers
+#define LINK_KEY(ret) (((ret) & SECCOMP_RET_ACTION_FULL) ^ 0x80000000U)
+#define LINK_KEY_ALLOW LINK_KEY(SECCOMP_RET_ALLOW)
+#define LINK_MEM_RET 0		// scratch memory: best action so far
+#define LINK_MEM_KEY 1		// and its key
+
+static struct sock_filter link_code[BPF_MAXINSNS];
+static int link_cnt;
+static int link_len = 0;	// result of link_filters(), 0 if a filter was loaded after linking
+
+// filters using the scratch memory or the X register are not linked
+static int link_supported(struct sock_fprog *prog) {
+	if (prog->len == 0 || BPF_CLASS(prog->filter[0].code) != BPF_LD)
+		return 0;
+
+	int i;
+	for (i = 0; i < prog->len; i++) {
+		struct sock_filter *ins = &prog->filter[i];
+		switch (BPF_CLASS(ins->code)) {
+		case BPF_LD:
+			if (BPF_MODE(ins->code) != BPF_ABS && BPF_MODE(ins->code) != BPF_IMM && BPF_MODE(ins->code) != BPF_LEN)
+				return 0;
+			break;
+		case BPF_ALU:
+			if (BPF_SRC(ins->code) == BPF_X)
+				return 0;
+			break;
+		case BPF_JMP:
+			if (BPF_OP(ins->code) != BPF_JA && BPF_SRC(ins->code) == BPF_X)
+				return 0;
+			break;
+		case BPF_RET:
+			if (BPF_RVAL(ins->code) != BPF_K)
+				return 0;
+			break;
+		default:
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static uint32_t link_min_key(struct sock_fprog *prog) {
+	uint32_t min = 0xffffffff;
+	int i;
+	for (i = 0; i < prog->len; i++) {
+		if (BPF_CLASS(prog->filter[i].code) == BPF_RET && LINK_KEY(prog->filter[i].k) < min)
+			min = LINK_KEY(prog->filter[i].k);
+	}
+	return min;
+}
+
+static int link_add(struct sock_filter ins) {
+	if (link_cnt == BPF_MAXINSNS)
+		return -1;
+	link_code[link_cnt] = ins;
+	return link_cnt++;
+}
+
+#define LINK_ADD(ins) do { struct sock_filter tmp = ins; if (link_add(tmp) == -1) return -1; } while (0)
+
+// return the index of the code handling a return value of filter number index
+static int link_ret(uint32_t ret, int index, uint32_t min_rest, int *next, int *next_cnt) {
+	uint32_t key = LINK_KEY(ret);
+	int start = link_cnt;
+
+	if (key <= min_rest) {
+		// the remaining filters cannot return anything with a higher precedence
+		assert(index != 0);	// the first filter returns directly
+		if (key != LINK_KEY_ALLOW) {
+			LINK_ADD(BPF_STMT(BPF_LD+BPF_W+BPF_MEM, LINK_MEM_KEY));
+			LINK_ADD(BPF_JUMP(BPF_JMP+BPF_JGT+BPF_K, key, 0, 1));
+			LINK_ADD(BPF_STMT(BPF_RET+BPF_K, ret));
+		}
+		LINK_ADD(BPF_STMT(BPF_LD+BPF_W+BPF_MEM, LINK_MEM_RET));
+		LINK_ADD(BPF_STMT(BPF_RET+BPF_A, 0));
+		return start;
+	}
+
+	// save the action if it has a higher precedence, and run the next filter
+	if (index == 0 || key != LINK_KEY_ALLOW) {
+		if (index != 0) {
+			LINK_ADD(BPF_STMT(BPF_LD+BPF_W+BPF_MEM, LINK_MEM_KEY));
+			LINK_ADD(BPF_JUMP(BPF_JMP+BPF_JGT+BPF_K, key, 0, 4));
+		}
+		LINK_ADD(BPF_STMT(BPF_LD+BPF_W+BPF_IMM, ret));
+		LINK_ADD(BPF_STMT(BPF_ST, LINK_MEM_RET));
+		LINK_ADD(BPF_STMT(BPF_LD+BPF_W+BPF_IMM, key));
+		LINK_ADD(BPF_STMT(BPF_ST, LINK_MEM_KEY));
+	}
+	if (link_add((struct sock_filter) BPF_JUMP(BPF_JMP+BPF_JA+BPF_K, 0, 0, 0)) == -1)
+		return -1;
+	next[(*next_cnt)++] = link_cnt - 1;	// jump to the next filter, fixed later
+	return start;
+}
+
+// Link the filters in the order they are run by the kernel. seccomp_load() puts every new filter
+// at the head of the list and seccomp_install_filters() installs the list starting from the head;
+// the kernel runs the last filter installed first, so the list is linked from the tail, the first
+// filter loaded. On equal precedence the action of the filter run first is kept.
+// Return the number of instructions, or -1 if the filters have to be stacked.
+static int link_filters(void) {
+	int cnt = 0;
+	FilterList *fl;
+	for (fl = filter_list_head; fl; fl = fl->next) {
+		if (!link_supported(&fl->prog))
+			return -1;
+		cnt++;
+	}
+	if (cnt < 2)
+		return -1;
+
+	// highest precedence returned by the filters after each filter
+	uint32_t min_rest[cnt];
+	int i = cnt - 1;
+	min_rest[i] = 0xffffffff;
+	FilterList *list[cnt];
+	for (fl = filter_list_head, i = cnt - 1; fl; fl = fl->next, i--)
+		list[i] = fl;
+	for (i = cnt - 2; i >= 0; i--) {
+		uint32_t min = link_min_key(&list[i + 1]->prog);
+		min_rest[i] = (min < min_rest[i + 1]) ? min : min_rest[i + 1];
+	}
+
+	link_cnt = 0;
+	for (i = 0; i < cnt; i++) {
+		struct sock_fprog *prog = &list[i]->prog;
+		if (link_cnt + prog->len > BPF_MAXINSNS)
+			return -1;
+		int base = link_cnt;
+		memcpy(&link_code[base], prog->filter, prog->len * sizeof(struct sock_filter));
+		link_cnt += prog->len;
+
+		// one block for each distinct return value
+		int next[prog->len];
+		int next_cnt = 0;
+		int j;
+		for (j = 0; j < prog->len; j++) {
+			struct sock_filter *ins = &link_code[base + j];
+			if (BPF_CLASS(ins->code) != BPF_RET)
+				continue;
+			uint32_t ret = ins->k;
+			if (i == 0 && LINK_KEY(ret) <= min_rest[i])
+				continue;	// final result, the instruction is kept
+
+			int block = -1;
+			int k;
+			for (k = 0; k < j; k++) {	// return instructions already replaced
+				if (BPF_CLASS(prog->filter[k].code) == BPF_RET && prog->filter[k].k == ret) {
+					block = base + k + 1 + (int) link_code[base + k].k;
+					break;
+				}
+			}
+			if (block == -1) {
+				block = link_ret(ret, i, min_rest[i], next, &next_cnt);
+				if (block == -1)
+					return -1;
+			}
+			struct sock_filter ja = BPF_JUMP(BPF_JMP+BPF_JA+BPF_K, block - (base + j) - 1, 0, 0);
+			*ins = ja;
+		}
+
+		// the next filter starts here
+		for (j = 0; j < next_cnt; j++)
+			link_code[next[j]].k = link_cnt - next[j] - 1;
+	}
+
+	return link_cnt;
+}
+
+// link the filters once, the list doesn't change after the last filter is loaded
+static int link_get(void) {
+	if (link_len == 0)
+		link_len = link_filters();
+	return link_len;
+}
+
+// save the linked program in RUN_SECCOMP_LINKED, it is not written if the filters are stacked;
+// called after the last filter is loaded, while /run/firejail/mnt is still writable
+void seccomp_save_linked(void) {
+	int len = link_get();
+	if (len == -1)
+		return;
+
+	FILE *fp = fopen(RUN_SECCOMP_LINKED, "w");
+	if (!fp)
+		errExit("fopen");
+	if (fwrite(link_code, sizeof(struct sock_filter), len, fp) != (size_t) len)
+		errExit("fwrite");
+	SET_PERMS_STREAM(fp, 0, 0, 0644);
+	fclose(fp);
+}
+
 // install seccomp filters
 int seccomp_install_filters(void) {
 	int r = 0;
@@ -67,6 +271,19 @@ int seccomp_install_filters(void) {
 	if (fl) {
 		prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
 
+		// a single program if possible
+		FilterList linked;
+		int len = link_get();
+		if (len != -1) {
+			if (arg_debug)
+				printf("Linking seccomp filters in a single program of %d instructions\n", len);
+			linked.next = NULL;
+			linked.prog.len = len;
+			linked.prog.filter = link_code;
+			linked.fname = "linked";
+			fl = &linked;
+		}
+
 		for (; fl; fl = fl->next) {
 			assert(fl->fname);
 			if (arg_debug)
@@ -125,6 +342,7 @@ int seccomp_load(const char *fname) {
 	if (fl->fname == NULL)
 		errExit("strdup");
 	filter_list_head = fl;
+	link_len = 0;
 
 	if (arg_debug && access(PATH_FSEC_PRINT, X_OK) == 0) {
 		sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 2,
@@ -190,21 +408,27 @@ int seccomp_filter_drop(void) {
 			if (arg_debug)
 				printf("Build default+drop seccomp filter\n");
 
-			// build the seccomp filter as a regular user
-			int rv;
-			if (arg_allow_debuggers)
-				rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 7,
-					      PATH_FSECCOMP, "default", "drop", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list, "allow-debuggers");
-			else
-				rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 6,
-					      PATH_FSECCOMP, "default", "drop", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list);
-			if (rv)
-				exit(rv);
-
-			// optimize the new filter
-			rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 2, PATH_FSEC_OPTIMIZE, RUN_SECCOMP_CFG);
-			if (rv)
-				exit(rv);
+			// use the filter from a previous run if available
+			char *key = seccomp_cache_key("default drop", cfg.seccomp_list);
+			if (seccomp_cache_load(key) == -1) {
+				// build the seccomp filter as a regular user
+				int rv;
+				if (arg_allow_debuggers)
+					rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 7,
+						      PATH_FSECCOMP, "default", "drop", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list, "allow-debuggers");
+				else
+					rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 6,
+						      PATH_FSECCOMP, "default", "drop", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list);
+				if (rv)
+					exit(rv);
+
+				// optimize the new filter
+				rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 2, PATH_FSEC_OPTIMIZE, RUN_SECCOMP_CFG);
+				if (rv)
+					exit(rv);
+				seccomp_cache_save(key);
+			}
+			free(key);
 		}
 	}
 
@@ -216,22 +440,28 @@ int seccomp_filter_drop(void) {
 		if (arg_debug)
 			printf("Build drop seccomp filter\n");
 
-		// build the seccomp filter as a regular user
-		int rv;
-		if (arg_allow_debuggers)
-			rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 6,
-				      PATH_FSECCOMP, "drop", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list_drop,  "allow-debuggers");
-		else
-			rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 5,
-				PATH_FSECCOMP, "drop", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list_drop);
-
-		if (rv)
-			exit(rv);
+		// use the filter from a previous run if available
+		char *key = seccomp_cache_key("drop", cfg.seccomp_list_drop);
+		if (seccomp_cache_load(key) == -1) {
+			// build the seccomp filter as a regular user
+			int rv;
+			if (arg_allow_debuggers)
+				rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 6,
+					      PATH_FSECCOMP, "drop", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list_drop,  "allow-debuggers");
+			else
+				rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 5,
+					PATH_FSECCOMP, "drop", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list_drop);
 
-		// optimize the drop filter
-		rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 2, PATH_FSEC_OPTIMIZE, RUN_SECCOMP_CFG);
-		if (rv)
-			exit(rv);
+			if (rv)
+				exit(rv);
+
+			// optimize the drop filter
+			rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 2, PATH_FSEC_OPTIMIZE, RUN_SECCOMP_CFG);
+			if (rv)
+				exit(rv);
+			seccomp_cache_save(key);
+		}
+		free(key);
 	}
 
 	// load the filter
@@ -262,14 +492,20 @@ int seccomp_filter_keep(void) {
 	if (arg_debug)
 		printf("Build keep seccomp filter\n");
 
-	// build the seccomp filter as a regular user
-	int rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 5,
-		 PATH_FSECCOMP, "keep", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list_keep);
+	// use the filter from a previous run if available
+	char *key = seccomp_cache_key("keep", cfg.seccomp_list_keep);
+	if (seccomp_cache_load(key) == -1) {
+		// build the seccomp filter as a regular user
+		int rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 5,
+			 PATH_FSECCOMP, "keep", RUN_SECCOMP_CFG, RUN_SECCOMP_POSTEXEC, cfg.seccomp_list_keep);
 
-	if (rv) {
-		fprintf(stderr, "Error: cannot configure seccomp filter\n");
-		exit(rv);
+		if (rv) {
+			fprintf(stderr, "Error: cannot configure seccomp filter\n");
+			exit(rv);
+		}
+		seccomp_cache_save(key);
 	}
+	free(key);
 
 	if (arg_debug)
 		printf("seccomp filter configured\n");
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifdef HAVE_SECCOMP
+#include "firejail.h"
+#include "../include/seccomp.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+
+// Cache of the filters built by fseccomp and fsec-optimize for the seccomp.drop, seccomp.keep and
+// seccomp lists, one entry for each user, list and build of the two programs. The data saved with
+// the key is the configured filter followed by the postexec filter.
+typedef struct {
+	uint32_t cfg_len;	// instructions, followed by the configured filter
+	uint32_t postexec_len;	// instructions, followed by the postexec filter
+} CacheFilters;
+
+#define FILTER_MAX (BPF_MAXINSNS * sizeof(struct sock_filter))
+
+static const DiskCache cache = {
+	.dir = RUN_FIREJAIL_SECCOMP_DIR,
+	.name = "seccomp filter",
+	.magic = 0x43534a46,	// "FJSC"
+	.version = 2,
+	.data_max = sizeof(CacheFilters) + 2 * FILTER_MAX,
+	.entries = 16,
+	.size = 1024 * 1024
+};
+
+// the program building the filter is part of the key, a new firejail version invalidates the cache
+static void key_add_file(char **key, const char *fname) {
+	struct stat s;
+	if (stat(fname, &s) == -1)
+		memset(&s, 0, sizeof(s));
+
+	char *tmp;
+	if (asprintf(&tmp, "%s%s:%lu:%lu:%lu\n", *key, fname, (unsigned long) s.st_ino,
+		     (unsigned long) s.st_size, (unsigned long) s.st_mtime) == -1)
+		errExit("asprintf");
+	free(*key);
+	*key = tmp;
+}
+
+// the key is made of everything the filter depends on
+char *seccomp_cache_key(const char *cmd, const char *list) {
+	assert(cmd);
+	assert(list);
+
+	char *key;
+	if (asprintf(&key, "firejail %s\nuid %d\narch %x\n%s %s\nallow-debuggers %d\n",
+		     VERSION, getuid(), ARCH_NR, cmd, list, arg_allow_debuggers) == -1)
+		errExit("asprintf");
+	key_add_file(&key, PATH_FSECCOMP);
+	key_add_file(&key, PATH_FSEC_OPTIMIZE);
+	return key;
+}
+
+// read a filter file built by fseccomp, return the size or -1
+static ssize_t read_filter(const char *fname, char *buf, size_t size) {
+	int fd = open(fname, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	ssize_t len = 0;
+	while ((size_t) len < size) {
+		ssize_t rv = read(fd, buf + len, size - len);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			return -1;
+		}
+		if (rv == 0)
+			break;
+		len += rv;
+	}
+	close(fd);
+
+	if (len % sizeof(struct sock_filter) || (size_t) len == size)	// too big
+		return -1;
+	return len;
+}
+
+static int write_filter(const char *fname, const char *buf, size_t len) {
+	// the file was created by preproc, its owner is the user
+	int fd = open(fname, O_WRONLY | O_TRUNC | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	size_t done = 0;
+	while (done < len) {
+		ssize_t rv = write(fd, buf + done, len - done);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			return -1;
+		}
+		done += rv;
+	}
+	close(fd);
+	return 0;
+}
+
+// copy the filters from the cache in RUN_SECCOMP_CFG and RUN_SECCOMP_POSTEXEC; return -1 if not found
+int seccomp_cache_load(const char *key) {
+	assert(key);
+	DiskCacheEntry entry;
+	if (disk_cache_load(&cache, key, &entry) == -1)
+		return -1;
+
+	CacheFilters *filters = (CacheFilters *) entry.data;
+	if (entry.len < sizeof(CacheFilters) ||
+	    filters->cfg_len > BPF_MAXINSNS || filters->postexec_len > BPF_MAXINSNS)
+		goto errout;
+	size_t cfg_size = filters->cfg_len * sizeof(struct sock_filter);
+	size_t postexec_size = filters->postexec_len * sizeof(struct sock_filter);
+	char *cfg = entry.data + sizeof(CacheFilters);
+	if (entry.len != sizeof(CacheFilters) + cfg_size + postexec_size ||
+	    write_filter(RUN_SECCOMP_CFG, cfg, cfg_size) == -1 ||
+	    write_filter(RUN_SECCOMP_POSTEXEC, cfg + cfg_size, postexec_size) == -1)
+		goto errout;
+
+	if (arg_debug)
+		printf("seccomp filter loaded from cache\n");
+	disk_cache_unmap(&entry);
+	return 0;
+
+errout:
+	if (arg_debug)
+		printf("seccomp filter cache entry rejected\n");
+	disk_cache_unmap(&entry);
+	return -1;
+}
+
+// save the filters just built in the cache
+void seccomp_cache_save(const char *key) {
+	assert(key);
+	if (geteuid() != 0)
+		return;
+
+	char *buf = malloc(cache.data_max + sizeof(struct sock_filter));
+	if (!buf)
+		errExit("malloc");
+	CacheFilters *filters = (CacheFilters *) buf;
+	char *cfg = buf + sizeof(CacheFilters);
+
+	// an extra instruction in the buffer to detect filters too big
+	size_t max = FILTER_MAX + sizeof(struct sock_filter);
+	ssize_t cfg_size = read_filter(RUN_SECCOMP_CFG, cfg, max);
+	if (cfg_size <= 0)
+		goto out;
+	ssize_t postexec_size = read_filter(RUN_SECCOMP_POSTEXEC, cfg + cfg_size, max);
+	if (postexec_size == -1)
+		goto out;
+
+	filters->cfg_len = cfg_size / sizeof(struct sock_filter);
+	filters->postexec_len = postexec_size / sizeof(struct sock_filter);
+	disk_cache_save(&cache, key, buf, sizeof(CacheFilters) + cfg_size + postexec_size);
+
+out:
+	free(buf);
+}
+#endif // HAVE_SECCOMP
@@ -19,6 +19,7 @@
  */
 #define _XOPEN_SOURCE 500
 #include "firejail.h"
+#include "../include/copy_utils.h"
 #include <ftw.h>
 #include <sys/stat.h>
 #include <sys/mount.h>
@@ -251,26 +252,6 @@ void logerr(const char *msg) {
 	closelog();
 }
 
-static int copy_file_by_fd(int src, int dst) {
-	assert(src >= 0);
-	assert(dst >= 0);
-
-	ssize_t len;
-	static const int BUFLEN = 1024;
-	unsigned char buf[BUFLEN];
-	while ((len = read(src, buf, BUFLEN)) > 0) {
-		int done = 0;
-		while (done != len) {
-			int rv = write(dst, buf + done, len - done);
-			if (rv == -1)
-				return -1;
-			done += rv;
-		}
-	}
-//	fflush(0);
-	return 0;
-}
-
 // return -1 if error, 0 if no error; if destname already exists, return error
 int copy_file(const char *srcname, const char *destname, uid_t uid, gid_t gid, mode_t mode) {
 	assert(srcname);
@@ -291,7 +272,7 @@ int copy_file(const char *srcname, const char *destname, uid_t uid, gid_t gid, m
 		return -1;
 	}
 
-	int errors = copy_file_by_fd(src, dst);
+	int errors = copy_fd(src, dst);
 	if (!errors) {
 		if (fchown(dst, uid, gid) == -1)
 			errExit("fchown");
@@ -344,7 +325,7 @@ void copy_file_from_user_to_root(const char *srcname, const char *destname, uid_
 		if (src < 0) {
 			fwarning("cannot open source file %s, file not copied\n", srcname);
 		} else {
-			if (copy_file_by_fd(src, dst)) {
+			if (copy_fd(src, dst)) {
 				fwarning("cannot copy %s\n", srcname);
 			}
 			close(src);
@@ -1060,3 +1041,14 @@ errexit:
 	fprintf(stderr, "Error: cannot open \"%s\", invalid filename\n", path);
 	exit(1);
 }
+
+// FNV-1a hash; several buffers are hashed by passing the hash of the previous one
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *ptr = data;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash ^= ptr[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
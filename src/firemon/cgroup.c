@@ -49,12 +49,12 @@ void cgroup(pid_t pid, int print_procs) {
 
 	// print processes
 	printf("  cgroup: ");
-	int i;
-	for (i = 0; i < max_pids; i++) {
-		if (pids[i].level == 1) {
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (ptr->level == 1) {
 			if (print_procs || pid == 0)
-				pid_print_list(i, arg_nowrap);
-			int child = find_child(i);
+				pid_print_list(ptr->pid, arg_nowrap);
+			int child = find_child(ptr->pid);
 			if (child != -1)
 				print_cgroup(child);
 		}
@@ -50,15 +50,20 @@ void cpu(pid_t pid, int print_procs) {
 	pid_read(pid);
 
 	// print processes
-	int i;
-	for (i = 0; i < max_pids; i++) {
-		if (pids[i].level == 1) {
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (ptr->level == 1) {
+			if (arg_format != FORMAT_TEXT) {
+				format_status(RECORD_CPU, ptr->pid, find_child(ptr->pid), "Cpus_allowed_list:");
+				continue;
+			}
 			if (print_procs || pid == 0)
-				pid_print_list(i, arg_nowrap);
-			int child = find_child(i);
+				pid_print_list(ptr->pid, arg_nowrap);
+			int child = find_child(ptr->pid);
 			if (child != -1)
 				print_cpu(child);
 		}
 	}
-	printf("\n");
+	if (arg_format == FORMAT_TEXT)
+		printf("\n");
 }
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
+
+static PidTable *table = NULL;
+
+static void daemon_publish(void) {
+	track_update();
+
+	table->seq++;	// odd, the table is being updated
+	__sync_synchronize();
+
+	uint32_t cnt = 0;
+	Process *ptr;
+	for (ptr = pids; ptr && cnt < PID_TABLE_MAX; ptr = ptr->next) {
+		if (ptr->level <= 0 || ptr->sandbox == 0)
+			continue;
+		PidTableEntry *entry = &table->entry[cnt++];
+		entry->pid = ptr->pid;
+		entry->parent = ptr->parent;
+		entry->sandbox = ptr->sandbox;
+		entry->uid = ptr->uid;
+		entry->level = ptr->level;
+		entry->unused = 0;
+	}
+	table->cnt = cnt;
+
+	__sync_synchronize();
+	table->seq++;
+}
+
+static void daemon_event(struct proc_event *proc_ev, void *arg) {
+	int *changed = arg;
+	pid_t pid;
+	pid_t child;
+	int what = track_event(proc_ev, 0, &pid, &child);
+	if (what == TRACK_EXIT || what == TRACK_EXIT_SANDBOX)
+		track_remove(pid);
+	if (what != TRACK_NONE && what != TRACK_EXEC && what != TRACK_GID && what != TRACK_SID)
+		*changed = 1;
+}
+
+static void daemon_monitor(int sock) {
+	while (1) {
+		struct pollfd pfd = { .fd = sock, .events = POLLIN };
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("poll");
+		}
+
+		// all the pending events are applied before the table is published
+		int changed = 0;
+		if (track_recv(sock, daemon_event, &changed) == -1) {
+			fprintf(stderr, "Warning: process events lost, the process table was read again from /proc (%u)\n",
+				track_lost);
+			track_bootstrap(0);
+			changed = 1;
+		}
+
+		if (changed)
+			daemon_publish();
+	}
+}
+
+void daemon_run(void) {
+	if (getuid() != 0) {
+		fprintf(stderr, "Error: you need to be root to run firemon --daemon\n");
+		exit(1);
+	}
+
+	// open the connector socket before reading /proc, the events in between are not lost
+	int sock = procevent_netlink_setup();
+	track_bootstrap(0);
+
+	struct stat s;
+	if (stat(PID_TABLE_DIR, &s) == -1) {
+		if (mkdir(PID_TABLE_DIR, 0755) == -1 && errno != EEXIST)
+			errExit("mkdir");
+	}
+
+	int fd = open(PID_TABLE_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		errExit("open");
+	if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+		fprintf(stderr, "Error: another firemon daemon is already running\n");
+		exit(1);
+	}
+	if (fchown(fd, 0, 0) == -1 || fchmod(fd, 0644) == -1)
+		errExit("fchown/fchmod");
+	if (ftruncate(fd, sizeof(PidTable)) == -1)
+		errExit("ftruncate");
+
+	table = mmap(NULL, sizeof(PidTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (table == MAP_FAILED)
+		errExit("mmap");
+	// the file descriptor is kept open in order to hold the lock
+
+	table->magic = 0;
+	table->seq = 0;
+	table->daemon = getpid();
+	daemon_publish();
+	__sync_synchronize();
+	table->magic = PID_TABLE_MAGIC;
+
+	daemon_monitor(sock); // it will never return from here
+}
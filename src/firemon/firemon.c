@@ -39,7 +39,9 @@ static int arg_top = 0;
 static int arg_list = 0;
 static int arg_netstats = 0;
 static int arg_apparmor = 0;
+static int arg_daemon = 0;
 int arg_nowrap = 0;
+static char *arg_socket = NULL;
 
 static struct termios tlocal;	// startup terminal setting
 static struct termios twait;	// no wait on key press
@@ -63,24 +65,22 @@ static void my_handler(int s){
 //    14792:netblue:/usr/bin/transmission-qt
 // We need 14792, the first real sandboxed process
 int find_child(int id) {
-	int i;
-	int first_child = -1;
+	Process *proc = pid_find(id);
+	if (!proc)
+		return -1;
 
 	// find the first child
-	for (i = 0; i < max_pids; i++) {
-		if (pids[i].level == 2 && pids[i].parent == id) {
-			first_child = i;
-			break;
-		}
-	}
-
-	if (first_child == -1)
+	Process *first_child = proc->child;
+	while (first_child && first_child->level != 2)
+		first_child = first_child->sibling;
+	if (!first_child)
 		return -1;
 
 	// find the second child
-	for (i = 0; i < max_pids; i++) {
-		if (pids[i].level == 3 && pids[i].parent == first_child)
-			return i;
+	Process *ptr;
+	for (ptr = first_child->child; ptr; ptr = ptr->sibling) {
+		if (ptr->level == 3)
+			return ptr->pid;
 	}
 
 	return -1;
@@ -88,6 +88,13 @@ int find_child(int id) {
 
 // sleep and wait for a key to be pressed
 void firemon_sleep(int st) {
+	// no terminal handling for machine-readable output
+	if (arg_format != FORMAT_TEXT) {
+		format_flush();
+		sleep(st);
+		return;
+	}
+
 	if (terminal_set == 0) {
 		tcgetattr(0, &twait);          // get current terminal attributes; 0 is the file descriptor for stdin
 		memcpy(&tlocal, &twait, sizeof(tlocal));
@@ -156,6 +163,8 @@ int main(int argc, char **argv) {
 			}
 			arg_netstats = 1;
 		}
+		else if (strcmp(argv[i], "--daemon") == 0)
+			arg_daemon = 1;
 
 
 		// cumulative options with or without a pid argument
@@ -194,6 +203,10 @@ int main(int argc, char **argv) {
 		// etc
 		else if (strcmp(argv[i], "--nowrap") == 0)
 			arg_nowrap = 1;
+		else if (strncmp(argv[i], "--format=", 9) == 0)
+			format_set(argv[i] + 9);
+		else if (strncmp(argv[i], "--socket=", 9) == 0)
+			arg_socket = argv[i] + 9;
 
 		// invalid option
 		else if (*argv[i] == '-') {
@@ -218,6 +231,10 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	if (arg_daemon) {
+		daemon_run();
+		return 0;
+	}
 
 	// if the parent is firejail, skip the process
 	pid_t ppid = getppid();
@@ -231,6 +248,14 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
+	if (arg_socket) {
+		if (arg_format == FORMAT_TEXT) {
+			fprintf(stderr, "Error: --socket requires --format=json or --format=binary\n");
+			exit(1);
+		}
+		format_socket(arg_socket);
+	}
+
 	if (arg_top) {
 		top();	// print all sandboxes, --name disregarded
 		return 0;
@@ -248,6 +273,14 @@ int main(int argc, char **argv) {
 		return 0;
 	}
 
+	// machine-readable output is available only for some of the options
+	if (arg_format != FORMAT_TEXT &&
+	    ((!arg_cpu && !arg_seccomp && !arg_caps) ||
+	     arg_apparmor || arg_cgroup || arg_x11 || arg_interface || arg_route || arg_arp)) {
+		fprintf(stderr, "Error: --format is supported only with --top, --netstats, --list, --tree, --cpu, --caps and --seccomp\n");
+		exit(1);
+	}
+
 	// if --name requested without other options, print all data
 	if (pid && !arg_cpu && !arg_seccomp && !arg_caps && !arg_apparmor &&
 	    !arg_cgroup && !arg_x11 && !arg_interface && !arg_route && !arg_arp) {
@@ -303,7 +336,7 @@ int main(int argc, char **argv) {
 	}
 	(void) print_procs;
 
-	if (getuid() == 0) {
+	if (getuid() == 0 && arg_format == FORMAT_TEXT) {
 		tree((pid_t) pid);	// pid initialized as zero, will print the tree for all processes if a specific pid was not requested
 		procevent((pid_t) pid);
 	}
@@ -29,8 +29,49 @@
 #include "../include/pid.h"
 #include "../include/common.h"
 
+// machine-readable output, --format=
+#define FORMAT_TEXT 0
+#define FORMAT_JSON 1
+#define FORMAT_BINARY 2
+extern int arg_format;
+
+#define RECORD_MAGIC 0x31524d46	// "FMR1"
+enum {
+	RECORD_TOP = 0,
+	RECORD_NETSTATS,
+	RECORD_LIST,
+	RECORD_TREE,
+	RECORD_CPU,
+	RECORD_CAPS,
+	RECORD_SECCOMP,
+	RECORD_MAX
+};
+
+// binary record, one for each sandbox; in --format=binary the command and the
+// view-specific string follow the record
+typedef struct {
+	uint32_t magic;		// RECORD_MAGIC
+	uint16_t type;		// RECORD_TOP, RECORD_NETSTATS...
+	uint16_t level;		// 1 for the sandbox, > 1 for processes in the sandbox (--tree)
+	uint64_t time;		// seconds since the Epoch
+	uint32_t pid;
+	uint32_t parent;
+	uint32_t uid;
+	uint32_t procs;		// number of processes in the sandbox
+	uint64_t rss;		// KiB
+	uint64_t shared;	// KiB
+	uint64_t uptime;	// seconds
+	uint64_t rx;		// bytes per second
+	uint64_t tx;		// bytes per second
+	uint32_t cpu;		// CPU usage in 0.1% units
+	uint16_t cmdlen;
+	uint16_t datalen;
+} Record;
+
 // clear screen
 static inline void firemon_clrscr(void) {
+	if (arg_format != FORMAT_TEXT)
+		return;
 	printf("\033[2J\033[1;1H");
 	fflush(0);
 }
@@ -42,9 +83,40 @@ int find_child(int id);
 void firemon_sleep(int st);
 
 
+// format.c
+void format_set(const char *str);
+void format_socket(const char *path);
+void format_record(Record *rec, const char *cmd, const char *data);
+void format_flush(void);
+void format_status(int type, pid_t pid, pid_t child, const char *key);
+
 // procevent.c
+int procevent_netlink_setup(void);
 void procevent(pid_t pid);
 
+// track.c
+enum {
+	TRACK_NONE = 0,	// not a sandbox process
+	TRACK_NEW_SANDBOX,
+	TRACK_FORK,
+	TRACK_EXEC,
+	TRACK_EXIT,	// the caller removes the process using track_remove()
+	TRACK_EXIT_SANDBOX,	// the caller removes the process using track_remove()
+	TRACK_UID,
+	TRACK_GID,
+	TRACK_SID
+};
+struct proc_event;
+extern unsigned track_lost;
+void track_bootstrap(pid_t mon_pid);
+void track_remove(pid_t pid);
+void track_update(void);
+int track_event(struct proc_event *proc_ev, pid_t mon_pid, pid_t *pid, pid_t *child);
+int track_recv(int sock, void (*handler)(struct proc_event *proc_ev, void *arg), void *arg);
+
+// daemon.c
+void daemon_run(void);
+
 // usage.c
 void usage(void);
 
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+
+#define MAXBUF 4096
+
+int arg_format = FORMAT_TEXT;
+
+static const char *record_name[RECORD_MAX] = {
+	"top", "netstats", "list", "tree", "cpu", "caps", "seccomp"
+};
+
+// name of the view-specific string in JSON records
+static const char *record_data_name[RECORD_MAX] = {
+	NULL, NULL, "name", NULL, "cpus", "caps", "seccomp"
+};
+
+// parse --format=
+void format_set(const char *str) {
+	if (strcmp(str, "text") == 0)
+		arg_format = FORMAT_TEXT;
+	else if (strcmp(str, "json") == 0)
+		arg_format = FORMAT_JSON;
+	else if (strcmp(str, "binary") == 0)
+		arg_format = FORMAT_BINARY;
+	else {
+		fprintf(stderr, "Error: invalid output format, use text, json or binary\n");
+		exit(1);
+	}
+}
+
+// redirect the output to a Unix socket
+void format_socket(const char *path) {
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: invalid socket name %s\n", path);
+		exit(1);
+	}
+
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock == -1)
+		errExit("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Error: cannot connect to %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	fflush(0);
+	if (dup2(sock, STDOUT_FILENO) == -1)
+		errExit("dup2");
+	close(sock);
+}
+
+static void json_string(const char *str) {
+	putchar('"');
+	const unsigned char *ptr = (const unsigned char *) str;
+	while (*ptr) {
+		if (*ptr == '"' || *ptr == '\\') {
+			putchar('\\');
+			putchar(*ptr);
+		}
+		else if (*ptr < 0x20)
+			printf("\\u%04x", *ptr);
+		else
+			putchar(*ptr);
+		ptr++;
+	}
+	putchar('"');
+}
+
+// print a record on stdout; the command and the view-specific string can be NULL
+void format_record(Record *rec, const char *cmd, const char *data) {
+	assert(rec->type < RECORD_MAX);
+	rec->magic = RECORD_MAGIC;
+	rec->time = time(NULL);
+
+	if (arg_format == FORMAT_BINARY) {
+		// the record is followed by the command and the data strings, not null-terminated
+		size_t cmdlen = (cmd) ? strlen(cmd) : 0;
+		size_t datalen = (data) ? strlen(data) : 0;
+		rec->cmdlen = (cmdlen > UINT16_MAX) ? UINT16_MAX : cmdlen;
+		rec->datalen = (datalen > UINT16_MAX) ? UINT16_MAX : datalen;
+		fwrite(rec, sizeof(Record), 1, stdout);
+		if (rec->cmdlen)
+			fwrite(cmd, rec->cmdlen, 1, stdout);
+		if (rec->datalen)
+			fwrite(data, rec->datalen, 1, stdout);
+		return;
+	}
+
+	// JSON lines
+	printf("{\"type\":\"%s\",\"time\":%llu,\"pid\":%u,\"uid\":%u",
+		record_name[rec->type], (unsigned long long) rec->time, rec->pid, rec->uid);
+	switch (rec->type) {
+		case RECORD_TOP:
+			printf(",\"rss\":%llu,\"shared\":%llu,\"cpu\":%u.%u,\"procs\":%u,\"uptime\":%llu",
+				(unsigned long long) rec->rss, (unsigned long long) rec->shared,
+				rec->cpu / 10, rec->cpu % 10, rec->procs, (unsigned long long) rec->uptime);
+			break;
+		case RECORD_NETSTATS:
+			printf(",\"rx\":%llu,\"tx\":%llu",
+				(unsigned long long) rec->rx, (unsigned long long) rec->tx);
+			break;
+		case RECORD_TREE:
+			printf(",\"parent\":%u,\"level\":%u", rec->parent, rec->level);
+			break;
+		default:
+			break;
+	}
+	if (cmd) {
+		printf(",\"command\":");
+		json_string(cmd);
+	}
+	if (data && record_data_name[rec->type]) {
+		printf(",\"%s\":", record_data_name[rec->type]);
+		json_string(data);
+	}
+	printf("}\n");
+}
+
+// flush the records at the end of an interval; exit if the reader went away
+void format_flush(void) {
+	if (fflush(stdout) == EOF)
+		exit(0);
+}
+
+// print a sandbox record; data is extracted from a /proc/PID/status line of the sandboxed process
+void format_status(int type, pid_t pid, pid_t child, const char *key) {
+	Record rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.type = type;
+	rec.pid = pid;
+	rec.level = 1;
+	Process *proc = pid_find(pid);
+	if (proc)
+		rec.uid = proc->uid;
+
+	char *data = NULL;
+	char buf[MAXBUF];
+	if (child != -1) {
+		char fname[64];
+		snprintf(fname, sizeof(fname), "/proc/%d/status", child);
+		FILE *fp = fopen(fname, "r");
+		if (fp) {
+			size_t keylen = strlen(key);
+			while (fgets(buf, MAXBUF, fp)) {
+				if (strncmp(buf, key, keylen) == 0) {
+					data = buf + keylen;
+					while (*data == ' ' || *data == '\t')
+						data++;
+					char *ptr = strchr(data, '\n');
+					if (ptr)
+						*ptr = '\0';
+					break;
+				}
+			}
+			fclose(fp);
+		}
+	}
+
+	char *cmd = pid_proc_cmdline(pid);
+	format_record(&rec, cmd, data);
+	free(cmd);
+}
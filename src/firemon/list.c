@@ -19,15 +19,35 @@
 */
 #include "firemon.h"
 
+static void list_record(Process *ptr) {
+	Record rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.type = RECORD_LIST;
+	rec.level = 1;
+	rec.pid = ptr->pid;
+	rec.parent = ptr->parent;
+	rec.uid = ptr->uid;
+
+	char *cmd = pid_proc_cmdline(ptr->pid);
+	char *name = pid_get_sandbox_name(ptr->pid);
+	format_record(&rec, cmd, name);
+	free(cmd);
+	free(name);
+}
+
 void list(void) {
 	pid_read(0);	// include all processes
 
 	// print processes
-	int i;
-	for (i = 0; i < max_pids; i++) {
-		if (i == skip_process)
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (ptr->pid == skip_process)
 			continue;
-		if (pids[i].level == 1)
-			pid_print_list(i, arg_nowrap);
+		if (ptr->level == 1) {
+			if (arg_format != FORMAT_TEXT)
+				list_record(ptr);
+			else
+				pid_print_list(ptr->pid, arg_nowrap);
+		}
 	}
 }
@@ -54,12 +54,14 @@ static char *get_header(void) {
 }
 
 void get_stats(int parent) {
+	Process *proc = pid_find(parent);
+	if (!proc)
+		return;
+
 	// find the first child
 	int child = -1;
-	for (child = parent + 1; child < max_pids; child++) {
-		if (pids[child].parent == parent)
-			break;
-	}
+	if (proc->child)
+		child = proc->child->pid;
 
 	if (child == -1)
 		goto errexit;
@@ -105,10 +107,10 @@ void get_stats(int parent) {
 	}
 
 	// store data
-	pids[parent].rx_delta = rx - pids[parent].rx;
-	pids[parent].rx = rx;
-	pids[parent].tx_delta = tx - pids[parent].tx;
-	pids[parent].tx = tx;
+	proc->rx_delta = rx - proc->rx;
+	proc->rx = rx;
+	proc->tx_delta = tx - proc->tx;
+	proc->tx = tx;
 
 
 	free(fname);
@@ -116,10 +118,10 @@ void get_stats(int parent) {
 	return;
 
 errexit:
-	pids[parent].rx = 0;
-	pids[parent].tx = 0;
-	pids[parent].rx_delta = 0;
-	pids[parent].tx_delta = 0;
+	proc->rx = 0;
+	proc->tx = 0;
+	proc->rx_delta = 0;
+	proc->tx_delta = 0;
 }
 
 
@@ -127,6 +129,10 @@ static char *firejail_exec = NULL;
 static int firejail_exec_len = 0;
 static int firejail_exec_prefix_len = 0;
 static void print_proc(int index, int itv, int col) {
+	Process *proc = pid_find(index);
+	if (!proc)
+		return;
+
 	if (!firejail_exec) {
 		if (asprintf(&firejail_exec, "%s/bin/firejail", PREFIX) == -1)
 			errExit("asprintf");
@@ -138,7 +144,7 @@ static void print_proc(int index, int itv, int col) {
 	char *cmd = pid_proc_cmdline(index);
 	char *ptrcmd;
 	if (cmd == NULL) {
-		if (pids[index].zombie)
+		if (proc->zombie)
 			ptrcmd = "(zombie)";
 		else
 			ptrcmd = "";
@@ -160,12 +166,28 @@ static void print_proc(int index, int itv, int col) {
 		return;
 	}
 
+	if (arg_format != FORMAT_TEXT) {
+		Record rec;
+		memset(&rec, 0, sizeof(rec));
+		rec.type = RECORD_NETSTATS;
+		rec.level = 1;
+		rec.pid = index;
+		rec.parent = proc->parent;
+		rec.uid = proc->uid;
+		rec.rx = proc->rx_delta / itv;
+		rec.tx = proc->tx_delta / itv;
+		format_record(&rec, ptrcmd, NULL);
+		if (cmd)
+			free(cmd);
+		return;
+	}
+
 	// pid
 	char pidstr[11];
 	snprintf(pidstr, 11, "%d", index);
 
 	// user
-	char *user = get_user_name(pids[index].uid);
+	char *user = get_user_name(proc->uid);
 	char *ptruser;
 	if (user)
 		ptruser = user;
@@ -173,11 +195,11 @@ static void print_proc(int index, int itv, int col) {
 		ptruser = "";
 
 
-	float rx_kbps = ((float) pids[index].rx_delta / 1000) / itv;
+	float rx_kbps = ((float) proc->rx_delta / 1000) / itv;
 	char ptrrx[15];
 	sprintf(ptrrx, "%.03f", rx_kbps);
 
-	float tx_kbps = ((float) pids[index].tx_delta / 1000) / itv;
+	float tx_kbps = ((float) proc->tx_delta / 1000) / itv;
 	char ptrtx[15];
 	sprintf(ptrtx, "%.03f", tx_kbps);
 
@@ -198,19 +220,20 @@ static void print_proc(int index, int itv, int col) {
 void netstats(void) {
 	pid_read(0);	// include all processes
 
-	printf("Displaying network statistics only for sandboxes using a new network namespace.\n");
+	if (arg_format == FORMAT_TEXT)
+		printf("Displaying network statistics only for sandboxes using a new network namespace.\n");
 
 	// print processes
 	while (1) {
 		// set pid table
-		int i;
+		Process *ptr;
 		int itv = 1; 	// 1 second  interval
 		pid_read(0);
 
 		// start rx/tx measurements
-		for (i = 0; i < max_pids; i++) {
-			if (pids[i].level == 1)
-				get_stats(i);
+		for (ptr = pids; ptr; ptr = ptr->next) {
+			if (ptr->level == 1)
+				get_stats(ptr->pid);
 		}
 
 		// wait 1 seconds
@@ -220,28 +243,32 @@ void netstats(void) {
 		struct winsize sz;
 		int row = 24;
 		int col = 80;
-		if (!ioctl(0, TIOCGWINSZ, &sz)) {
-			col = sz.ws_col;
-			row = sz.ws_row;
-		}
+		if (arg_format == FORMAT_TEXT) {
+			if (!ioctl(0, TIOCGWINSZ, &sz)) {
+				col = sz.ws_col;
+				row = sz.ws_row;
+			}
 
-		// start printing
-		firemon_clrscr();
-		char *header = get_header();
-		if (strlen(header) > (size_t)col)
-			header[col] = '\0';
-		printf("%s\n", header);
-		if (row > 0)
-			row--;
-		free(header);
+			// start printing
+			firemon_clrscr();
+			char *header = get_header();
+			if (strlen(header) > (size_t)col)
+				header[col] = '\0';
+			printf("%s\n", header);
+			if (row > 0)
+				row--;
+			free(header);
+		}
 
 		// start rx/tx measurements
-		for (i = 0; i < max_pids; i++) {
-			if (pids[i].level == 1) {
-				get_stats(i);
-				print_proc(i, itv, col);
+		for (ptr = pids; ptr; ptr = ptr->next) {
+			if (ptr->level == 1) {
+				get_stats(ptr->pid);
+				print_proc(ptr->pid, itv, col);
 			}
 		}
+		if (arg_format != FORMAT_TEXT)
+			format_flush();
 #ifdef HAVE_GCOV
 			__gcov_flush();
 #endif
@@ -54,229 +54,275 @@ static char *get_header(void) {
 }
 
 
-static char *firejail_exec = NULL;
-static int firejail_exec_len = 0;
-static int firejail_exec_prefix_len = 0;
-// recursivity!!!
-static char *print_top(unsigned index, unsigned parent, unsigned *utime, unsigned *stime, unsigned itv, float *cpu, int *cnt) {
-	char *rv = NULL;
-
-	// Remove unused parameter warning
-	(void)parent;
+// one row for each sandbox, no strings are built until the row is printed
+typedef struct {
+	pid_t pid;
+	pid_t parent;
+	uid_t uid;
+	unsigned char zombie;
+	int cnt;			// process count
+	float cpu;
+	unsigned long long rss;		// KiB
+	unsigned long long shared;	// KiB
+	unsigned long long uptime;	// seconds
+} Row;
+
+// reusable row array
+static Row *rows = NULL;
+static int rows_cnt = 0;
+static int rows_max = 0;
+
+static Row *row_new(void) {
+	if (rows_cnt == rows_max) {
+		rows_max = (rows_max) ? rows_max * 2 : 64;
+		rows = realloc(rows, rows_max * sizeof(Row));
+		if (!rows)
+			errExit("realloc");
+	}
+	return &rows[rows_cnt++];
+}
 
-	char procdir[20];
-	snprintf(procdir, 20, "/proc/%u", index);
-	struct stat s;
-	if (stat(procdir, &s) == -1)
-		return NULL;
+// recursivity!!!
+static void collect_top(unsigned index, unsigned *utime, unsigned *stime, unsigned itv, Row *row) {
+	// stat and statm are read once per refresh
+	Process *proc = pid_find(index);
+	if (!proc || pid_read_stats(proc) == -1)
+		return;
 
-	if (pids[index].level == 1) {
+	if (proc->level == 1) {
 		pgs_rss = 0;
 		pgs_shared = 0;
 		*utime = 0;
 		*stime = 0;
-		*cnt = 0;
+		row->cnt = 0;
 	}
 
-	(*cnt)++;
-	pid_getmem(index, &pgs_rss, &pgs_shared);
-	unsigned utmp;
-	unsigned stmp;
-	pid_get_cpu_time(index, &utmp, &stmp);
-	*utime += utmp;
-	*stime += stmp;
+	row->cnt++;
+	pgs_rss += proc->rss;
+	pgs_shared += proc->shared;
+	*utime += proc->cpu_utime;
+	*stime += proc->cpu_stime;
 
+	Process *ptr;
+	for (ptr = proc->child; ptr; ptr = ptr->sibling)
+		collect_top(ptr->pid, utime, stime, itv, row);
 
-	int i;
-	for (i = index + 1; i < max_pids; i++) {
-		if (pids[i].parent == (pid_t)index)
-			print_top(i, index, utime, stime, itv, cpu, cnt);
-	}
-
-	if (!firejail_exec) {
-		if (asprintf(&firejail_exec, "%s/bin/firejail", PREFIX) == -1)
-			errExit("asprintf");
-		firejail_exec_len = strlen(firejail_exec);
-		firejail_exec_prefix_len = strlen(PREFIX) + 5;
-	}
-
-	if (pids[index].level == 1) {
-		// pid
-		char pidstr[10];
-		snprintf(pidstr, 10, "%u", index);
-
-		// command
-		char *cmd = pid_proc_cmdline(index);
-		char *ptrcmd;
-		if (cmd == NULL) {
-			if (pids[index].zombie)
-				ptrcmd = "(zombie)";
-			else
-				ptrcmd = "";
-		}
-		else if (strncmp(cmd, firejail_exec, firejail_exec_len) == 0)
-			ptrcmd = cmd + firejail_exec_prefix_len;
-		else
-			ptrcmd = cmd;
-
-		// user
-		char *user = get_user_name(pids[index].uid);
-		char *ptruser;
-		if (user)
-			ptruser = user;
-		else
-			ptruser = "";
+	if (proc->level == 1) {
+		row->pid = index;
+		row->parent = proc->parent;
+		row->uid = proc->uid;
+		row->zombie = proc->zombie;
 
 		// memory
 		if (pgsz == 0)
 			pgsz = getpagesize();
-		char rss[10];
-		snprintf(rss, 10, "%u", pgs_rss * pgsz / 1024);
-		char shared[10];
-		snprintf(shared, 10, "%u", pgs_shared * pgsz / 1024);
+		row->rss = (unsigned long long) pgs_rss * pgsz / 1024;
+		row->shared = (unsigned long long) pgs_shared * pgsz / 1024;
 
 		// uptime
-		unsigned long long uptime = pid_get_start_time(index);
+		unsigned long long uptime = proc->start_time;
 		if (clocktick == 0)
 			clocktick = sysconf(_SC_CLK_TCK);
 		uptime /= clocktick;
-		uptime = sysuptime - uptime;
-		unsigned sec = uptime % 60;
-		uptime -= sec;
-		uptime /= 60;
-		unsigned min = uptime % 60;
-		uptime -= min;
-		uptime /= 60;
-		unsigned hour = uptime;
-		char uptime_str[50];
-		snprintf(uptime_str, 50, "%02u:%02u:%02u", hour, min, sec);
+		row->uptime = sysuptime - uptime;
 
 		// cpu
 		itv *= clocktick;
-		float ud = (float) (*utime - pids[index].utime) / itv * 100;
-		float sd = (float) (*stime - pids[index].stime) / itv * 100;
-		float cd = ud + sd;
-		*cpu = cd;
-		char cpu_str[10];
-		snprintf(cpu_str, 10, "%2.1f", cd);
-
-		// process count
-		char prcs_str[10];
-		snprintf(prcs_str, 10, "%d", *cnt);
-
-		if (asprintf(&rv, "%-5.5s %-9.9s %-8.8s %-8.8s %-5.5s %-4.4s %-9.9s %s",
-		                 pidstr, ptruser, rss, shared, cpu_str, prcs_str, uptime_str, ptrcmd) == -1)
-			errExit("asprintf");
-
-		if (cmd)
-			free(cmd);
-		if (user)
-			free(user);
-
+		float ud = (float) (*utime - proc->utime) / itv * 100;
+		float sd = (float) (*stime - proc->stime) / itv * 100;
+		row->cpu = ud + sd;
 	}
+}
 
-	return rv;
+// row ordering: higher cpu first, lower pid first on equal cpu
+static inline int row_before(const Row *a, const Row *b) {
+	if (a->cpu != b->cpu)
+		return a->cpu > b->cpu;
+	return a->pid < b->pid;
 }
 
+static int row_cmp(const void *a, const void *b) {
+	const Row *r1 = *(Row * const *) a;
+	const Row *r2 = *(Row * const *) b;
+	if (row_before(r1, r2))
+		return -1;
+	if (row_before(r2, r1))
+		return 1;
+	return 0;
+}
 
-typedef struct node_t {
-	struct node_t *next;
-	char *line;
-	float cpu;
-} Node;
-
-static Node *head = NULL;
-
-static void head_clear(void) {
-	Node *ptr = head;
-	while (ptr) {
-		if (ptr->line)
-			free(ptr->line);
-		Node *next = ptr->next;
-		free(ptr);
-		ptr = next;
+static void heap_sift_down(Row **heap, int len, int i) {
+	while (1) {
+		int l = 2 * i + 1;
+		int r = l + 1;
+		int min = i;
+		// the root of the heap is the row printed last
+		if (l < len && row_before(heap[min], heap[l]))
+			min = l;
+		if (r < len && row_before(heap[min], heap[r]))
+			min = r;
+		if (min == i)
+			return;
+		Row *tmp = heap[i];
+		heap[i] = heap[min];
+		heap[min] = tmp;
+		i = min;
 	}
-
-	head = NULL;
 }
 
-static void head_add(float cpu, char *line) {
-	// allocate a new node structure
-	Node *node = malloc(sizeof(Node));
-	if (!node)
-		errExit("malloc");
-	node->line = line;
-	node->cpu = cpu;
-	node->next = NULL;
-
-	// insert in first list position
-	if (head == NULL || head->cpu < cpu) {
-		node->next = head;
-		head = node;
-		return;
+static void heap_sift_up(Row **heap, int i) {
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!row_before(heap[parent], heap[i]))
+			return;
+		Row *tmp = heap[i];
+		heap[i] = heap[parent];
+		heap[parent] = tmp;
+		i = parent;
 	}
+}
 
-	// insert in the right place
-	Node *ptr = head;
-	while (1) {
-		// last position
-		Node *current = ptr->next;
-		if (current == NULL) {
-			ptr->next = node;
-			return;
+// select the top n rows using a bounded heap, and sort them
+static int select_top(Row **heap, int n) {
+	int len = 0;
+	int i;
+	for (i = 0; i < rows_cnt; i++) {
+		Row *row = &rows[i];
+		if (len < n) {
+			heap[len] = row;
+			heap_sift_up(heap, len);
+			len++;
 		}
-
-		// current position
-		if (current->cpu < cpu) {
-			ptr->next = node;
-			node->next = current;
-			return;
+		else if (len && row_before(row, heap[0])) {
+			heap[0] = row;
+			heap_sift_down(heap, len, 0);
 		}
-
-		ptr = current;
 	}
+
+	qsort(heap, len, sizeof(Row *), row_cmp);
+	return len;
 }
 
-void head_print(int col, int row) {
-	Node *ptr = head;
-	int current = 0;
-	while (ptr) {
-		if (current >= row)
-			break;
+static char *firejail_exec = NULL;
+static int firejail_exec_len = 0;
+static int firejail_exec_prefix_len = 0;
 
-		if (strlen(ptr->line) > (size_t)col)
-			ptr->line[col] = '\0';
+static void print_row(Row *row, int col, int last) {
+	if (!firejail_exec) {
+		if (asprintf(&firejail_exec, "%s/bin/firejail", PREFIX) == -1)
+			errExit("asprintf");
+		firejail_exec_len = strlen(firejail_exec);
+		firejail_exec_prefix_len = strlen(PREFIX) + 5;
+	}
 
-		if (ptr->next == NULL || current == (row - 1)) {
-			printf("%s", ptr->line);
-			fflush(0);
-		}
+	// command
+	char *cmd = pid_proc_cmdline(row->pid);
+	char *ptrcmd;
+	if (cmd == NULL) {
+		if (row->zombie)
+			ptrcmd = "(zombie)";
 		else
-			printf("%s\n", ptr->line);
+			ptrcmd = "";
+	}
+	else if (strncmp(cmd, firejail_exec, firejail_exec_len) == 0)
+		ptrcmd = cmd + firejail_exec_prefix_len;
+	else
+		ptrcmd = cmd;
+
+	if (arg_format != FORMAT_TEXT) {
+		Record rec;
+		memset(&rec, 0, sizeof(rec));
+		rec.type = RECORD_TOP;
+		rec.level = 1;
+		rec.pid = row->pid;
+		rec.parent = row->parent;
+		rec.uid = row->uid;
+		rec.procs = row->cnt;
+		rec.rss = row->rss;
+		rec.shared = row->shared;
+		rec.uptime = row->uptime;
+		rec.cpu = (uint32_t) (row->cpu * 10 + 0.5);
+		format_record(&rec, ptrcmd, NULL);
+		if (cmd)
+			free(cmd);
+		return;
+	}
 
-		ptr = ptr->next;
-		current++;
+	// pid
+	char pidstr[10];
+	snprintf(pidstr, 10, "%u", row->pid);
+
+	// user
+	char *user = get_user_name(row->uid);
+	char *ptruser;
+	if (user)
+		ptruser = user;
+	else
+		ptruser = "";
+
+	// memory
+	char rss[20];
+	snprintf(rss, 20, "%llu", row->rss);
+	char shared[20];
+	snprintf(shared, 20, "%llu", row->shared);
+
+	// uptime
+	unsigned long long uptime = row->uptime;
+	unsigned sec = uptime % 60;
+	uptime -= sec;
+	uptime /= 60;
+	unsigned min = uptime % 60;
+	uptime -= min;
+	uptime /= 60;
+	unsigned hour = uptime;
+	char uptime_str[50];
+	snprintf(uptime_str, 50, "%02u:%02u:%02u", hour, min, sec);
+
+	// cpu
+	char cpu_str[10];
+	snprintf(cpu_str, 10, "%2.1f", row->cpu);
+
+	// process count
+	char prcs_str[10];
+	snprintf(prcs_str, 10, "%d", row->cnt);
+
+	char line[col + 1];
+	snprintf(line, col + 1, "%-5.5s %-9.9s %-8.8s %-8.8s %-5.5s %-4.4s %-9.9s %s",
+		pidstr, ptruser, rss, shared, cpu_str, prcs_str, uptime_str, ptrcmd);
+	if (last) {
+		printf("%s", line);
+		fflush(0);
 	}
+	else
+		printf("%s\n", line);
+
+	if (cmd)
+		free(cmd);
+	if (user)
+		free(user);
 }
 
 void top(void) {
+	Row **heap = NULL;
+	int heap_max = 0;
+
 	while (1) {
-		// clear linked list
-		head_clear();
+		// reuse the row array
+		rows_cnt = 0;
 
 		// set pid table
-		int i;
+		Process *ptr;
 		int itv = 1; // 1 second  interval
 		pid_read(0);
 
 		// start cpu measurements
 		unsigned utime = 0;
 		unsigned stime = 0;
-		for (i = 0; i < max_pids; i++) {
-			if (i == skip_process)
+		for (ptr = pids; ptr; ptr = ptr->next) {
+			if (ptr->pid == skip_process)
 				continue;
-			if (pids[i].level == 1)
-				pid_store_cpu(i, 0, &utime, &stime);
+			if (ptr->level == 1)
+				pid_store_cpu(ptr->pid, 0, &utime, &stime);
 		}
 
 		// wait 1 second
@@ -286,22 +332,24 @@ void top(void) {
 		struct winsize sz;
 		int row = 24;
 		int col = 80;
-		if (!ioctl(STDIN_FILENO, TIOCGWINSZ, &sz)) {
-			if (sz.ws_col > 0 && sz.ws_row > 0) {
-				col = sz.ws_col;
-				row = sz.ws_row;
+		if (arg_format == FORMAT_TEXT) {
+			if (!ioctl(STDIN_FILENO, TIOCGWINSZ, &sz)) {
+				if (sz.ws_col > 0 && sz.ws_row > 0) {
+					col = sz.ws_col;
+					row = sz.ws_row;
+				}
 			}
-		}
 
-		// start printing
-		firemon_clrscr();
-		char *header = get_header();
-		if (strlen(header) > (size_t)col)
-			header[col] = '\0';
-		printf("%s\n", header);
-		if (row > 0)
-			row--;
-		free(header);
+			// start printing
+			firemon_clrscr();
+			char *header = get_header();
+			if (strlen(header) > (size_t)col)
+				header[col] = '\0';
+			printf("%s\n", header);
+			if (row > 0)
+				row--;
+			free(header);
+		}
 
 		// find system uptime
 		FILE *fp = fopen("/proc/uptime", "r");
@@ -313,19 +361,38 @@ void top(void) {
 			fclose(fp);
 		}
 
-		// print processes
-		for (i = 0; i < max_pids; i++) {
-			if (i == skip_process)
+		// collect sandbox data
+		for (ptr = pids; ptr; ptr = ptr->next) {
+			if (ptr->pid == skip_process)
 				continue;
-			if (pids[i].level == 1) {
-				float cpu = 0;
-				int cnt = 0; // process count
-				char *line = print_top(i, 0, &utime, &stime, itv, &cpu, &cnt);
-				if (line)
-					head_add(cpu, line);
+			if (ptr->level == 1) {
+				Row *r = row_new();
+				memset(r, 0, sizeof(Row));
+				collect_top(ptr->pid, &utime, &stime, itv, r);
+				if (r->pid == 0)	// the sandbox is gone
+					rows_cnt--;
 			}
 		}
-		head_print(col, row);
+
+		// print sandboxes
+		if (arg_format == FORMAT_TEXT) {
+			if (heap_max < row) {
+				heap_max = row;
+				heap = realloc(heap, heap_max * sizeof(Row *));
+				if (!heap)
+					errExit("realloc");
+			}
+			int len = select_top(heap, row);
+			int i;
+			for (i = 0; i < len; i++)
+				print_row(heap[i], col, i == len - 1);
+		}
+		else {
+			int i;
+			for (i = 0; i < rows_cnt; i++)
+				print_row(&rows[i], col, 0);
+			format_flush();
+		}
 #ifdef HAVE_GCOV
 			__gcov_flush();
 #endif
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Sandbox tracking engine: the process table is read once from /proc, and
+// from then on it is updated using the events received from the kernel
+// process connector.
+#include "firemon.h"
+#include <sys/socket.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <linux/cn_proc.h>
+
+#define TRACK_BATCH 64		// datagrams received with a single recvmmsg() call
+#define TRACK_MSGLEN 512	// the kernel sends one process event in each datagram
+
+static int track_reparent = 0;	// a sandbox process exited, its children were moved to a new parent
+unsigned track_lost = 0;	// number of times the kernel dropped events
+
+// firejail options that don't start a sandbox, sorted
+static const char *const track_exclude[] = {
+	"apparmor.print", "bandwidth", "caps.print", "cpu.print", "debug-caps", "debug-errnos",
+	"debug-protocols", "debug-syscalls", "dns.print", "fs.print", "get", "help", "list", "ls",
+	"netfilter.print", "netfilter6.print", "netstats", "overlay-clean", "profile.print",
+	"protocol.print", "put", "seccomp.print", "top", "tree", "version"
+};
+
+static int track_exclude_cmp(const void *key, const void *elem) {
+	return strcmp((const char *) key, *(const char * const *) elem);
+}
+
+// the program just executed by the process is firejail starting a new sandbox
+static int track_is_firejail(pid_t pid) {
+	char buf[4096];
+	if (pid_read_file(pid, "comm", buf, sizeof(buf)) == -1 || strncmp(buf, "firejail", 8) != 0)
+		return 0;
+
+	ssize_t len = pid_read_file(pid, "cmdline", buf, sizeof(buf));
+	if (len == -1)
+		return 1;
+
+	// look at the options, skip argv[0]
+	char *end = buf + len;
+	char *arg = buf + strlen(buf) + 1;
+	while (arg < end && strncmp(arg, "--", 2) == 0) {
+		char *next = arg + strlen(arg) + 1;
+		arg += 2;
+		char *ptr = strchr(arg, '=');
+		if (ptr)
+			*ptr = '\0';
+		if (bsearch(arg, track_exclude, sizeof(track_exclude) / sizeof(track_exclude[0]),
+		            sizeof(track_exclude[0]), track_exclude_cmp))
+			return 0;
+		arg = next;
+	}
+
+	return 1;
+}
+
+// find the sandbox for all the processes in the table
+static void track_set_sandbox(void) {
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		ptr->sandbox = 0;
+		if (ptr->level <= 0)
+			continue;
+
+		Process *sandbox = ptr;
+		while (sandbox && sandbox->level > 1)
+			sandbox = pid_find(sandbox->parent);
+		if (sandbox)
+			ptr->sandbox = sandbox->pid;
+	}
+}
+
+// read the process table from /proc; the socket should be already open,
+// the events generated during the scan are applied on top of it
+void track_bootstrap(pid_t mon_pid) {
+	pid_scan(mon_pid);
+	track_set_sandbox();
+	track_reparent = 0;
+}
+
+// remove a process after TRACK_EXIT and TRACK_EXIT_SANDBOX events
+void track_remove(pid_t pid) {
+	Process *proc = pid_find(pid);
+	if (proc && proc->level > 0)
+		track_reparent = 1;
+	pid_remove(pid);
+}
+
+// the children of an exited process were moved by the kernel to a new parent;
+// read the new parent from /proc and update the levels
+void track_update(void) {
+	if (!track_reparent)
+		return;
+	track_reparent = 0;
+
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (ptr->level > 1 && !pid_find(ptr->parent))
+			pid_read_stats(ptr);
+	}
+
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (ptr->level <= 0)
+			continue;
+
+		short level = 1;
+		Process *p = ptr;
+		while (p && p->pid != ptr->sandbox) {
+			p = pid_find(p->parent);
+			level++;
+		}
+		if (p)
+			ptr->level = level;
+	}
+}
+
+// update the process table; mon_pid: sandbox monitored, 0 for all sandboxes
+// return TRACK_NONE if the event is not related to a sandbox
+int track_event(struct proc_event *proc_ev, pid_t mon_pid, pid_t *pid, pid_t *child) {
+	Process *proc;
+	*child = 0;
+
+	switch (proc_ev->what) {
+		case PROC_EVENT_FORK:
+			if (proc_ev->event_data.fork.child_pid != proc_ev->event_data.fork.child_tgid)
+				return TRACK_NONE; // this is a thread, not a process
+			*pid = proc_ev->event_data.fork.parent_tgid;
+			proc = pid_find(*pid);
+			if (!proc || proc->level <= 0)
+				return TRACK_NONE;
+
+			*child = proc_ev->event_data.fork.child_tgid;
+			Process *proc_child = pid_insert(*child);
+			proc_child->parent = proc->pid;
+			proc_child->level = proc->level + 1;
+			proc_child->sandbox = proc->sandbox;
+			proc_child->uid = proc->uid;	// inherited from the parent
+			proc_child->uid_valid = proc->uid_valid;
+			proc_child->type = -1;
+			proc_child->age = 255;	// the type is known, /proc is not read again
+			return TRACK_FORK;
+
+		case PROC_EVENT_EXEC:
+			*pid = proc_ev->event_data.exec.process_tgid;
+			proc = pid_find(*pid);
+			if (proc && proc->level > 0) {
+				if (proc->cmd) {
+					free(proc->cmd);
+					proc->cmd = NULL;
+				}
+				return TRACK_EXEC;
+			}
+			if (mon_pid || !track_is_firejail(*pid))
+				return TRACK_NONE;
+
+			// new sandbox
+			proc = pid_insert(*pid);
+			if (pid_read_stats(proc) == -1) {
+				pid_remove(*pid);
+				return TRACK_NONE;
+			}
+			if (proc->cmd) {
+				free(proc->cmd);
+				proc->cmd = NULL;
+			}
+			proc->level = 1;
+			proc->sandbox = *pid;
+			proc->uid = pid_get_uid(*pid);
+			proc->uid_valid = 1;
+			proc->type = 1;
+			proc->age = 255;
+			return TRACK_NEW_SANDBOX;
+
+		case PROC_EVENT_EXIT:
+			if (proc_ev->event_data.exit.process_pid != proc_ev->event_data.exit.process_tgid)
+				return TRACK_NONE; // this is a thread, not a process
+			*pid = proc_ev->event_data.exit.process_tgid;
+			proc = pid_find(*pid);
+			if (!proc)
+				return TRACK_NONE;
+			if (proc->level <= 0) {
+				pid_remove(*pid);
+				return TRACK_NONE;
+			}
+			return (proc->level == 1) ? TRACK_EXIT_SANDBOX : TRACK_EXIT;
+
+		case PROC_EVENT_UID:
+			*pid = proc_ev->event_data.id.process_tgid;
+			proc = pid_find(*pid);
+			if (!proc || proc->level <= 0)
+				return TRACK_NONE;
+			proc->uid = proc_ev->event_data.id.r.ruid;
+			proc->uid_valid = 1;
+			if (proc->user) {
+				free(proc->user);
+				proc->user = NULL;
+			}
+			return TRACK_UID;
+
+		case PROC_EVENT_GID:
+			*pid = proc_ev->event_data.id.process_tgid;
+			proc = pid_find(*pid);
+			return (proc && proc->level > 0) ? TRACK_GID : TRACK_NONE;
+
+		case PROC_EVENT_SID:
+			*pid = proc_ev->event_data.sid.process_tgid;
+			proc = pid_find(*pid);
+			return (proc && proc->level > 0) ? TRACK_SID : TRACK_NONE;
+
+		default:
+			return TRACK_NONE;
+	}
+}
+
+// receive all the pending events and pass them to the handler
+// return the number of events received, or -1 if the kernel dropped events (ENOBUFS)
+int track_recv(int sock, void (*handler)(struct proc_event *proc_ev, void *arg), void *arg) {
+	static char buf[TRACK_BATCH][TRACK_MSGLEN] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+	struct iovec iov[TRACK_BATCH];
+	struct mmsghdr msgs[TRACK_BATCH];
+	int cnt = 0;
+
+	while (1) {
+		int i;
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < TRACK_BATCH; i++) {
+			iov[i].iov_base = buf[i];
+			iov[i].iov_len = TRACK_MSGLEN;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int n = recvmmsg(sock, msgs, TRACK_BATCH, MSG_DONTWAIT, NULL);
+		if (n == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return cnt;
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				track_lost++;
+				return -1;
+			}
+			errExit("recvmmsg");
+		}
+
+		for (i = 0; i < n; i++) {
+			unsigned len = msgs[i].msg_len;
+			struct nlmsghdr *nlmsghdr;
+			for (nlmsghdr = (struct nlmsghdr *) buf[i];
+			     NLMSG_OK(nlmsghdr, len);
+			     nlmsghdr = NLMSG_NEXT(nlmsghdr, len)) {
+				if (nlmsghdr->nlmsg_type == NLMSG_ERROR || nlmsghdr->nlmsg_type == NLMSG_NOOP)
+					continue;
+				struct cn_msg *cn_msg = NLMSG_DATA(nlmsghdr);
+				if (cn_msg->id.idx != CN_IDX_PROC || cn_msg->id.val != CN_VAL_PROC)
+					continue;
+				handler((struct proc_event *) cn_msg->data, arg);
+				cnt++;
+			}
+		}
+
+		if (n < TRACK_BATCH)
+			return cnt;
+	}
+}
@@ -19,16 +19,40 @@
 */
 #include "firemon.h"
 
+// recursivity!!!
+static void tree_record(Process *ptr) {
+	Record rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.type = RECORD_TREE;
+	rec.level = ptr->level;
+	rec.pid = ptr->pid;
+	rec.parent = ptr->parent;
+	rec.uid = ptr->uid;
+
+	char *cmd = pid_proc_cmdline(ptr->pid);
+	format_record(&rec, cmd, NULL);
+	free(cmd);
+
+	Process *child;
+	for (child = ptr->child; child; child = child->sibling)
+		tree_record(child);
+}
+
 void tree(pid_t pid) {
 	pid_read(pid);
 
 	// print processes
-	int i;
-	for (i = 0; i < max_pids; i++) {
-		if (i == skip_process)
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (ptr->pid == skip_process)
 			continue;
-		if (pids[i].level == 1)
-			pid_print_tree(i, 0, arg_nowrap);
+		if (ptr->level == 1) {
+			if (arg_format != FORMAT_TEXT)
+				tree_record(ptr);
+			else
+				pid_print_tree(ptr->pid, 0, arg_nowrap);
+		}
 	}
-	printf("\n");
+	if (arg_format == FORMAT_TEXT)
+		printf("\n");
 }
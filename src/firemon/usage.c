@@ -31,6 +31,11 @@ static char *help_str =
 	"\t--caps - print capabilities configuration for each sandbox.\n\n"
 	"\t--cgroup - print control group information for each sandbox.\n\n"
 	"\t--cpu - print CPU affinity for each sandbox.\n\n"
+	"\t--daemon - keep track of the sandboxes in the background and publish\n"
+	"\t\tthe process table in /run/firejail/firemon.table; root only.\n\n"
+	"\t--format=text|json|binary - output format for --top, --netstats, --list,\n"
+	"\t\t--tree, --cpu, --caps and --seccomp; json and binary formats stream\n"
+	"\t\tone record for each sandbox, without any terminal handling.\n\n"
 	"\t--help, -? - this help screen.\n\n"
 	"\t--interface - print network interface information for each sandbox.\n\n"
 	"\t--list - list all sandboxes.\n\n"
@@ -40,6 +45,7 @@ static char *help_str =
 	"\t--nowrap - enable line wrapping in terminals.\n\n"
 	"\t--route - print route table for each sandbox.\n\n"
 	"\t--seccomp - print seccomp configuration for each sandbox.\n\n"
+	"\t--socket=path - send json or binary records to a Unix socket.\n\n"
 	"\t--tree - print a tree of all sandboxed processes.\n\n"
 	"\t--top - monitor the most CPU-intensive sandboxes.\n\n"
 	"\t--version - print program version and exit.\n\n"
@@ -26,15 +26,15 @@ void x11(pid_t pid, int print_procs) {
 	pid_read(pid);
 
 	// print processes
-	int i;
-	for (i = 0; i < max_pids; i++) {
-		if (pids[i].level == 1) {
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (ptr->level == 1) {
 			if (print_procs || pid == 0)
-				pid_print_list(i, arg_nowrap);
+				pid_print_list(ptr->pid, arg_nowrap);
 
 			char *x11file;
 			// todo: use macro from src/firejail/firejail.h for /run/firejail/x11 directory
-			if (asprintf(&x11file, "/run/firejail/x11/%d", i) == -1)
+			if (asprintf(&x11file, "/run/firejail/x11/%d", ptr->pid) == -1)
 				errExit("asprintf");
 
 			FILE *fp = fopen(x11file, "r");
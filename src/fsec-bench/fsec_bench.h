@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef FSEC_BENCH_H
+#define FSEC_BENCH_H
+#include "../include/common.h"
+#include "../include/seccomp.h"
+#include "../include/strace.h"
+#include "../include/syscall_list.h"
+#include <sys/mman.h>
+
+// interp.c
+int interp_run(const struct sock_filter *filter, int entries, const struct seccomp_data *data, uint32_t *ret);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fsec_bench.h"
+
+// Classic BPF interpreter following the kernel seccomp rules: the filter reads struct
+// seccomp_data with absolute loads, there are 16 words of scratch memory, jumps go only
+// forward, and the filter ends with a return instruction.
+
+// run the filter; return the number of instructions executed, or -1 if the filter is invalid
+int interp_run(const struct sock_filter *filter, int entries, const struct seccomp_data *data, uint32_t *ret) {
+	uint32_t A = 0;
+	uint32_t X = 0;
+	uint32_t mem[BPF_MEMWORDS];
+	memset(mem, 0, sizeof(mem));
+	const unsigned char *ptr = (const unsigned char *) data;
+
+	int cnt = 0;
+	int pc = 0;
+	while (pc < entries) {
+		const struct sock_filter *ins = &filter[pc++];
+		cnt++;
+
+		switch (ins->code) {
+		case BPF_LD + BPF_W + BPF_ABS:
+			if (ins->k % sizeof(uint32_t) || ins->k >= sizeof(struct seccomp_data))
+				return -1;
+			memcpy(&A, ptr + ins->k, sizeof(uint32_t));
+			break;
+		case BPF_LD + BPF_W + BPF_LEN:
+			A = sizeof(struct seccomp_data);
+			break;
+		case BPF_LDX + BPF_W + BPF_LEN:
+			X = sizeof(struct seccomp_data);
+			break;
+		case BPF_LD + BPF_IMM:
+			A = ins->k;
+			break;
+		case BPF_LDX + BPF_IMM:
+			X = ins->k;
+			break;
+		case BPF_LD + BPF_MEM:
+			if (ins->k >= BPF_MEMWORDS)
+				return -1;
+			A = mem[ins->k];
+			break;
+		case BPF_LDX + BPF_MEM:
+			if (ins->k >= BPF_MEMWORDS)
+				return -1;
+			X = mem[ins->k];
+			break;
+		case BPF_ST:
+			if (ins->k >= BPF_MEMWORDS)
+				return -1;
+			mem[ins->k] = A;
+			break;
+		case BPF_STX:
+			if (ins->k >= BPF_MEMWORDS)
+				return -1;
+			mem[ins->k] = X;
+			break;
+		case BPF_MISC + BPF_TAX:
+			X = A;
+			break;
+		case BPF_MISC + BPF_TXA:
+			A = X;
+			break;
+
+		case BPF_ALU + BPF_ADD + BPF_K: A += ins->k; break;
+		case BPF_ALU + BPF_ADD + BPF_X: A += X; break;
+		case BPF_ALU + BPF_SUB + BPF_K: A -= ins->k; break;
+		case BPF_ALU + BPF_SUB + BPF_X: A -= X; break;
+		case BPF_ALU + BPF_MUL + BPF_K: A *= ins->k; break;
+		case BPF_ALU + BPF_MUL + BPF_X: A *= X; break;
+		case BPF_ALU + BPF_DIV + BPF_K:
+			if (ins->k == 0)
+				return -1;
+			A /= ins->k;
+			break;
+		case BPF_ALU + BPF_DIV + BPF_X:
+			if (X == 0) {
+				*ret = SECCOMP_RET_KILL;	// the kernel aborts the filter
+				return cnt;
+			}
+			A /= X;
+			break;
+		case BPF_ALU + BPF_MOD + BPF_K:
+			if (ins->k == 0)
+				return -1;
+			A %= ins->k;
+			break;
+		case BPF_ALU + BPF_MOD + BPF_X:
+			if (X == 0) {
+				*ret = SECCOMP_RET_KILL;
+				return cnt;
+			}
+			A %= X;
+			break;
+		case BPF_ALU + BPF_AND + BPF_K: A &= ins->k; break;
+		case BPF_ALU + BPF_AND + BPF_X: A &= X; break;
+		case BPF_ALU + BPF_OR + BPF_K: A |= ins->k; break;
+		case BPF_ALU + BPF_OR + BPF_X: A |= X; break;
+		case BPF_ALU + BPF_XOR + BPF_K: A ^= ins->k; break;
+		case BPF_ALU + BPF_XOR + BPF_X: A ^= X; break;
+		case BPF_ALU + BPF_LSH + BPF_K: A = (ins->k < 32) ? A << ins->k : 0; break;
+		case BPF_ALU + BPF_LSH + BPF_X: A = (X < 32) ? A << X : 0; break;
+		case BPF_ALU + BPF_RSH + BPF_K: A = (ins->k < 32) ? A >> ins->k : 0; break;
+		case BPF_ALU + BPF_RSH + BPF_X: A = (X < 32) ? A >> X : 0; break;
+		case BPF_ALU + BPF_NEG: A = -A; break;
+
+		case BPF_JMP + BPF_JA + BPF_K:
+			pc += ins->k;
+			break;
+		case BPF_JMP + BPF_JEQ + BPF_K: pc += (A == ins->k) ? ins->jt : ins->jf; break;
+		case BPF_JMP + BPF_JEQ + BPF_X: pc += (A == X) ? ins->jt : ins->jf; break;
+		case BPF_JMP + BPF_JGT + BPF_K: pc += (A > ins->k) ? ins->jt : ins->jf; break;
+		case BPF_JMP + BPF_JGT + BPF_X: pc += (A > X) ? ins->jt : ins->jf; break;
+		case BPF_JMP + BPF_JGE + BPF_K: pc += (A >= ins->k) ? ins->jt : ins->jf; break;
+		case BPF_JMP + BPF_JGE + BPF_X: pc += (A >= X) ? ins->jt : ins->jf; break;
+		case BPF_JMP + BPF_JSET + BPF_K: pc += (A & ins->k) ? ins->jt : ins->jf; break;
+		case BPF_JMP + BPF_JSET + BPF_X: pc += (A & X) ? ins->jt : ins->jf; break;
+
+		case BPF_RET + BPF_K:
+			*ret = ins->k;
+			return cnt;
+		case BPF_RET + BPF_A:
+			*ret = A;
+			return cnt;
+
+		default:
+			return -1;
+		}
+	}
+
+	// jumped past the end of the filter
+	return -1;
+}
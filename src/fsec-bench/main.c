@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fsec_bench.h"
+
+#define MAX_FILTERS 16
+
+typedef struct {
+	const char *fname;
+	struct sock_filter *filter;
+	int entries;
+} Filter;
+static Filter filters[MAX_FILTERS];
+static int filters_cnt = 0;
+
+static int arg_verbose = 0;
+static int arg_max_insns = 0;		// 0: no limit
+static double arg_max_avg = 0;		// 0: no limit
+static int nr_max;
+
+// instructions executed and filter result for each syscall number
+static int *insns;
+static uint32_t *result;
+static unsigned long long *calls;	// number of calls in the trace
+
+static void usage(void) {
+	printf("Usage:\n");
+	printf("\tfsec-bench [options] file [file...] - run seccomp filters in a BPF interpreter\n");
+	printf("\n");
+	printf("The filters are run for every syscall number on the native architecture, and\n");
+	printf("the number of BPF instructions executed is reported. If several files are given,\n");
+	printf("all of them are run, the same way the kernel runs stacked filters.\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t--trace=file - weight the results by the syscalls in an strace output file;\n");
+	printf("\t\tboth plain strace output and strace -c summaries are accepted\n");
+	printf("\t--max-insns=number - fail if a syscall executes more instructions\n");
+	printf("\t--max-avg=number - fail if the average number of instructions is higher\n");
+	printf("\t--verbose - print the results for every syscall\n");
+}
+
+static void filter_load(const char *fname) {
+	if (filters_cnt == MAX_FILTERS) {
+		fprintf(stderr, "Error: too many filters\n");
+		exit(1);
+	}
+
+	int fd = open(fname, O_RDONLY);
+	if (fd == -1)
+		goto errexit;
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size == -1)
+		goto errexit;
+	if (size == 0 || size % sizeof(struct sock_filter) || size / sizeof(struct sock_filter) > BPF_MAXINSNS) {
+		fprintf(stderr, "Error: %s is not a seccomp filter\n", fname);
+		exit(1);
+	}
+	struct sock_filter *filter = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (filter == MAP_FAILED)
+		goto errexit;
+	close(fd);
+
+	filters[filters_cnt].fname = fname;
+	filters[filters_cnt].filter = filter;
+	filters[filters_cnt].entries = size / sizeof(struct sock_filter);
+	filters_cnt++;
+	return;
+
+errexit:
+	fprintf(stderr, "Error: cannot read %s\n", fname);
+	exit(1);
+}
+
+// kernel precedence of the filter results: the lowest action wins, compared as signed numbers
+static inline int32_t action_of(uint32_t ret) {
+	return (int32_t) (ret & 0xffff0000U);
+}
+
+static void run_filters(void) {
+	int nr;
+	for (nr = 0; nr <= nr_max; nr++) {
+		struct seccomp_data data;
+		memset(&data, 0, sizeof(data));
+		data.nr = nr;
+		data.arch = ARCH_NR;
+
+		// the most recent filter runs first
+		int i;
+		for (i = filters_cnt - 1; i >= 0; i--) {
+			uint32_t ret;
+			int cnt = interp_run(filters[i].filter, filters[i].entries, &data, &ret);
+			if (cnt == -1) {
+				fprintf(stderr, "Error: invalid filter %s\n", filters[i].fname);
+				exit(1);
+			}
+			insns[nr] += cnt;
+			if (i == filters_cnt - 1 || action_of(ret) < action_of(result[nr]))
+				result[nr] = ret;
+		}
+	}
+}
+
+static void trace_add(const char *name, unsigned long long cnt, void *arg) {
+	unsigned *unknown = arg;
+	int nr = syscall_find_name(name);
+	if (nr < 0 || nr > nr_max) {
+		(*unknown)++;
+		return;
+	}
+	calls[nr] += cnt;
+}
+
+static void trace_load(const char *fname) {
+	unsigned unknown = 0;
+	if (strace_read(fname, trace_add, &unknown) == -1) {
+		fprintf(stderr, "Error: cannot open %s\n", fname);
+		exit(1);
+	}
+	if (unknown)
+		fprintf(stderr, "Warning: %u syscalls in %s not available on this platform\n", unknown, fname);
+}
+
+static void print_action(uint32_t ret) {
+	switch (ret & SECCOMP_RET_ACTION) {
+		case SECCOMP_RET_ALLOW:
+			printf("allow");
+			break;
+		case SECCOMP_RET_ERRNO:
+			printf("errno %u", ret & SECCOMP_RET_DATA);
+			break;
+		case SECCOMP_RET_TRAP:
+			printf("trap");
+			break;
+		case SECCOMP_RET_TRACE:
+			printf("trace");
+			break;
+		case SECCOMP_RET_LOG:
+			printf("log");
+			break;
+		default:
+			printf("kill");
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *trace = NULL;
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-?") == 0) {
+			usage();
+			return 0;
+		}
+		else if (strncmp(argv[i], "--trace=", 8) == 0)
+			trace = argv[i] + 8;
+		else if (strncmp(argv[i], "--max-insns=", 12) == 0)
+			arg_max_insns = atoi(argv[i] + 12);
+		else if (strncmp(argv[i], "--max-avg=", 10) == 0)
+			arg_max_avg = atof(argv[i] + 10);
+		else if (strcmp(argv[i], "--verbose") == 0)
+			arg_verbose = 1;
+		else if (*argv[i] == '-') {
+			fprintf(stderr, "Error: invalid option %s\n", argv[i]);
+			usage();
+			return 1;
+		}
+		else
+			filter_load(argv[i]);
+	}
+	if (filters_cnt == 0) {
+		usage();
+		return 1;
+	}
+
+	nr_max = syscall_nr_max();
+	insns = calloc(nr_max + 1, sizeof(int));
+	result = calloc(nr_max + 1, sizeof(uint32_t));
+	calls = calloc(nr_max + 1, sizeof(unsigned long long));
+	if (!insns || !result || !calls)
+		errExit("calloc");
+
+	run_filters();
+	if (trace)
+		trace_load(trace);
+
+	// statistics over all syscall numbers, and over the trace
+	int min = insns[0], max = insns[0];
+	double sum = 0;
+	int tmin = 0, tmax = 0;
+	double tsum = 0;
+	unsigned long long tcalls = 0;
+	int tdistinct = 0;
+	int nr;
+	for (nr = 0; nr <= nr_max; nr++) {
+		if (insns[nr] < min)
+			min = insns[nr];
+		if (insns[nr] > max)
+			max = insns[nr];
+		sum += insns[nr];
+
+		if (calls[nr]) {
+			if (tdistinct == 0 || insns[nr] < tmin)
+				tmin = insns[nr];
+			if (tdistinct == 0 || insns[nr] > tmax)
+				tmax = insns[nr];
+			tsum += (double) insns[nr] * calls[nr];
+			tcalls += calls[nr];
+			tdistinct++;
+		}
+
+		if (arg_verbose) {
+			const char *name = syscall_find_nr(nr);
+			printf("%d\t%-24s %d\t", nr, (name) ? name : "-", insns[nr]);
+			print_action(result[nr]);
+			if (calls[nr])
+				printf("\t%llu calls", calls[nr]);
+			printf("\n");
+		}
+	}
+	double avg = sum / (nr_max + 1);
+
+	int size = 0;
+	for (i = 0; i < filters_cnt; i++)
+		size += filters[i].entries;
+	printf("Filter size: %d instructions in %d file%s\n", size, filters_cnt, (filters_cnt > 1) ? "s" : "");
+	printf("All syscalls: %d, instructions executed min %d, avg %.2f, max %d\n",
+		nr_max + 1, min, avg, max);
+	if (trace) {
+		if (tcalls) {
+			avg = tsum / tcalls;
+			printf("Trace: %llu calls, %d syscalls, instructions executed min %d, avg %.2f, max %d\n",
+				tcalls, tdistinct, tmin, avg, tmax);
+			min = tmin;
+			max = tmax;
+		}
+		else
+			printf("Trace: no syscalls found\n");
+	}
+
+	// regression checks
+	int rv = 0;
+	if (arg_max_insns && max > arg_max_insns) {
+		fprintf(stderr, "Error: %d instructions executed, the maximum is %d\n", max, arg_max_insns);
+		rv = 1;
+	}
+	if (arg_max_avg && avg > arg_max_avg) {
+		fprintf(stderr, "Error: %.2f instructions executed on average, the maximum is %.2f\n", avg, arg_max_avg);
+		rv = 1;
+	}
+	return rv;
+}
@@ -21,10 +21,17 @@
 #define FSEC_OPTIMIZE_H
 #include "../include/common.h"
 #include "../include/seccomp.h"
+#include "../include/strace.h"
+#include "../include/syscall_list.h"
+#include "../include/tree_plan.h"
 #include <sys/mman.h>
 
 // optimize.c
 struct sock_filter *duplicate(struct sock_filter *filter, int entries);
 int optimize(struct sock_filter * filter, int entries);
+void optimize_load_freq(const char *fname);
+
+// verify.c
+int verify(struct sock_filter *filter1, int entries1, struct sock_filter *filter2, int entries2);
 
 #endif
\ No newline at end of file
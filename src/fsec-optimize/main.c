@@ -21,7 +21,9 @@
 
 static void usage(void) {
 	printf("Usage:\n");
-	printf("\tfsec-optimize file - optimize seccomp filter\n");
+	printf("\tfsec-optimize [--freq=file] file - optimize seccomp filter\n");
+	printf("\t\t--freq: order the syscall checks by the syscall frequencies in\n");
+	printf("\t\tan strace output file or strace -c summary\n");
 }
 
 int main(int argc, char **argv) {
@@ -34,6 +36,12 @@ for (i = 0; i < argc; i++)
 printf("\n");
 }
 #endif
+	if (argc == 3 && strncmp(argv[1], "--freq=", 7) == 0) {
+		optimize_load_freq(argv[1] + 7);
+		argc--;
+		argv++;
+	}
+
 	if (argc != 2) {
 		usage();
 		return 1;
@@ -27,99 +27,482 @@
 //	__u32	k;      /* Generic multiuse field */
 //};
 
+// The filter is converted into a graph, where every node is an instruction and the edges are
+// the jumps. The optimizations are done on the graph:
+//	- unconditional jumps and conditional jumps with both branches going to the same place are removed
+//	- identical instructions jumping to the same places are merged, this includes the return instructions
+//	- the checks following a load are replaced by a balanced decision tree, contiguous
+//	  values with the same outcome are merged into ranges, and duplicate checks are removed;
+//	  with a syscall frequency profile, the tree for the syscall number is balanced by
+//	  the number of calls, and it is kept only if it executes fewer instructions
+//	- the instructions not reachable from the start of the filter are dropped
+// At the end a new filter is generated from the graph, and all the jumps are recalculated.
 
-#define LIMIT_BLACKLISTS 4	// we optimize blacklists only if we have more than
+typedef struct {
+	struct sock_filter ins;
+	int jt;		// jump true, or the next node for instructions other than jumps; -1 for return
+	int jf;
+} Node;
+static Node *nodes = NULL;
+static int nodes_cnt = 0;
+static int nodes_size = 0;
+
+#define MAX_JUMP 255	// jt and jf are 8 bit offsets
+
+static inline int is_ret(struct sock_filter *ins) {
+	return BPF_CLASS(ins->code) == BPF_RET;
+}
 
-static inline int is_blacklist(struct sock_filter *bpf) {
-	if (bpf->code == BPF_JMP + BPF_JEQ + BPF_K &&
-	    (bpf + 1)->code == BPF_RET + BPF_K &&
-	    (bpf + 1)->k == SECCOMP_RET_KILL )
-		return 1;
+static inline int is_cond(struct sock_filter *ins) {
+	return BPF_CLASS(ins->code) == BPF_JMP && BPF_OP(ins->code) != BPF_JA;
+}
+
+static inline int is_ja(struct sock_filter *ins) {
+	return BPF_CLASS(ins->code) == BPF_JMP && BPF_OP(ins->code) == BPF_JA;
+}
+
+// comparisons on the accumulator the decision tree is built from
+static inline int is_compare(struct sock_filter *ins) {
+	return ins->code == BPF_JMP + BPF_JEQ + BPF_K ||
+	       ins->code == BPF_JMP + BPF_JGT + BPF_K ||
+	       ins->code == BPF_JMP + BPF_JGE + BPF_K;
+}
+
+static int compare(struct sock_filter *ins, uint32_t val) {
+	switch (BPF_OP(ins->code)) {
+	case BPF_JEQ:
+		return val == ins->k;
+	case BPF_JGT:
+		return val > ins->k;
+	case BPF_JGE:
+		return val >= ins->k;
+	}
+	assert(0);
 	return 0;
 }
 
-static int count_blacklists(struct sock_filter *filter, int entries) {
-	int cnt = 0;
+static int node_add(struct sock_filter ins, int jt, int jf) {
+	if (nodes_cnt == nodes_size) {
+		nodes_size *= 2;
+		nodes = realloc(nodes, nodes_size * sizeof(Node));
+		if (!nodes)
+			errExit("realloc");
+	}
+	nodes[nodes_cnt].ins = ins;
+	nodes[nodes_cnt].jt = jt;
+	nodes[nodes_cnt].jf = jf;
+	return nodes_cnt++;
+}
+
+// return -1 if the filter cannot be converted
+static int graph_build(struct sock_filter *filter, int entries) {
+	nodes_size = 2 * entries;
+	nodes = realloc(nodes, nodes_size * sizeof(Node));
+	if (!nodes)
+		errExit("realloc");
+	nodes_cnt = 0;
+
+	if (!is_ret(&filter[entries - 1]))
+		return -1;
+
 	int i;
+	for (i = 0; i < entries; i++) {
+		struct sock_filter *ins = &filter[i];
+		int jt = -1;
+		int jf = -1;
+		if (is_cond(ins)) {
+			jt = i + 1 + ins->jt;
+			jf = i + 1 + ins->jf;
+		}
+		else if (is_ja(ins)) {
+			if (ins->k >= (uint32_t) entries)
+				return -1;
+			jt = i + 1 + ins->k;
+		}
+		else if (!is_ret(ins))
+			jt = i + 1;
+		if (jt >= entries || jf >= entries)
+			return -1;
+		node_add(*ins, jt, jf);
+	}
+
+	return 0;
+}
 
-	for (i = 0; i < (entries - 1); i++, filter++) { // is_blacklist works on two consecutive lines; using entries - 1
-		if (is_blacklist(filter))
-			cnt++;
+//**********************************
+// node merging
+//**********************************
+// skip over unconditional jumps and over conditional jumps with a known outcome
+static int skip_jumps(int id) {
+	while (1) {
+		struct sock_filter *ins = &nodes[id].ins;
+		if (is_ja(ins) || (is_cond(ins) && nodes[id].jt == nodes[id].jf))
+			id = nodes[id].jt;
+		else if (ins->code == BPF_JMP + BPF_JGE + BPF_K && ins->k == 0)
+			id = nodes[id].jt;	// always true
+		else if (ins->code == BPF_JMP + BPF_JGT + BPF_K && ins->k == 0xffffffff)
+			id = nodes[id].jf;	// always false
+		else
+			return id;
 	}
+}
 
-	return cnt;
+static int *merged = NULL;	// node id after merging, -1 if not processed yet
+static int *hash = NULL;
+static int hash_size = 0;
+
+static unsigned node_hash(Node *node) {
+	unsigned h = node->ins.code;
+	h = h * 31 + node->ins.k;
+	if (BPF_CLASS(node->ins.code) != BPF_JMP) {
+		h = h * 31 + node->ins.jt;
+		h = h * 31 + node->ins.jf;
+	}
+	h = h * 31 + (unsigned) node->jt;
+	h = h * 31 + (unsigned) node->jf;
+	return h & (hash_size - 1);
 }
 
-typedef struct {
-	int to_remove;
-	int to_fix_jumps;
-} Action;
+static int node_equal(Node *n1, Node *n2) {
+	if (n1->ins.code != n2->ins.code || n1->ins.k != n2->ins.k ||
+	    n1->jt != n2->jt || n1->jf != n2->jf)
+		return 0;
+	// jt and jf offsets are meaningful only for instructions other than jumps
+	if (BPF_CLASS(n1->ins.code) != BPF_JMP && (n1->ins.jt != n2->ins.jt || n1->ins.jf != n2->ins.jf))
+		return 0;
+	return 1;
+}
 
-static int optimize_blacklists(struct sock_filter *filter, int entries) {
-	assert(entries);
-	assert(filter);
+static int node_merge(int id) {
+	int orig = id;
+	if (merged[orig] != -1)
+		return merged[orig];
+
+	id = skip_jumps(id);
+	if (merged[id] != -1) {
+		merged[orig] = merged[id];
+		return merged[id];
+	}
+
+	Node *node = &nodes[id];
+	int rv = -1;
+	if (is_cond(&node->ins)) {
+		node->jt = node_merge(node->jt);
+		node->jf = node_merge(node->jf);
+		if (node->jt == node->jf)
+			rv = node->jt;
+	}
+	else if (!is_ret(&node->ins))
+		node->jt = node_merge(node->jt);
+
+	if (rv == -1) {
+		unsigned h = node_hash(node);
+		while (hash[h] != -1 && !node_equal(&nodes[hash[h]], node))
+			h = (h + 1) & (hash_size - 1);
+		if (hash[h] == -1)
+			hash[h] = id;
+		rv = hash[h];
+	}
+
+	merged[id] = rv;
+	merged[orig] = rv;
+	return rv;
+}
+
+// return the new start node
+static int graph_merge(int start) {
+	merged = realloc(merged, nodes_cnt * sizeof(int));
+	hash_size = 1;
+	while (hash_size < 2 * nodes_cnt)
+		hash_size *= 2;
+	hash = realloc(hash, hash_size * sizeof(int));
+	if (!merged || !hash)
+		errExit("realloc");
+	memset(merged, 0xff, nodes_cnt * sizeof(int));
+	memset(hash, 0xff, hash_size * sizeof(int));
+
+	return node_merge(start);
+}
+
+//**********************************
+// decision trees
+//**********************************
+// ranges of values with the same outcome, the outcome of a segment is the node executed next
+static Segment *segs = NULL;
+static int segs_cnt = 0;
+static TreePlan plan;
+
+// syscall frequency profile
+static FreqProfile freq;
+
+static void freq_add(const char *name, unsigned long long calls, void *arg) {
+	(void) arg;
+	int nr = syscall_find_name(name);
+	if (nr < 0)
+		return;
+	freq_profile_add(&freq, nr, calls);
+}
+
+// load a frequency profile from an strace output file or an strace -c summary
+void optimize_load_freq(const char *fname) {
+	if (strace_read(fname, freq_add, NULL) == -1) {
+		fprintf(stderr, "Error fsec-optimize: cannot open %s\n", fname);
+		exit(1);
+	}
+}
+
+static int *region = NULL;	// comparison nodes following a load
+static int region_cnt = 0;
+static int *depth = NULL;	// longest chain of comparisons starting from a node, -1 if not in the region
+
+static int region_walk(int id) {
+	if (!is_compare(&nodes[id].ins))
+		return 0;
+	if (depth[id] != -1)
+		return depth[id];
+
+	region[region_cnt++] = id;
+	depth[id] = 0;
+	int d1 = region_walk(nodes[id].jt);
+	int d2 = region_walk(nodes[id].jf);
+	depth[id] = 1 + ((d1 > d2) ? d1 : d2);
+	return depth[id];
+}
+
+// find the node executed after the region for a value in the accumulator
+static int region_exit(int id, uint32_t val) {
+	while (is_compare(&nodes[id].ins))
+		id = (compare(&nodes[id].ins, val)) ? nodes[id].jt : nodes[id].jf;
+	return id;
+}
+
+static int uint32_cmp(const void *a, const void *b) {
+	uint32_t v1 = *(const uint32_t *) a;
+	uint32_t v2 = *(const uint32_t *) b;
+	return (v1 < v2) ? -1 : (v1 > v2);
+}
+
+static void build_segments(int root, int weighted) {
+	// the outcome can change only at the values compared, and right after them
+	uint32_t *val = malloc((2 * region_cnt + 1) * sizeof(uint32_t));
+	segs = realloc(segs, (2 * region_cnt + 2) * sizeof(Segment));
+	if (!val || !segs)
+		errExit("malloc");
+	int cnt = 0;
+	val[cnt++] = 0;
 	int i;
-	int j;
-
-	// step1: extract information
-	Action action[entries];
-	memset(&action[0], 0, sizeof(Action) * entries);
-	int remove_cnt = 0;
-	for (i = 0; i < (entries - 1); i++) { // is_blacklist works on two consecutive lines; using entries - 1
-		if (is_blacklist(filter + i)) {
-			action[i]. to_fix_jumps = 1;
-			i++;
-			action[i].to_remove = 1;
-			remove_cnt++;
-		}
+	for (i = 0; i < region_cnt; i++) {
+		uint32_t k = nodes[region[i]].ins.k;
+		val[cnt++] = k;
+		if (k != 0xffffffff)
+			val[cnt++] = k + 1;
+	}
+	qsort(val, cnt, sizeof(uint32_t), uint32_cmp);
+
+	segs_cnt = 0;
+	for (i = 0; i < cnt; i++) {
+		if (i && val[i] == val[i - 1])
+			continue;
+		int node = region_exit(root, val[i]);
+		if (segs_cnt && segs[segs_cnt - 1].outcome == (uint32_t) node)
+			continue;	// extend the previous range
+		segs[segs_cnt].start = val[i];
+		segs[segs_cnt].outcome = node;
+		segs_cnt++;
 	}
+	free(val);
+
+	tree_count_calls(segs, segs_cnt, (weighted) ? &freq : NULL);
+}
 
-	// step2: remove lines
-	struct sock_filter *filter_step2 = duplicate(filter, entries);
-	Action action_step2[entries];
-	memset(&action_step2[0], 0, sizeof(Action) * entries);
-	for (i = 0, j = 0; i < entries; i++) {
-		if (!action[i].to_remove) {
-			memcpy(&filter_step2[j], &filter[i], sizeof(struct sock_filter));
-			memcpy(&action_step2[j], &action[i], sizeof(Action));
-			j++;
+// comparisons executed for the syscalls in the frequency profile
+static unsigned long long region_cost(int root) {
+	unsigned long long cost = 0;
+	int i;
+	for (i = 0; i < freq.cnt; i++) {
+		int id = root;
+		while (is_compare(&nodes[id].ins)) {
+			cost += freq.entry[i].calls;
+			id = (compare(&nodes[id].ins, freq.entry[i].nr)) ? nodes[id].jt : nodes[id].jf;
 		}
-		else {
-			// do nothing, we are removing this line
+	}
+	return cost;
+}
+
+// build the tree for segments lo to hi, return the root node and the tree depth
+static int build_tree(int lo, int hi, int *tree_depth) {
+	if (lo == hi) {
+		*tree_depth = 0;
+		return segs[lo].outcome;
+	}
+
+	// a single value inside a range, as in the architecture check
+	if (hi - lo == 2 && segs[lo].outcome == segs[hi].outcome && segs[lo + 1].start + 1 == segs[hi].start) {
+		*tree_depth = 1;
+		struct sock_filter ins = BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, segs[lo + 1].start, 0, 0);
+		return node_add(ins, segs[lo + 1].outcome, segs[lo].outcome);
+	}
+
+	int mid = tree_split(&plan, lo, hi);
+	int d1;
+	int d2;
+	int right = build_tree(mid, hi, &d1);
+	int left = build_tree(lo, mid - 1, &d2);
+	*tree_depth = 1 + ((d1 > d2) ? d1 : d2);
+	struct sock_filter ins = BPF_JUMP(BPF_JMP+BPF_JGE+BPF_K, segs[mid].start, 0, 0);
+	return node_add(ins, right, left);
+}
+
+// replace the comparisons following each load with a decision tree
+static void graph_trees(void) {
+	int cnt = nodes_cnt;
+	depth = realloc(depth, cnt * sizeof(int));
+	region = realloc(region, cnt * sizeof(int));
+	if (!depth || !region)
+		errExit("realloc");
+
+	int i;
+	for (i = 0; i < cnt; i++) {
+		if (nodes[i].ins.code != BPF_LD + BPF_W + BPF_ABS || merged[i] != i)
+			continue;	// the node was removed during merging
+		int root = nodes[i].jt;
+		if (!is_compare(&nodes[root].ins))
+			continue;
+
+		memset(depth, 0xff, cnt * sizeof(int));
+		region_cnt = 0;
+		int region_depth = region_walk(root);
+		int weighted = nodes[i].ins.k == offsetof(struct seccomp_data, nr);
+		build_segments(root, weighted);
+		tree_plan(&plan, segs, segs_cnt);
+
+		int mark = nodes_cnt;
+		int tree_depth;
+		int tree = build_tree(0, segs_cnt - 1, &tree_depth);
+		int better = tree_depth < region_depth ||
+		    (tree_depth == region_depth && nodes_cnt - mark < region_cnt);
+		if (weighted) {
+			unsigned long long region_calls = region_cost(root);
+			unsigned long long tree_calls = region_cost(tree);
+			if (tree_calls != region_calls)
+				better = tree_calls < region_calls;
 		}
+		if (better)
+			nodes[i].jt = tree;
+		else
+			nodes_cnt = mark;	// no improvement, drop the tree
 	}
+}
 
-	// step 3: add the new ret KILL, and recalculate entries
-	filter_step2[j].code = BPF_RET + BPF_K;
-	filter_step2[j].k = SECCOMP_RET_KILL;
-	entries = j + 1;
+//**********************************
+// code generation
+//**********************************
+// the code is generated backwards; index i has i instructions after it in the final filter
+static struct sock_filter *code = NULL;
+static int code_cnt = 0;
+static int *pos = NULL;		// nearest instruction for a node, -1 if not generated yet
+static int *owner = NULL;	// node generated at an index
 
-	// step 4: recalculate jumps
-	for (i = 0; i < entries; i++) {
-		if (action_step2[i].to_fix_jumps) {
-			filter_step2[i].jt = entries - i - 2;
-			filter_step2[i].jf = 0;
+static int emit(struct sock_filter ins, int id) {
+	code[code_cnt] = ins;
+	owner[code_cnt] = id;
+	pos[id] = code_cnt;
+	return code_cnt++;
+}
+
+static inline int is_far(int from, int target) {
+	return from - target - 1 > MAX_JUMP;
+}
+
+// instruction forwarding to a target too far away for jt/jf, or not right after an instruction
+static int emit_far(int target) {
+	if (is_ret(&code[target]))
+		return emit(code[target], owner[target]);	// a copy of the return instruction
+	struct sock_filter ins = BPF_JUMP(BPF_JMP+BPF_JA+BPF_K, code_cnt - target - 1, 0, 0);
+	return emit(ins, owner[target]);
+}
+
+static int emit_node(int id) {
+	if (pos[id] != -1)
+		return pos[id];
+
+	Node *node = &nodes[id];
+	struct sock_filter ins = node->ins;
+	if (is_ret(&ins))
+		return emit(ins, id);
+
+	if (is_cond(&ins)) {
+		int t = emit_node(node->jt);
+		int f = emit_node(node->jf);
+		if (is_far(code_cnt, t) || is_far(code_cnt, f)) {
+			if (!is_far(code_cnt, t) && !is_far(code_cnt + 1, t))
+				f = emit_far(f);
+			else if (!is_far(code_cnt, f) && !is_far(code_cnt + 1, f))
+				t = emit_far(t);
+			else {
+				t = emit_far(t);
+				f = emit_far(f);
+			}
 		}
+		ins.jt = code_cnt - t - 1;
+		ins.jf = code_cnt - f - 1;
+		return emit(ins, id);
 	}
 
-	// update
-	memcpy(filter, filter_step2, entries * sizeof(struct sock_filter));
-	free(filter_step2);
-	return entries;
+	// the next instruction has to follow
+	int next = emit_node(node->jt);
+	if (next != code_cnt - 1)
+		emit_far(next);
+	return emit(ins, id);
+}
+
+// return the number of instructions
+static int graph_emit(int start) {
+	// every node is generated once, with at most two extra instructions for far jumps
+	code = realloc(code, 3 * nodes_cnt * sizeof(struct sock_filter));
+	owner = realloc(owner, 3 * nodes_cnt * sizeof(int));
+	pos = realloc(pos, nodes_cnt * sizeof(int));
+	if (!code || !owner || !pos)
+		errExit("realloc");
+	memset(pos, 0xff, nodes_cnt * sizeof(int));
+	code_cnt = 0;
+
+	int root = emit_node(start);
+	assert(root == code_cnt - 1);
+
+	// the code was generated backwards
+	int i;
+	for (i = 0; i < code_cnt / 2; i++) {
+		struct sock_filter tmp = code[i];
+		code[i] = code[code_cnt - 1 - i];
+		code[code_cnt - 1 - i] = tmp;
+	}
+	return code_cnt;
 }
 
 int optimize(struct sock_filter *filter, int entries) {
 	assert(filter);
 	assert(entries);
 
-	//**********************************
-	// optimize blacklist statements
-	//**********************************
-	// count "ret KILL"
-	int cnt = count_blacklists(filter, entries);
-	if (cnt > LIMIT_BLACKLISTS)
-		entries = optimize_blacklists(filter, entries);
-	return entries;
+	if (graph_build(filter, entries) == -1)
+		return entries;
+
+	int start = graph_merge(0);
+	graph_trees();
+	start = graph_merge(start);
+	int cnt = graph_emit(start);
+
+	// keep the original filter if it is shorter, or if the two filters cannot be proved equivalent
+	if (cnt > entries)
+		return entries;
+	int rv = verify(filter, entries, code, cnt);
+	if (rv == 0)
+		fprintf(stderr, "Warning fsec-optimize: the optimized filter is different, optimization skipped\n");
+	if (rv != 1)
+		return entries;
+
+	memcpy(filter, code, cnt * sizeof(struct sock_filter));
+	return cnt;
 }
 
 struct sock_filter *duplicate(struct sock_filter *filter, int entries) {
@@ -133,4 +516,3 @@ struct sock_filter *duplicate(struct sock_filter *filter, int entries) {
 	memcpy(rv, filter, len);
 	return rv;
 }
-
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fsec_optimize.h"
+
+// Equivalence check for two seccomp filters made of loads from struct seccomp_data, comparisons
+// with constants and return instructions. The result of a filter can change only at the values
+// compared with a data word, and right after them. Running the two filters with all the combinations
+// of these values covers every possible input: all syscall numbers, architectures and arguments.
+
+#define DATA_WORDS ((int) (sizeof(struct seccomp_data) / sizeof(uint32_t)))
+#define VERIFY_MAX (1 << 22)	// maximum number of inputs tested
+
+// data word in the accumulator
+#define ACC_UNSET -3	// instruction not reached
+#define ACC_CONFLICT -2	// different words depending on the path
+#define ACC_NONE -1	// nothing loaded yet, the accumulator is 0
+
+typedef struct {
+	int loaded;
+	uint32_t *val;
+	int cnt;
+	int size;
+} Word;
+static Word words[DATA_WORDS];
+
+static int is_supported(struct sock_filter *filter, int entries) {
+	if (BPF_CLASS(filter[entries - 1].code) != BPF_RET)
+		return 0;
+
+	int i;
+	for (i = 0; i < entries; i++) {
+		struct sock_filter *ins = &filter[i];
+		switch (ins->code) {
+		case BPF_LD + BPF_W + BPF_ABS:
+			if (ins->k % sizeof(uint32_t) || ins->k >= sizeof(struct seccomp_data))
+				return 0;
+			words[ins->k / sizeof(uint32_t)].loaded = 1;
+			break;
+		case BPF_JMP + BPF_JA + BPF_K:
+			if (ins->k >= (uint32_t) (entries - i - 1))
+				return 0;
+			break;
+		case BPF_JMP + BPF_JEQ + BPF_K:
+		case BPF_JMP + BPF_JGT + BPF_K:
+		case BPF_JMP + BPF_JGE + BPF_K:
+			if (i + 1 + ins->jt >= entries || i + 1 + ins->jf >= entries)
+				return 0;
+			break;
+		case BPF_RET + BPF_K:
+			break;
+		default:
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void value_add(int word, uint32_t val) {
+	Word *w = &words[word];
+	if (w->cnt == w->size) {
+		w->size = (w->size) ? w->size * 2 : 64;
+		w->val = realloc(w->val, w->size * sizeof(uint32_t));
+		if (!w->val)
+			errExit("realloc");
+	}
+	w->val[w->cnt++] = val;
+}
+
+static void acc_set(int *acc, int index, int word) {
+	if (acc[index] == ACC_UNSET)
+		acc[index] = word;
+	else if (acc[index] != word)
+		acc[index] = ACC_CONFLICT;
+}
+
+// collect the values compared with each data word
+static void collect_values(struct sock_filter *filter, int entries) {
+	int acc[entries];
+	int i;
+	for (i = 0; i < entries; i++)
+		acc[i] = ACC_UNSET;
+	acc[0] = ACC_NONE;
+
+	// jumps go only forward
+	for (i = 0; i < entries; i++) {
+		struct sock_filter *ins = &filter[i];
+		if (acc[i] == ACC_UNSET)
+			continue;
+
+		if (ins->code == BPF_LD + BPF_W + BPF_ABS)
+			acc_set(acc, i + 1, ins->k / sizeof(uint32_t));
+		else if (ins->code == BPF_JMP + BPF_JA + BPF_K)
+			acc_set(acc, i + 1 + ins->k, acc[i]);
+		else if (BPF_CLASS(ins->code) == BPF_JMP) {
+			int j;
+			for (j = 0; j < DATA_WORDS; j++) {
+				if (words[j].loaded && (acc[i] == j || acc[i] == ACC_CONFLICT)) {
+					value_add(j, ins->k);
+					if (ins->k != 0xffffffff)
+						value_add(j, ins->k + 1);
+				}
+			}
+			acc_set(acc, i + 1 + ins->jt, acc[i]);
+			acc_set(acc, i + 1 + ins->jf, acc[i]);
+		}
+	}
+}
+
+static uint32_t run(struct sock_filter *filter, const uint32_t *data) {
+	uint32_t a = 0;
+	int pc = 0;
+	while (1) {
+		struct sock_filter *ins = &filter[pc];
+		switch (ins->code) {
+		case BPF_LD + BPF_W + BPF_ABS:
+			a = data[ins->k / sizeof(uint32_t)];
+			pc++;
+			break;
+		case BPF_JMP + BPF_JA + BPF_K:
+			pc += 1 + ins->k;
+			break;
+		case BPF_JMP + BPF_JEQ + BPF_K:
+			pc += 1 + ((a == ins->k) ? ins->jt : ins->jf);
+			break;
+		case BPF_JMP + BPF_JGT + BPF_K:
+			pc += 1 + ((a > ins->k) ? ins->jt : ins->jf);
+			break;
+		case BPF_JMP + BPF_JGE + BPF_K:
+			pc += 1 + ((a >= ins->k) ? ins->jt : ins->jf);
+			break;
+		default:	// BPF_RET + BPF_K
+			return ins->k;
+		}
+	}
+}
+
+static int uint32_cmp(const void *a, const void *b) {
+	uint32_t v1 = *(const uint32_t *) a;
+	uint32_t v2 = *(const uint32_t *) b;
+	return (v1 < v2) ? -1 : (v1 > v2);
+}
+
+// return 1 if the filters are equivalent, 0 if they are not, -1 if they cannot be verified
+int verify(struct sock_filter *filter1, int entries1, struct sock_filter *filter2, int entries2) {
+	int i;
+	for (i = 0; i < DATA_WORDS; i++) {
+		words[i].loaded = 0;
+		words[i].cnt = 0;
+	}
+	if (!is_supported(filter1, entries1) || !is_supported(filter2, entries2))
+		return -1;
+
+	collect_values(filter1, entries1);
+	collect_values(filter2, entries2);
+
+	// sorted list of test values for each word, starting with 0
+	long long total = 1;
+	for (i = 0; i < DATA_WORDS; i++) {
+		Word *w = &words[i];
+		if (!w->loaded)
+			continue;
+		value_add(i, 0);
+		qsort(w->val, w->cnt, sizeof(uint32_t), uint32_cmp);
+		int j;
+		int cnt = 0;
+		for (j = 0; j < w->cnt; j++) {
+			if (cnt == 0 || w->val[j] != w->val[cnt - 1])
+				w->val[cnt++] = w->val[j];
+		}
+		w->cnt = cnt;
+		total *= cnt;
+		if (total > VERIFY_MAX)
+			return -1;
+	}
+
+	// run the filters for all the combinations
+	uint32_t data[DATA_WORDS];
+	int index[DATA_WORDS];
+	memset(data, 0, sizeof(data));
+	memset(index, 0, sizeof(index));
+	for (i = 0; i < DATA_WORDS; i++) {
+		if (words[i].loaded)
+			data[i] = words[i].val[0];
+	}
+
+	while (1) {
+		if (run(filter1, data) != run(filter2, data))
+			return 0;
+
+		// next combination
+		for (i = 0; i < DATA_WORDS; i++) {
+			if (!words[i].loaded)
+				continue;
+			if (++index[i] < words[i].cnt) {
+				data[i] = words[i].val[index[i]];
+				break;
+			}
+			index[i] = 0;
+			data[i] = words[i].val[0];
+		}
+		if (i == DATA_WORDS)
+			return 1;
+	}
+}
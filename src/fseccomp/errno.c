@@ -20,6 +20,7 @@
 #include "fseccomp.h"
 
 #include <errno.h>
+#include <ctype.h>
 //#include <attr/xattr.h>
 
 typedef struct {
@@ -170,29 +171,71 @@ static ErrnoEntry errnolist[] = {
 #endif
 };
 
-int errno_find_name(const char *name) {
+// lookup tables, built on first use: a hash table for the names, case insensitive,
+// and the names indexed by number
+static ErrnoEntry **name_hash = NULL;
+static unsigned name_hash_size = 0;	// power of 2, at least twice the number of errors
+static char **nr_table = NULL;
+static int nr_max = -1;
+
+static unsigned name_hash_fn(const char *name) {
+	unsigned h = 2166136261U;	// FNV-1a
+	while (*name) {
+		h ^= (unsigned char) toupper((unsigned char) *name++);
+		h *= 16777619U;
+	}
+	return h & (name_hash_size - 1);
+}
+
+static void errno_init(void) {
+	if (name_hash)
+		return;
+
 	int i;
 	int elems = sizeof(errnolist) / sizeof(errnolist[0]);
+	name_hash_size = 1;
+	while (name_hash_size < 2 * (unsigned) elems)
+		name_hash_size *= 2;
+	name_hash = calloc(name_hash_size, sizeof(ErrnoEntry *));
+	if (!name_hash)
+		errExit("calloc");
+
 	for (i = 0; i < elems; i++) {
-		if (strcasecmp(name, errnolist[i].name) == 0)
-			return errnolist[i].nr;
+		unsigned h = name_hash_fn(errnolist[i].name);
+		while (name_hash[h] && strcasecmp(name_hash[h]->name, errnolist[i].name) != 0)
+			h = (h + 1) & (name_hash_size - 1);
+		if (!name_hash[h])	// the first entry wins
+			name_hash[h] = &errnolist[i];
+		if (errnolist[i].nr > nr_max)
+			nr_max = errnolist[i].nr;
 	}
 
-	return -1;
+	nr_table = calloc(nr_max + 1, sizeof(char *));
+	if (!nr_table)
+		errExit("calloc");
+	for (i = elems - 1; i >= 0; i--)
+		nr_table[errnolist[i].nr] = errnolist[i].name;
 }
 
-char *errno_find_nr(int nr) {
-	int i;
-	int elems = sizeof(errnolist) / sizeof(errnolist[0]);
-	for (i = 0; i < elems; i++) {
-		if (nr == errnolist[i].nr)
-			return errnolist[i].name;
+int errno_find_name(const char *name) {
+	errno_init();
+	unsigned h = name_hash_fn(name);
+	while (name_hash[h]) {
+		if (strcasecmp(name, name_hash[h]->name) == 0)
+			return name_hash[h]->nr;
+		h = (h + 1) & (name_hash_size - 1);
 	}
 
-	return "unknown";
+	return -1;
 }
 
+char *errno_find_nr(int nr) {
+	errno_init();
+	if (nr >= 0 && nr <= nr_max && nr_table[nr])
+		return nr_table[nr];
 
+	return "unknown";
+}
 
 void errno_print(void) {
 	int i;
@@ -23,7 +23,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <linux/filter.h>
 #include "../include/common.h"
+#include "../include/strace.h"
+#include "../include/tree_plan.h"
 
 // main.c
 extern int arg_quiet;
@@ -32,7 +35,26 @@ extern int arg_quiet;
 void syscall_print(void);
 int syscall_check_list(const char *slist, void (*callback)(int fd, int syscall, int arg, void *ptrarg), int fd, int arg, void *ptrarg);
 const char *syscall_find_nr(int nr);
-void syscalls_in_list(const char *list, const char *slist, int fd, char **prelist, char **postlist);
+int syscall_find_name(const char *name);
+int syscall_nr_max(void);
+int syscall_use_secondary(void);
+
+// syscall_set.c
+typedef struct {
+	int size;		// number of syscalls covered by the bitmap
+	unsigned char *bits;
+	int *errnum;		// errno returned by the syscall, 0 to kill the process
+} SyscallSet;
+SyscallSet *set_new(void);
+void set_free(SyscallSet *set);
+int set_test(const SyscallSet *set, int nr);
+void set_add(SyscallSet *set, int nr, int errnum);
+void set_union(SyscallSet *dst, const SyscallSet *src);
+void set_difference(SyscallSet *dst, const SyscallSet *src);
+void set_intersection(SyscallSet *dst, const SyscallSet *src);
+int set_empty(const SyscallSet *set);
+void set_add_list(SyscallSet *set, const char *list);
+void set_print(const SyscallSet *set);
 
 // errno.c
 void errno_print(void);
@@ -50,12 +72,12 @@ void seccomp_secondary_block(const char *fname);
 
 // seccomp_file.c
 void write_to_file(int fd, const void *data, int size);
+void filter_load_freq(const char *fname);
 void filter_init(int fd);
-void filter_add_whitelist(int fd, int syscall, int arg, void *ptrarg);
-void filter_add_blacklist(int fd, int syscall, int arg, void *ptrarg);
-void filter_add_errno(int fd, int syscall, int arg, void *ptrarg);
-void filter_end_blacklist(int fd);
-void filter_end_whitelist(int fd);
+void filter_init_32(int fd);
+void filter_add_code(const struct sock_filter *code, int cnt);
+void filter_end_blacklist(int fd, const SyscallSet *set);
+void filter_end_whitelist(int fd, const SyscallSet *set);
 
 // seccomp.c
 // default list
@@ -68,6 +90,8 @@ void seccomp_default_drop(const char *fname1, const char *fname2, char *list, in
 void seccomp_keep(const char *fname1, const char *fname2, char *list);
 // block writable and executable memory
 void memory_deny_write_execute(const char *fname);
+// filter for the helper programs started by firejail
+void seccomp_sbox(const char *fname);
 
 // seccomp_print
 void filter_print(const char *fname);
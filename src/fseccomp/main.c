@@ -22,6 +22,8 @@ int arg_quiet = 0;
 
 static void usage(void) {
 	printf("Usage:\n");
+	printf("\tfseccomp [--freq=file] command - build the filter ordered by the syscall\n");
+	printf("\t\tfrequencies in an strace output file or strace -c summary\n");
 	printf("\tfseccomp debug-syscalls\n");
 	printf("\tfseccomp debug-errnos\n");
 	printf("\tfseccomp debug-protocols\n");
@@ -37,6 +39,7 @@ static void usage(void) {
 	printf("\tfseccomp default drop file1 file2 list allow-debuggers\n");
 	printf("\tfseccomp keep file1 file2 list\n");
 	printf("\tfseccomp memory-deny-write-execute file\n");
+	printf("\tfseccomp sbox file\n");
 }
 
 int main(int argc, char **argv) {
@@ -58,6 +61,16 @@ printf("\n");
 	if (quiet && strcmp(quiet, "yes") == 0)
 		arg_quiet = 1;
 
+	if (strncmp(argv[1], "--freq=", 7) == 0) {
+		filter_load_freq(argv[1] + 7);
+		argc--;
+		argv++;
+		if (argc < 2) {
+			usage();
+			return 1;
+		}
+	}
+
 	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") ==0) {
 		usage();
 		return 0;
@@ -74,6 +87,8 @@ printf("\n");
 		seccomp_secondary_32(argv[3]);
 	else if (argc == 4 && strcmp(argv[1], "secondary") == 0 && strcmp(argv[2], "block") == 0)
 		seccomp_secondary_block(argv[3]);
+	else if (argc == 3 && strcmp(argv[1], "sbox") == 0)
+		seccomp_sbox(argv[2]);
 	else if (argc == 3 && strcmp(argv[1], "default") == 0)
 		seccomp_default(argv[2], 0);
 	else if (argc == 4 && strcmp(argv[1], "default") == 0 && strcmp(argv[3], "allow-debuggers") == 0)
@@ -24,45 +24,95 @@
 #include <sys/syscall.h>
 #include <sys/types.h>
 
-static void add_default_list(int fd, int allow_debuggers) {
-	int r;
+static void add_default_list(SyscallSet *set, int allow_debuggers) {
 	if (!allow_debuggers)
-		r = syscall_check_list("@default-nodebuggers", filter_add_blacklist, fd, 0, NULL);
+		set_add_list(set, "@default-nodebuggers");
 	else
-		r = syscall_check_list("@default", filter_add_blacklist, fd, 0, NULL);
+		set_add_list(set, "@default");
 
-	assert(r == 0);
 //#ifdef SYS_mknod - emoved in 0.9.29 - it breaks Zotero extension
-//		filter_add_blacklist(SYS_mknod, 0);
+//		set_add(set, SYS_mknod, 0);
 //#endif
 // breaking Firefox nightly when playing youtube videos
 // TODO: test again when firefox sandbox is finally released
 //#ifdef SYS_get_mempolicy
-//	filter_add_blacklist(fd, SYS_get_mempolicy, 0);
+//	set_add(set, SYS_get_mempolicy, 0);
 //#endif
 //#ifdef SYS_quotactl - in use by Firefox
-//	filter_add_blacklist(fd, SYS_quotactl, 0);
+//	set_add(set, SYS_quotactl, 0);
 //#endif
 }
 
-// default list
-void seccomp_default(const char *fname, int allow_debuggers) {
-	assert(fname);
+// split the list in syscalls blacklisted before and after exec: the syscalls in
+// @default-keep are used by firejail after the seccomp filter is initialized
+static void split_list(const char *list, SyscallSet **prelist, SyscallSet **postlist) {
+	SyscallSet *keep = set_new();
+	set_add_list(keep, "@default-keep");
+
+	SyscallSet *pre = set_new();
+	set_add_list(pre, list);
+	SyscallSet *post = set_new();
+	set_union(post, pre);
+
+	set_difference(pre, keep);
+	set_intersection(post, keep);
+	set_free(keep);
+
+	if (!arg_quiet) {
+		printf("Seccomp list in: %s, check list: @default-keep,", list);
+		if (!set_empty(pre)) {
+			printf(" prelist: ");
+			set_print(pre);
+			printf(",");
+		}
+		if (!set_empty(post)) {
+			printf(" postlist: ");
+			set_print(post);
+		}
+		printf("\n");
+	}
 
-	// open file
+	*prelist = pre;
+	*postlist = post;
+}
+
+static int open_filter_file(const char *fname) {
 	int fd = open(fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 	if (fd < 0) {
 		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname);
 		exit(1);
 	}
+	return fd;
+}
 
-	// build filter (no post-exec filter needed because default list is fine for us)
+// build post-exec filter: blacklist the syscalls in @default-keep
+static void write_postlist(const char *fname, SyscallSet *postlist) {
+	if (set_empty(postlist))
+		return;
+
+	int i;
+	for (i = 0; i < postlist->size; i++)
+		postlist->errnum[i] = 0;	// always killed
+
+	int fd = open_filter_file(fname);
 	filter_init(fd);
-	add_default_list(fd, allow_debuggers);
-	filter_end_blacklist(fd);
+	filter_end_blacklist(fd, postlist);
+	close(fd);
+}
 
-	// close file
+// default list
+void seccomp_default(const char *fname, int allow_debuggers) {
+	assert(fname);
+
+	// build filter (no post-exec filter needed because default list is fine for us)
+	SyscallSet *set = set_new();
+	add_default_list(set, allow_debuggers);
+
+	int fd = open_filter_file(fname);
+	filter_init(fd);
+	filter_end_blacklist(fd, set);
 	close(fd);
+	set_free(set);
 }
 
 // drop list
@@ -71,46 +121,18 @@ void seccomp_drop(const char *fname1, const char *fname2, char *list, int allow_
 	assert(fname2);
 	(void) allow_debuggers; // todo: to implemnet it
 
-	// open file for pre-exec filter
-	int fd = open(fname1, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname1);
-		exit(1);
-	}
-
 	// build pre-exec filter: don't blacklist any syscalls in @default-keep
-	filter_init(fd);
-	char *prelist, *postlist;
-	syscalls_in_list(list, "@default-keep", fd, &prelist, &postlist);
-	if (prelist)
-		if (syscall_check_list(prelist, filter_add_blacklist, fd, 0, NULL)) {
-			fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-			exit(1);
-		}
-	filter_end_blacklist(fd);
-	// close file
-	close(fd);
+	SyscallSet *prelist, *postlist;
+	split_list(list, &prelist, &postlist);
 
-	if (!postlist)
-		return;
-
-	// open file for post-exec filter
-	fd = open(fname2, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname2);
-		exit(1);
-	}
-
-	// build post-exec filter: blacklist remaining syscalls
+	int fd = open_filter_file(fname1);
 	filter_init(fd);
-	if (syscall_check_list(postlist, filter_add_blacklist, fd, 0, NULL)) {
-		fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-		exit(1);
-	}
-	filter_end_blacklist(fd);
-
-	// close file
+	filter_end_blacklist(fd, prelist);
 	close(fd);
+
+	write_postlist(fname2, postlist);
+	set_free(prelist);
+	set_free(postlist);
 }
 
 // default+drop
@@ -118,77 +140,70 @@ void seccomp_default_drop(const char *fname1, const char *fname2, char *list, in
 	assert(fname1);
 	assert(fname2);
 
-	// open file
-	int fd = open(fname1, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname1);
-		exit(1);
-	}
-
 	// build pre-exec filter: blacklist @default, don't blacklist
 	// any listed syscalls in @default-keep
-	filter_init(fd);
-	add_default_list(fd, allow_debuggers);
-	char *prelist, *postlist;
-	syscalls_in_list(list, "@default-keep", fd, &prelist, &postlist);
-	if (prelist)
-		if (syscall_check_list(prelist, filter_add_blacklist, fd, 0, NULL)) {
-			fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-			exit(1);
-		}
-	filter_end_blacklist(fd);
-
-	// close file
-	close(fd);
-
-	if (!postlist)
-		return;
+	SyscallSet *prelist, *postlist;
+	split_list(list, &prelist, &postlist);
+	SyscallSet *set = set_new();
+	add_default_list(set, allow_debuggers);
+	set_union(set, prelist);
 
-	// open file for post-exec filter
-	fd = open(fname2, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname2);
-		exit(1);
-	}
-
-	// build post-exec filter: blacklist remaining syscalls
+	int fd = open_filter_file(fname1);
 	filter_init(fd);
-	if (syscall_check_list(postlist, filter_add_blacklist, fd, 0, NULL)) {
-		fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-		exit(1);
-	}
-	filter_end_blacklist(fd);
-
-	// close file
+	filter_end_blacklist(fd, set);
 	close(fd);
+
+	write_postlist(fname2, postlist);
+	set_free(set);
+	set_free(prelist);
+	set_free(postlist);
 }
 
 void seccomp_keep(const char *fname1, const char *fname2, char *list) {
 	(void) fname2;
 
-	// open file for pre-exec filter
-	int fd = open(fname1, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname1);
-		exit(1);
-	}
-
 	// build pre-exec filter: whitelist also @default-keep
-	filter_init(fd);
 	// these syscalls are used by firejail after the seccomp filter is initialized
-	int r;
-	r = syscall_check_list("@default-keep", filter_add_whitelist, fd, 0, NULL);
-	assert(r == 0);
+	SyscallSet *set = set_new();
+	set_add_list(set, "@default-keep");
+	set_add_list(set, list);
 
-	if (syscall_check_list(list, filter_add_whitelist, fd, 0, NULL)) {
-		fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-		exit(1);
-	}
+	int fd = open_filter_file(fname1);
+	filter_init(fd);
+	filter_end_whitelist(fd, set);
+	close(fd);
+	set_free(set);
+}
+
+// filter installed by firejail for its helper programs (fnet, fcopy, firemon, iptables etc.)
+void seccomp_sbox(const char *fname) {
+	static const char * const extra[] = {
+		"create_module",
+		"ioprio_set",
+		"mount",
+		"name_to_handle_at",
+		"ni_syscall",
+		"open_by_handle_at",
+		"ptrace",
+		"syslog",
+		"umount2",
+		NULL
+	};
 
-	filter_end_whitelist(fd);
+	SyscallSet *set = set_new();
+	set_add_list(set, "@module,@raw-io,@reboot,@swap");
+	int i;
+	for (i = 0; extra[i]; i++) {
+		int nr = syscall_find_name(extra[i]);
+		if (nr != -1)	// not all of them are available on every platform
+			set_add(set, nr, 0);
+	}
 
-	// close file
+	int fd = open_filter_file(fname);
+	filter_init(fd);
+	filter_end_blacklist(fd, set);
 	close(fd);
+	set_free(set);
 }
 
 #if defined(__x86_64__) || defined(__aarch64__) || defined(__powerpc64__)
@@ -207,13 +222,7 @@ void seccomp_keep(const char *fname1, const char *fname2, char *list) {
 #endif
 
 void memory_deny_write_execute(const char *fname) {
-	// open file
-	int fd = open(fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname);
-		exit(1);
-	}
-
+	int fd = open_filter_file(fname);
 	filter_init(fd);
 
 	// build filter
@@ -261,9 +270,9 @@ void memory_deny_write_execute(const char *fname) {
 		RETURN_ALLOW
 #endif
 	};
-	write_to_file(fd, filter, sizeof(filter));
+	filter_add_code(filter, sizeof(filter) / sizeof(filter[0]));
 
-	filter_end_blacklist(fd);
+	filter_end_blacklist(fd, NULL);
 
 	// close file
 	close(fd);
@@ -36,8 +36,209 @@ void write_to_file(int fd, const void *data, int size) {
 	}
 }
 
+// The filter is kept in memory from filter_init() to filter_end_*(), and it is written
+// to the file with a single write. The syscall set passed to filter_end_*() is compiled
+// into a balanced binary tree of BPF_JGE range checks. Syscall numbers with the same
+// action are merged into ranges, and the tree leaves jump to a block of shared return
+// instructions at the end of the filter.
+static struct sock_filter *filter = NULL;
+static int filter_cnt = 0;
+static int filter_size = 0;
+
+// ranges of syscall numbers with the same action, the outcome of a segment is the action
+static Segment *segs = NULL;
+static int segs_cnt = 0;
+static TreePlan plan;
+
+// the code is generated backwards, starting with the return instructions;
+// index i has i instructions after it in the final filter
+static struct sock_filter *code = NULL;
+static int code_cnt = 0;
+
+// nearest return instruction for each action
+typedef struct {
+	uint32_t action;
+	int index;
+} Ret;
+static Ret *rets = NULL;
+static int rets_cnt = 0;
+
+#define MAX_JUMP 255	// jt and jf are 8 bit offsets
+
+// Syscall frequency profile. With a profile, the tree is split by the number of calls
+// instead of the number of segments, and the frequent syscalls are resolved closer to the root.
+static FreqProfile freq;
+
+static void freq_add(const char *name, unsigned long long calls, void *arg) {
+	(void) arg;
+	int nr = syscall_find_name(name);
+	if (nr < 0)
+		return;
+	freq_profile_add(&freq, nr, calls);
+}
+
+// load a frequency profile from an strace output file or an strace -c summary
+void filter_load_freq(const char *fname) {
+	if (strace_read(fname, freq_add, NULL) == -1) {
+		fprintf(stderr, "Error fseccomp: cannot open %s\n", fname);
+		exit(1);
+	}
+}
+
+static void segment_add(uint32_t start, uint32_t action) {
+	if (segs_cnt && segs[segs_cnt - 1].outcome == action)
+		return;	// extend the previous range
+	segs[segs_cnt].start = start;
+	segs[segs_cnt].outcome = action;
+	segs_cnt++;
+}
+
+static void build_segments(const SyscallSet *set, uint32_t action, uint32_t default_action) {
+	int size = (set) ? set->size : 0;
+	segs = realloc(segs, (2 * size + 2) * sizeof(Segment));
+	if (!segs)
+		errExit("realloc");
+	segs_cnt = 0;
+
+	uint32_t next = 0;	// first syscall number not covered yet
+	int i;
+	for (i = 0; i < size; i++) {
+		if (!set_test(set, i))
+			continue;
+		if ((uint32_t) i != next || segs_cnt == 0)
+			segment_add(next, default_action);
+		segment_add(i, (set->errnum[i]) ? SECCOMP_RET_ERRNO | set->errnum[i] : action);
+		next = i + 1;
+	}
+	if (segs_cnt == 0 || next != 0)
+		segment_add(next, default_action);
+
+	tree_count_calls(segs, segs_cnt, &freq);
+}
+
+static int emit(struct sock_filter ins) {
+	code[code_cnt] = ins;
+	return code_cnt++;
+}
+
+static int ret_find(uint32_t action) {
+	int i;
+	for (i = 0; i < rets_cnt; i++) {
+		if (rets[i].action == action)
+			return rets[i].index;
+	}
+	assert(0);
+	return -1;
+}
+
+static void ret_add(uint32_t action) {
+	int i;
+	for (i = 0; i < rets_cnt; i++) {
+		if (rets[i].action == action) {
+			rets[i].index = code_cnt;	// the new copy is closer to the code generated next
+			break;
+		}
+	}
+	if (i == rets_cnt) {
+		rets[rets_cnt].action = action;
+		rets[rets_cnt].index = code_cnt;
+		rets_cnt++;
+	}
+	struct sock_filter ins = BPF_STMT(BPF_RET+BPF_K, action);
+	emit(ins);
+}
+
+// instruction forwarding to a target too far away for jt/jf
+static int emit_far(int target) {
+	if (code[target].code == BPF_RET+BPF_K) {
+		// a copy of the return instruction
+		ret_add(code[target].k);
+		return code_cnt - 1;
+	}
+	struct sock_filter ins = BPF_JUMP(BPF_JMP+BPF_JA+BPF_K, code_cnt - target - 1, 0, 0);
+	return emit(ins);
+}
+
+static inline int is_far(int from, int target) {
+	return from - target - 1 > MAX_JUMP;
+}
+
+// generate the code for segments lo to hi, return the index of the first instruction
+static int emit_tree(int lo, int hi) {
+	if (lo == hi)
+		return ret_find(segs[lo].outcome);
+
+	int mid = tree_split(&plan, lo, hi);
+	int right = emit_tree(mid, hi);		// syscall >= segs[mid].start
+	int left = emit_tree(lo, mid - 1);
+
+	if (is_far(code_cnt, right) || is_far(code_cnt, left)) {
+		right = emit_far(right);
+		if (is_far(code_cnt, left))
+			left = emit_far(left);
+	}
+	struct sock_filter ins = BPF_JUMP(BPF_JMP+BPF_JGE+BPF_K, segs[mid].start,
+		code_cnt - right - 1, code_cnt - left - 1);
+	return emit(ins);
+}
+
+// append BPF code to the filter
+void filter_add_code(const struct sock_filter *code, int cnt) {
+	if (filter_cnt + cnt > filter_size) {
+		while (filter_cnt + cnt > filter_size)
+			filter_size = (filter_size) ? filter_size * 2 : 256;
+		filter = realloc(filter, filter_size * sizeof(struct sock_filter));
+		if (!filter)
+			errExit("realloc");
+	}
+	memcpy(filter + filter_cnt, code, cnt * sizeof(struct sock_filter));
+	filter_cnt += cnt;
+}
+
+// action: the action for the syscalls in the set, unless an errno is specified
+static void filter_end(int fd, const SyscallSet *set, uint32_t action, uint32_t default_action) {
+	build_segments(set, action, default_action);
+	tree_plan(&plan, segs, segs_cnt);
+
+	// a tree of n leaves has n - 1 jumps, each one with at most two extra instructions
+	code = realloc(code, (3 * segs_cnt + 1) * sizeof(struct sock_filter));
+	rets = realloc(rets, segs_cnt * sizeof(Ret));
+	if (!code || !rets)
+		errExit("realloc");
+	code_cnt = 0;
+	rets_cnt = 0;
+
+	// shared return instructions, the default action at the end
+	ret_add(default_action);
+	int i;
+	for (i = 0; i < segs_cnt; i++) {
+		int j;
+		for (j = 0; j < rets_cnt; j++) {
+			if (rets[j].action == segs[i].outcome)
+				break;
+		}
+		if (j == rets_cnt)
+			ret_add(segs[i].outcome);
+	}
+
+	int root = emit_tree(0, segs_cnt - 1);
+	if (root != code_cnt - 1)
+		emit_far(root);
+
+	// the code was generated backwards
+	for (i = 0; i < code_cnt / 2; i++) {
+		struct sock_filter tmp = code[i];
+		code[i] = code[code_cnt - 1 - i];
+		code[code_cnt - 1 - i] = tmp;
+	}
+	filter_add_code(code, code_cnt);
+	write_to_file(fd, filter, filter_cnt * sizeof(struct sock_filter));
+	filter_cnt = 0;
+}
+
 void filter_init(int fd) {
-	struct sock_filter filter[] = {
+	(void) fd;
+	struct sock_filter prologue[] = {
 		VALIDATE_ARCHITECTURE,
 #if defined(__x86_64__)
 		EXAMINE_SYSCALL,
@@ -50,54 +251,38 @@ void filter_init(int fd) {
 #if 0
 {
 	int i;
-	unsigned char *ptr = (unsigned char *) &filter[0];
-	for (i = 0; i < sizeof(filter); i++, ptr++)
+	unsigned char *ptr = (unsigned char *) &prologue[0];
+	for (i = 0; i < sizeof(prologue); i++, ptr++)
 		printf("%x, ", (*ptr) & 0xff);
 	printf("\n");
 }
 #endif
 
-	write_to_file(fd, filter, sizeof(filter));
+	filter_cnt = 0;
+	filter_add_code(prologue, sizeof(prologue) / sizeof(prologue[0]));
 }
 
-void filter_add_whitelist(int fd, int syscall, int arg, void *ptrarg) {
-	(void) arg;
-	(void) ptrarg;
-
-	struct sock_filter filter[] = {
-		WHITELIST(syscall)
+// prologue for the 32 bit arch filter installed on 64 bit architectures
+void filter_init_32(int fd) {
+	(void) fd;
+	struct sock_filter prologue[] = {
+		VALIDATE_ARCHITECTURE_32,
+		EXAMINE_SYSCALL
 	};
-	write_to_file(fd, filter, sizeof(filter));
-}
-
-void filter_add_blacklist(int fd, int syscall, int arg, void *ptrarg) {
-	(void) arg;
-	(void) ptrarg;
 
-	struct sock_filter filter[] = {
-		BLACKLIST(syscall)
-	};
-	write_to_file(fd, filter, sizeof(filter));
-}
+	// the frequency profile holds native syscall numbers, it doesn't apply here
+	freq_profile_free(&freq);
 
-void filter_add_errno(int fd, int syscall, int arg, void *ptrarg) {
-	(void) ptrarg;
-	struct sock_filter filter[] = {
-		BLACKLIST_ERRNO(syscall, arg)
-	};
-	write_to_file(fd, filter, sizeof(filter));
+	filter_cnt = 0;
+	filter_add_code(prologue, sizeof(prologue) / sizeof(prologue[0]));
 }
 
-void filter_end_blacklist(int fd) {
-	struct sock_filter filter[] = {
-		RETURN_ALLOW
-	};
-	write_to_file(fd, filter, sizeof(filter));
+// the syscalls in the set are killed, or they return the errno specified in the set
+void filter_end_blacklist(int fd, const SyscallSet *set) {
+	filter_end(fd, set, SECCOMP_RET_KILL, SECCOMP_RET_ALLOW);
 }
 
-void filter_end_whitelist(int fd) {
-	struct sock_filter filter[] = {
-		KILL_PROCESS
-	};
-	write_to_file(fd, filter, sizeof(filter));
+// the syscalls in the set are allowed, or they return the errno specified in the set
+void filter_end_whitelist(int fd, const SyscallSet *set) {
+	filter_end(fd, set, SECCOMP_RET_ALLOW, SECCOMP_RET_KILL);
 }
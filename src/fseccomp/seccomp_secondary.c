@@ -45,7 +45,24 @@ static void write_filter(const char *fname, size_t size, const void *filter) {
 
 // 32 bit arch filter installed on 64 bit architectures
 void seccomp_secondary_32(const char *fname) {
-	// hardcoded syscall values
+	// build the default filter from the 32 bit syscall table extracted during make
+	if (syscall_use_secondary() == 0) {
+		SyscallSet *set = set_new();
+		set_add_list(set, "@default-nodebuggers");
+
+		int fd = open(fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if (fd < 0) {
+			fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname);
+			exit(1);
+		}
+		filter_init_32(fd);
+		filter_end_blacklist(fd, set);
+		close(fd);
+		set_free(set);
+		return;
+	}
+
+	// no syscall table available, use the hardcoded syscall values
 	struct sock_filter filter[] = {
 		VALIDATE_ARCHITECTURE_32,
 		EXAMINE_SYSCALL,
@@ -32,13 +32,6 @@ typedef struct {
 	const char * const list;
 } SyscallGroupList;
 
-typedef struct {
-	const char *slist;
-	char *prelist, *postlist;
-	bool found;
-	int syscall;
-} SyscallCheckList;
-
 static const SyscallEntry syslist[] = {
 //
 // code generated using tools/extract-syscall
@@ -49,63 +42,36 @@ static const SyscallEntry syslist[] = {
 //
 }; // end of syslist
 
+// secondary architecture syscalls, generated during make from the kernel headers
+static const SyscallEntry syslist_secondary[] = {
+#if defined(__x86_64__)
+#include "syscall_secondary.h"
+#endif
+	{ NULL, -1 }
+};
+
 static const SyscallGroupList sysgroups[] = {
 	{ .name = "@clock", .list =
-#ifdef SYS_adjtimex
 	  "adjtimex,"
-#endif
-#ifdef SYS_clock_adjtime
 	  "clock_adjtime,"
-#endif
-#ifdef SYS_clock_settime
 	  "clock_settime,"
-#endif
-#ifdef SYS_settimeofday
 	  "settimeofday,"
-#endif
-#ifdef SYS_stime
 	  "stime"
-#endif
 	},
 	{ .name = "@cpu-emulation", .list =
-#ifdef SYS_modify_ldt
 	  "modify_ldt,"
-#endif
-#ifdef SYS_subpage_prot
 	  "subpage_prot,"
-#endif
-#ifdef SYS_switch_endian
 	  "switch_endian,"
-#endif
-#ifdef SYS_vm86
 	  "vm86,"
-#endif
-#ifdef SYS_vm86old
 	  "vm86old"
-#endif
-#if !defined(SYS_modify_ldt) && !defined(SYS_subpage_prot) && !defined(SYS_switch_endian) && !defined(SYS_vm86) && !defined(SYS_vm86old)
-	  "__dummy_syscall__" // workaround for arm64, s390x and sparc64 which don't have any of above defined and empty syscall lists are not allowed
-#endif
 	},
 	{ .name = "@debug", .list =
-#ifdef SYS_lookup_dcookie
 	  "lookup_dcookie,"
-#endif
-#ifdef SYS_perf_event_open
 	  "perf_event_open,"
-#endif
-#ifdef SYS_process_vm_writev
 	  "process_vm_writev,"
-#endif
-#ifdef SYS_rtas
 	  "rtas,"
-#endif
-#ifdef SYS_s390_runtime_instr
 	  "s390_runtime_instr,"
-#endif
-#ifdef SYS_sys_debug_setcontext
 	  "sys_debug_setcontext,"
-#endif
 	},
 	{ .name = "@default", .list =
 	  "@cpu-emulation,"
@@ -113,170 +79,67 @@ static const SyscallGroupList sysgroups[] = {
 	  "@obsolete,"
 	  "@privileged,"
 	  "@resources,"
-#ifdef SYS_open_by_handle_at
 	  "open_by_handle_at,"
-#endif
-#ifdef SYS_name_to_handle_at
 	  "name_to_handle_at,"
-#endif
-#ifdef SYS_ioprio_set
 	  "ioprio_set,"
-#endif
-#ifdef SYS_ni_syscall
 	  "ni_syscall,"
-#endif
-#ifdef SYS_syslog
 	  "syslog,"
-#endif
-#ifdef SYS_fanotify_init
 	  "fanotify_init,"
-#endif
-#ifdef SYS_kcmp
 	  "kcmp,"
-#endif
-#ifdef SYS_add_key
 	  "add_key,"
-#endif
-#ifdef SYS_request_key
 	  "request_key,"
-#endif
-#ifdef SYS_keyctl
 	  "keyctl,"
-#endif
-#ifdef SYS_io_setup
 	  "io_setup,"
-#endif
-#ifdef SYS_io_destroy
 	  "io_destroy,"
-#endif
-#ifdef SYS_io_getevents
 	  "io_getevents,"
-#endif
-#ifdef SYS_io_submit
 	  "io_submit,"
-#endif
-#ifdef SYS_io_cancel
 	  "io_cancel,"
-#endif
-#ifdef SYS_remap_file_pages
 	  "remap_file_pages,"
-#endif
-#ifdef SYS_vmsplice
 	  "vmsplice,"
-#endif
-#ifdef SYS_umount
 	  "umount,"
-#endif
-#ifdef SYS_userfaultfd
 	  "userfaultfd"
-#endif
 	},
 	{ .name = "@default-nodebuggers", .list =
 	  "@default,"
-#ifdef SYS_ptrace
 	  "ptrace,"
-#endif
-#ifdef SYS_personality
 	  "personality,"
-#endif
-#ifdef SYS_process_vm_readv
 	  "process_vm_readv"
-#endif
 	},
 	{ .name = "@default-keep", .list =
 	  "execve,"
 	  "prctl"
 	},
 	{ .name = "@module", .list =
-#ifdef SYS_delete_module
 	  "delete_module,"
-#endif
-#ifdef SYS_finit_module
 	  "finit_module,"
-#endif
-#ifdef SYS_init_module
 	  "init_module"
-#endif
 	},
 	{ .name = "@obsolete", .list =
-#ifdef SYS__sysctl
 	  "_sysctl,"
-#endif
-#ifdef SYS_afs_syscall
 	  "afs_syscall,"
-#endif
-#ifdef SYS_bdflush
 	  "bdflush,"
-#endif
-#ifdef SYS_break
 	  "break,"
-#endif
-#ifdef SYS_create_module
 	  "create_module,"
-#endif
-#ifdef SYS_ftime
 	  "ftime,"
-#endif
-#ifdef SYS_get_kernel_syms
 	  "get_kernel_syms,"
-#endif
-#ifdef SYS_getpmsg
 	  "getpmsg,"
-#endif
-#ifdef SYS_gtty
 	  "gtty,"
-#endif
-#ifdef SYS_lock
 	  "lock,"
-#endif
-#ifdef SYS_mpx
 	  "mpx,"
-#endif
-#ifdef SYS_prof
 	  "prof,"
-#endif
-#ifdef SYS_profil
 	  "profil,"
-#endif
-#ifdef SYS_putpmsg
 	  "putpmsg,"
-#endif
-#ifdef SYS_query_module
 	  "query_module,"
-#endif
-#ifdef SYS_security
 	  "security,"
-#endif
-#ifdef SYS_sgetmask
 	  "sgetmask,"
-#endif
-#ifdef SYS_ssetmask
 	  "ssetmask,"
-#endif
-#ifdef SYS_stty
 	  "stty,"
-#endif
-#ifdef SYS_sysfs
 	  "sysfs,"
-#endif
-#ifdef SYS_tuxcall
 	  "tuxcall,"
-#endif
-#ifdef SYS_ulimit
 	  "ulimit,"
-#endif
-#ifdef SYS_uselib
 	  "uselib,"
-#endif
-#ifdef SYS_ustat
 	  "ustat,"
-#endif
-#ifdef SYS_vserver
 	  "vserver"
-#endif
-#if !defined(SYS__sysctl) && !defined(SYS_afs_syscall) && !defined(SYS_bdflush) && !defined(SYS_break) && !defined(SYS_create_module) && !defined(SYS_ftime) && !defined(SYS_get_kernel_syms) && !defined(SYS_getpmsg) && !defined(SYS_gtty) && !defined(SYS_lock) && !defined(SYS_mpx) && !defined(SYS_prof) && !defined(SYS_profil) && !defined(SYS_putpmsg) && !defined(SYS_query_module) && !defined(SYS_security) && !defined(SYS_sgetmask) && !defined(SYS_ssetmask) && !defined(SYS_stty) && !defined(SYS_sysfs) && !defined(SYS_tuxcall) && !defined(SYS_ulimit) && !defined(SYS_uselib) && !defined(SYS_ustat) && !defined(SYS_vserver)
-	  "__dummy_syscall__" // workaround for arm64 which doesn't have any of above defined and empty syscall lists are not allowed
-#endif
 	},
 	{ .name = "@privileged", .list =
 	  "@clock,"
@@ -284,136 +147,170 @@ static const SyscallGroupList sysgroups[] = {
 	  "@raw-io,"
 	  "@reboot,"
 	  "@swap,"
-#ifdef SYS_acct
 	  "acct,"
-#endif
-#ifdef SYS_bpf
 	  "bpf,"
-#endif
-#ifdef SYS_chroot
 	  "chroot,"
-#endif
-#ifdef SYS_mount
 	  "mount,"
-#endif
-#ifdef SYS_nfsservctl
 	  "nfsservctl,"
-#endif
-#ifdef SYS_pivot_root
 	  "pivot_root,"
-#endif
-#ifdef SYS_setdomainname
 	  "setdomainname,"
-#endif
-#ifdef SYS_sethostname
 	  "sethostname,"
-#endif
-#ifdef SYS_umount2
 	  "umount2,"
-#endif
-#ifdef SYS_vhangup
 	  "vhangup"
-#endif
 	},
 	{ .name = "@raw-io", .list =
-#ifdef SYS_ioperm
 	  "ioperm,"
-#endif
-#ifdef SYS_iopl
 	  "iopl,"
-#endif
-#ifdef SYS_pciconfig_iobase
 	  "pciconfig_iobase,"
-#endif
-#ifdef SYS_pciconfig_read
 	  "pciconfig_read,"
-#endif
-#ifdef SYS_pciconfig_write
 	  "pciconfig_write,"
-#endif
-#ifdef SYS_s390_mmio_read
 	  "s390_mmio_read,"
-#endif
-#ifdef SYS_s390_mmio_write
 	  "s390_mmio_write"
-#endif
-#if !defined(SYS_ioperm) && !defined(SYS_iopl) && !defined(SYS_pciconfig_iobase) && !defined(SYS_pciconfig_read) && !defined(SYS_pciconfig_write) && !defined(SYS_s390_mmio_read) && !defined(SYS_s390_mmio_write)
-	  "__dummy_syscall__" // workaround for s390x which doesn't have any of above defined and empty syscall lists are not allowed
-#endif
 	},
 	{ .name = "@reboot", .list =
-#ifdef SYS_kexec_load
 	  "kexec_load,"
-#endif
-#ifdef SYS_kexec_file_load
 	  "kexec_file_load,"
-#endif
-#ifdef SYS_reboot
 	  "reboot,"
-#endif
 	},
 	{ .name = "@resources", .list =
-#ifdef SYS_set_mempolicy
 	  "set_mempolicy,"
-#endif
-#ifdef SYS_migrate_pages
 	  "migrate_pages,"
-#endif
-#ifdef SYS_move_pages
 	  "move_pages,"
-#endif
-#ifdef SYS_mbind
 	  "mbind"
-#endif
 	},
 	{ .name = "@swap", .list =
-#ifdef SYS_swapon
 	  "swapon,"
-#endif
-#ifdef SYS_swapoff
 	  "swapoff"
-#endif
 	}
 };
 
-// return -1 if error, or syscall number
-static int syscall_find_name(const char *name) {
+// Lookup tables, built on first use: an open addressing hash table for syscall names,
+// the syscall names indexed by number, and the groups expanded as sets of syscall numbers.
+// There is one set of tables for the native architecture and one for the secondary
+// architecture; the groups are defined by name and resolved against the current table.
+typedef struct {
+	const SyscallEntry *list;
+	int elems;
+	const SyscallEntry **name_hash;
+	unsigned name_hash_size;	// power of 2, at least twice the number of syscalls
+	const char **nr_table;
+	int nr_max;
+	SyscallSet *group_set[sizeof(sysgroups) / sizeof(sysgroups[0])];
+} SyscallTable;
+
+static SyscallTable table_native = {
+	.list = syslist,
+	.elems = sizeof(syslist) / sizeof(syslist[0]),
+	.nr_max = -1
+};
+static SyscallTable table_secondary = {
+	.list = syslist_secondary,
+	.elems = sizeof(syslist_secondary) / sizeof(syslist_secondary[0]) - 1,	// skip the terminator
+	.nr_max = -1
+};
+static SyscallTable *table = &table_native;
+static int group_depth = 0;	// nesting level of the group being expanded
+
+static unsigned name_hash_fn(const char *name) {
+	unsigned h = 2166136261U;	// FNV-1a
+	while (*name) {
+		h ^= (unsigned char) *name++;
+		h *= 16777619U;
+	}
+	return h & (table->name_hash_size - 1);
+}
+
+static void syscall_init(void) {
+	if (table->name_hash)
+		return;
+
 	int i;
-	int elems = sizeof(syslist) / sizeof(syslist[0]);
+	const SyscallEntry *list = table->list;
+	int elems = table->elems;
+	table->name_hash_size = 1;
+	while (table->name_hash_size < 2 * (unsigned) elems)
+		table->name_hash_size *= 2;
+	table->name_hash = calloc(table->name_hash_size, sizeof(SyscallEntry *));
+	if (!table->name_hash)
+		errExit("calloc");
+
 	for (i = 0; i < elems; i++) {
-		if (strcmp(name, syslist[i].name) == 0)
-			return syslist[i].nr;
+		unsigned h = name_hash_fn(list[i].name);
+		while (table->name_hash[h] && strcmp(table->name_hash[h]->name, list[i].name) != 0)
+			h = (h + 1) & (table->name_hash_size - 1);
+		if (!table->name_hash[h])	// the first entry wins
+			table->name_hash[h] = &list[i];
+		if (list[i].nr > table->nr_max)
+			table->nr_max = list[i].nr;
+	}
+
+	table->nr_table = calloc(table->nr_max + 1, sizeof(char *));
+	if (!table->nr_table)
+		errExit("calloc");
+	for (i = elems - 1; i >= 0; i--)
+		table->nr_table[list[i].nr] = list[i].name;
+}
+
+// switch all lookups to the secondary architecture; return -1 if the table
+// was not available at build time, 0 if OK
+int syscall_use_secondary(void) {
+	if (table_secondary.elems == 0)
+		return -1;
+	table = &table_secondary;
+	return 0;
+}
+
+// return -1 if error, or syscall number
+int syscall_find_name(const char *name) {
+	syscall_init();
+	unsigned h = name_hash_fn(name);
+	while (table->name_hash[h]) {
+		if (strcmp(name, table->name_hash[h]->name) == 0)
+			return table->name_hash[h]->nr;
+		h = (h + 1) & (table->name_hash_size - 1);
 	}
 
 	return -1;
 }
 
+int syscall_nr_max(void) {
+	syscall_init();
+	return table->nr_max;
+}
+
 const char *syscall_find_nr(int nr) {
-	int i;
-	int elems = sizeof(syslist) / sizeof(syslist[0]);
-	for (i = 0; i < elems; i++) {
-		if (nr == syslist[i].nr)
-			return syslist[i].name;
-	}
+	syscall_init();
+	if (nr >= 0 && nr <= table->nr_max && table->nr_table[nr])
+		return table->nr_table[nr];
 
 	return "unknown";
 }
 
 void syscall_print(void) {
 	int i;
-	int elems = sizeof(syslist) / sizeof(syslist[0]);
-	for (i = 0; i < elems; i++) {
-		printf("%d\t- %s\n", syslist[i].nr, syslist[i].name);
+	for (i = 0; i < table->elems; i++) {
+		printf("%d\t- %s\n", table->list[i].nr, table->list[i].name);
 	}
 	printf("\n");
 }
 
-static const char *syscall_find_group(const char *name) {
+// return the group expanded as a set of syscalls, or NULL if the group is not found
+static const SyscallSet *syscall_find_group(const char *name) {
 	int i;
 	int elems = sizeof(sysgroups) / sizeof(sysgroups[0]);
 	for (i = 0; i < elems; i++) {
-		if (strcmp(name, sysgroups[i].name) == 0)
-			return sysgroups[i].list;
+		if (strcmp(name, sysgroups[i].name) == 0) {
+			// the list is parsed only once, the groups inside are expanded recursively;
+			// syscalls not available on this architecture are skipped silently
+			if (!table->group_set[i]) {
+				SyscallSet *set = set_new();
+				group_depth++;
+				set_add_list(set, sysgroups[i].list);
+				group_depth--;
+				table->group_set[i] = set;
+			}
+			return table->group_set[i];
+		}
 	}
 
 	return NULL;
@@ -486,30 +383,26 @@ int syscall_check_list(const char *slist, void (*callback)(int fd, int syscall,
 		int syscall_nr;
 		int error_nr;
 		if (*ptr == '@') {
-			const char *new_list = syscall_find_group(ptr);
-			if (!new_list) {
+			const SyscallSet *set = syscall_find_group(ptr);
+			if (!set) {
 				fprintf(stderr, "Error fseccomp: unknown syscall group %s\n", ptr);
 				exit(1);
 			}
-			syscall_check_list(new_list, callback, fd, arg, ptrarg);
+			if (callback != NULL) {
+				for (syscall_nr = 0; syscall_nr < set->size; syscall_nr++) {
+					if (set_test(set, syscall_nr))
+						callback(fd, syscall_nr, arg, ptrarg);
+				}
+			}
 		}
 		else {
 			syscall_process_name(ptr, &syscall_nr, &error_nr);
 			if (syscall_nr == -1) {
-				if (!arg_quiet)
+				if (!arg_quiet && !group_depth)
 					fprintf(stderr, "Warning fseccomp: syscall \"%s\" not available on this platform\n", ptr);
 			}
-			else if (callback != NULL) {
-				if (error_nr != -1 && fd != 0) {
-					filter_add_errno(fd, syscall_nr, error_nr, ptrarg);
-				}
-				else if (error_nr != -1 && fd == 0) {
-					callback(fd, syscall_nr, error_nr, ptrarg);
-				}
-				else {
-					callback(fd, syscall_nr, arg, ptrarg);
-				}
-			}
+			else if (callback != NULL)
+				callback(fd, syscall_nr, (error_nr != -1) ? error_nr : arg, ptrarg);
 		}
 		ptr = strtok_r(NULL, ",", &saveptr);
 	}
@@ -517,74 +410,3 @@ int syscall_check_list(const char *slist, void (*callback)(int fd, int syscall,
 	free(str);
 	return 0;
 }
-
-static void find_syscall(int fd, int syscall, int arg, void *ptrarg) {
-	(void)fd;
-	(void) arg;
-	SyscallCheckList *ptr = ptrarg;
-	if (syscall == ptr->syscall)
-		ptr->found = true;
-}
-
-// go through list2 and find matches for problem syscall
-static void syscall_in_list(int fd, int syscall, int arg, void *ptrarg) {
-	(void) fd;
-	(void)arg;
-	SyscallCheckList *ptr = ptrarg;
-	SyscallCheckList sl;
-	sl.found = false;
-	sl.syscall = syscall;
-	syscall_check_list(ptr->slist, find_syscall, fd, 0, &sl);
-	// if found in the problem list, add to post-exec list
-	if (sl.found) {
-		if (ptr->postlist) {
-			if (asprintf(&ptr->postlist, "%s,%s", ptr->postlist, syscall_find_nr(syscall)) == -1)
-				errExit("asprintf");
-		}
-		else
-			ptr->postlist = strdup(syscall_find_nr(syscall));
-	}
-	else { // no problem, add to pre-exec list
-		// build syscall:error_no
-		char *newcall;
-		if (arg != 0) {
-			if (asprintf(&newcall, "%s:%s", syscall_find_nr(syscall), errno_find_nr(arg)) == -1)
-				errExit("asprintf");
-		}
-		else {
-			newcall = strdup(syscall_find_nr(syscall));
-			if (!newcall)
-				errExit("strdup");
-		}
-
-		if (ptr->prelist) {
-			if (asprintf(&ptr->prelist, "%s,%s", ptr->prelist, newcall) == -1)
-				errExit("asprintf");
-		}
-		else
-			ptr->prelist = newcall;
-	}
-}
-
-// go through list and find matches for syscalls in list @default-keep
-void syscalls_in_list(const char *list, const char *slist, int fd, char **prelist, char **postlist) {
-	(void) fd;
-	SyscallCheckList sl;
-	// these syscalls are used by firejail after the seccomp filter is initialized
-	sl.slist = slist;
-	sl.prelist = NULL;
-	sl.postlist = NULL;
-	syscall_check_list(list, syscall_in_list, 0, 0, &sl);
-	if (!arg_quiet) {
-		printf("Seccomp list in: %s,", list);
-		if (sl.slist)
-			printf(" check list: %s,", sl.slist);
-		if (sl.prelist)
-			printf(" prelist: %s,", sl.prelist);
-		if (sl.postlist)
-			printf(" postlist: %s", sl.postlist);
-		printf("\n");
-	}
-	*prelist = sl.prelist;
-	*postlist = sl.postlist;
-}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fseccomp.h"
+
+// A syscall set is a bitmap over syscall numbers, with an optional errno for each syscall.
+// The filters are built with set operations on the syscall lists, and the BPF code is
+// generated at the end from the final set.
+
+static void set_resize(SyscallSet *set, int size) {
+	if (size <= set->size)
+		return;
+
+	int bytes = (size + 7) / 8;
+	int old_bytes = (set->size + 7) / 8;
+	set->bits = realloc(set->bits, bytes);
+	set->errnum = realloc(set->errnum, size * sizeof(int));
+	if (!set->bits || !set->errnum)
+		errExit("realloc");
+	memset(set->bits + old_bytes, 0, bytes - old_bytes);
+	memset(set->errnum + set->size, 0, (size - set->size) * sizeof(int));
+	set->size = size;
+}
+
+SyscallSet *set_new(void) {
+	SyscallSet *set = malloc(sizeof(SyscallSet));
+	if (!set)
+		errExit("malloc");
+	memset(set, 0, sizeof(SyscallSet));
+	set_resize(set, syscall_nr_max() + 1);
+	return set;
+}
+
+void set_free(SyscallSet *set) {
+	if (!set)
+		return;
+	free(set->bits);
+	free(set->errnum);
+	free(set);
+}
+
+int set_test(const SyscallSet *set, int nr) {
+	if (nr < 0 || nr >= set->size)
+		return 0;
+	return (set->bits[nr / 8] & (1 << (nr % 8))) != 0;
+}
+
+// errno 0 kills the process; a syscall already in the set keeps its errno
+void set_add(SyscallSet *set, int nr, int errnum) {
+	assert(nr >= 0);
+	if (set_test(set, nr))
+		return;
+	set_resize(set, nr + 1);
+	set->bits[nr / 8] |= 1 << (nr % 8);
+	set->errnum[nr] = errnum;
+}
+
+static void set_remove(SyscallSet *set, int nr) {
+	if (!set_test(set, nr))
+		return;
+	set->bits[nr / 8] &= ~(1 << (nr % 8));
+	set->errnum[nr] = 0;
+}
+
+// the syscalls already in dst keep their errno
+void set_union(SyscallSet *dst, const SyscallSet *src) {
+	int i;
+	for (i = 0; i < src->size; i++) {
+		if (set_test(src, i))
+			set_add(dst, i, src->errnum[i]);
+	}
+}
+
+void set_difference(SyscallSet *dst, const SyscallSet *src) {
+	int i;
+	for (i = 0; i < src->size; i++) {
+		if (set_test(src, i))
+			set_remove(dst, i);
+	}
+}
+
+void set_intersection(SyscallSet *dst, const SyscallSet *src) {
+	int i;
+	for (i = 0; i < dst->size; i++) {
+		if (!set_test(src, i))
+			set_remove(dst, i);
+	}
+}
+
+int set_empty(const SyscallSet *set) {
+	int i;
+	for (i = 0; i < (set->size + 7) / 8; i++) {
+		if (set->bits[i])
+			return 0;
+	}
+	return 1;
+}
+
+static void set_add_callback(int fd, int syscall, int arg, void *ptrarg) {
+	(void) fd;
+	set_add((SyscallSet *) ptrarg, syscall, arg);
+}
+
+// add a list of syscalls, groups, and syscall:errno entries
+void set_add_list(SyscallSet *set, const char *list) {
+	if (syscall_check_list(list, set_add_callback, 0, 0, set)) {
+		fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
+		exit(1);
+	}
+}
+
+// print the set as a syscall list
+void set_print(const SyscallSet *set) {
+	const char *sep = "";
+	int i;
+	for (i = 0; i < set->size; i++) {
+		if (!set_test(set, i))
+			continue;
+		if (set->errnum[i])
+			printf("%s%s:%s", sep, syscall_find_nr(i), errno_find_nr(set->errnum[i]));
+		else
+			printf("%s%s", sep, syscall_find_nr(i));
+		sep = ",";
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef COPY_UTILS_H
+#define COPY_UTILS_H
+
+#include "../include/common.h"
+
+// copy methods, in the order they are tried
+enum {
+	COPY_CLONE = 0,		// FICLONE reflink, no data is copied
+	COPY_RANGE,		// copy_file_range(), in-kernel copy
+	COPY_SENDFILE,		// sendfile(), in-kernel copy
+	COPY_RW,		// read()/write() through a large buffer
+	COPY_METHODS
+};
+
+typedef struct {
+	unsigned long long bytes;	// bytes copied
+	unsigned files;			// files copied
+	unsigned syscalls;		// copy syscalls
+	unsigned method[COPY_METHODS];	// files completed by each method
+} CopyStats;
+
+extern CopyStats copy_stats;
+
+// copy the content of src into dst, starting at the current file offsets
+// return 0 if ok, -1 if error
+int copy_fd(int src, int dst);
+void copy_stats_print(const char *prog);
+
+#endif
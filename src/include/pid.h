@@ -19,14 +19,19 @@
 */
 #ifndef PID_H
 #define PID_H
-extern int max_pids;
-
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <unistd.h>
-typedef struct {
+typedef struct process_t {
+	struct process_t *next;	// next process in the snapshot, sorted by pid
+	struct process_t *hnext;	// next process in the same hash bucket
+	struct process_t *child;	// first child, sorted by pid; the tree is rebuilt by pid_read()
+	struct process_t *sibling;	// next process with the same parent
+	struct process_t *last_child;
+	pid_t pid;
 	short level;  // -1 not a firejail process, 0 not investigated yet, 1 firejail process, > 1 firejail child
 	unsigned char zombie;
 	pid_t parent;
@@ -39,20 +44,67 @@ typedef struct {
 	unsigned long long tx;	// networking tx, bytes
 	unsigned rx_delta;
 	unsigned tx_delta;
+
+	// statistics, updated by pid_read() for sandbox processes, and by pid_read_stats()
+	unsigned cpu_utime;	// clock ticks
+	unsigned cpu_stime;	// clock ticks
+	unsigned long long start_time;	// clock ticks since boot
+	unsigned rss;		// pages
+	unsigned shared;	// pages
+	pid_t sandbox;		// sandbox the process belongs to, maintained by firemon --daemon
+
+	// snapshot engine data
+	char comm[16];		// program name, changes on exec
+	ino_t ino;		// /proc/PID inode, changes when the pid is reused
+	signed char type;	// 1 firejail executable, -1 any other program, 0 not read yet
+	unsigned char age;	// number of snapshots the process was found in, saturated
+	unsigned char uid_valid;
+	unsigned gen;		// last snapshot the process was found in
+	unsigned level_gen;	// snapshot the level was computed for
+	unsigned stat_gen;	// snapshot /proc/PID/stat was last read in
 } Process;
-//extern Process pids[max_pids];
+
+// live processes, sorted by pid
 extern Process *pids;
 
+// process table published by firemon --daemon in a read-only shared memory file
+#define PID_TABLE_DIR "/run/firejail"
+#define PID_TABLE_FILE PID_TABLE_DIR "/firemon.table"
+#define PID_TABLE_MAGIC 0x31425446	// "FTB1"
+#define PID_TABLE_MAX 32768		// maximum number of sandboxed processes
+
+typedef struct {
+	pid_t pid;
+	pid_t parent;
+	pid_t sandbox;		// pid of the sandbox the process belongs to
+	uid_t uid;
+	short level;
+	short unused;
+} PidTableEntry;
+
+typedef struct {
+	uint32_t magic;
+	volatile uint32_t seq;	// odd while the table is updated
+	pid_t daemon;
+	uint32_t cnt;
+	PidTableEntry entry[PID_TABLE_MAX];	// sorted by pid
+} PidTable;
+
 // pid functions
-void pid_getmem(unsigned pid, unsigned *rss, unsigned *shared);
-void pid_get_cpu_time(unsigned pid, unsigned *utime, unsigned *stime);
-unsigned long long pid_get_start_time(unsigned pid);
 uid_t pid_get_uid(pid_t pid);
 char *pid_get_user_name(uid_t uid);
+char *pid_get_sandbox_name(pid_t pid);
+// process table functions
+Process *pid_find(pid_t pid);
+Process *pid_insert(pid_t pid);
+void pid_remove(pid_t pid);
+int pid_read_stats(Process *ptr);
+ssize_t pid_read_file(pid_t pid, const char *name, char *buf, size_t size);
 // print functions
 void pid_print_tree(unsigned index, unsigned parent, int nowrap);
 void pid_print_list(unsigned index, int nowrap);
 void pid_store_cpu(unsigned index, unsigned parent, unsigned *utime, unsigned *stime);
 void pid_read(pid_t mon_pid);
+void pid_scan(pid_t mon_pid);
 
 #endif
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef TREE_PLAN_H
+#define TREE_PLAN_H
+#include <stdint.h>
+
+// Binary trees of range checks on the syscall number, shared by fseccomp and fsec-optimize.
+// The values are split in segments with the same outcome. Without a frequency profile the
+// tree is balanced; with a profile it minimizes the number of comparisons executed for the
+// calls in the profile, and the frequent syscalls are resolved closer to the root.
+
+// syscall frequency profile, sorted by syscall number
+typedef struct {
+	uint32_t nr;
+	unsigned long long calls;
+} Freq;
+
+typedef struct {
+	Freq *entry;
+	int cnt;
+	int size;
+} FreqProfile;
+
+void freq_profile_add(FreqProfile *prof, uint32_t nr, unsigned long long calls);
+void freq_profile_free(FreqProfile *prof);
+
+// range of values with the same outcome: segment i covers [start, next segment start)
+typedef struct {
+	uint32_t start;
+	uint32_t outcome;		// return action or graph node, set by the caller
+	unsigned long long calls;	// calls in the segments before this one, from the frequency profile
+} Segment;
+
+// Set the running total of the calls in cnt segments; segs[cnt] receives the total.
+// prof can be NULL.
+void tree_count_calls(Segment *segs, int cnt, const FreqProfile *prof);
+
+typedef struct {
+	int cnt;
+	int *split;		// NULL for a balanced tree
+} TreePlan;
+
+// plan the tree for the segments counted by tree_count_calls()
+void tree_plan(TreePlan *plan, const Segment *segs, int cnt);
+
+// split point for segments lo to hi: the first segment on the right side of the tree
+int tree_split(const TreePlan *plan, int lo, int hi);
+
+#endif
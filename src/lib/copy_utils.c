@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "../include/copy_utils.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define COPY_CHUNK (1024 * 1024 * 1024)	// bytes requested in a single in-kernel copy call
+#define COPY_BUFLEN (128 * 1024)	// read/write buffer
+
+CopyStats copy_stats;
+
+static int copy_done(int method) {
+	copy_stats.files++;
+	copy_stats.method[method]++;
+	return 0;
+}
+
+// src and dst are freshly opened files, dst is empty
+int copy_fd(int src, int dst) {
+	assert(src >= 0);
+	assert(dst >= 0);
+	ssize_t len;
+	off_t copied = 0;
+
+	// the in-kernel methods are used only for regular files with a known size;
+	// /proc and /sys files report a size of 0
+	struct stat s;
+	int regular = (fstat(src, &s) == 0 && S_ISREG(s.st_mode) && s.st_size > 0);
+
+	if (regular) {
+#ifdef FICLONE
+		// share the data blocks on btrfs/xfs; fails on other filesystems
+		// and across filesystems
+		copy_stats.syscalls++;
+		if (ioctl(dst, FICLONE, src) == 0) {
+			copy_stats.bytes += s.st_size;
+			return copy_done(COPY_CLONE);
+		}
+#endif
+
+#ifdef SYS_copy_file_range
+		// on error the next method continues from the current file offsets
+		while (1) {
+			copy_stats.syscalls++;
+			len = syscall(SYS_copy_file_range, src, NULL, dst, NULL, COPY_CHUNK, 0);
+			if (len <= 0)
+				break;
+			copied += len;
+			copy_stats.bytes += len;
+		}
+		if (len == 0 && copied == s.st_size)
+			return copy_done(COPY_RANGE);
+#endif
+
+		while (1) {
+			copy_stats.syscalls++;
+			len = sendfile(dst, src, NULL, COPY_CHUNK);
+			if (len <= 0)
+				break;
+			copied += len;
+			copy_stats.bytes += len;
+		}
+		if (len == 0 && copied == s.st_size)
+			return copy_done(COPY_SENDFILE);
+	}
+
+	// last resort
+	static unsigned char *buf = NULL;
+	if (!buf) {
+		buf = malloc(COPY_BUFLEN);
+		if (!buf)
+			errExit("malloc");
+	}
+	while (1) {
+		copy_stats.syscalls++;
+		len = read(src, buf, COPY_BUFLEN);
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		ssize_t done = 0;
+		while (done != len) {
+			copy_stats.syscalls++;
+			ssize_t rv = write(dst, buf + done, len - done);
+			if (rv == -1) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			done += rv;
+		}
+		copy_stats.bytes += len;
+	}
+	if (len == -1)
+		return -1;
+	return copy_done(COPY_RW);
+}
+
+void copy_stats_print(const char *prog) {
+	printf("%s: %u files, %llu bytes, %u syscalls (reflink %u, copy_file_range %u, sendfile %u, read/write %u)\n",
+	       prog, copy_stats.files, copy_stats.bytes, copy_stats.syscalls,
+	       copy_stats.method[COPY_CLONE], copy_stats.method[COPY_RANGE],
+	       copy_stats.method[COPY_SENDFILE], copy_stats.method[COPY_RW]);
+}
@@ -25,103 +25,178 @@
 #include <pwd.h>
 #include <sys/ioctl.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/mman.h>
 
 #define PIDS_BUFLEN 4096
-//Process pids[max_pids];
+#define PIDS_HASH_INIT 1024	// initial number of hash buckets, power of 2
+#define PIDS_EXEC_AGE 16	// snapshots a process is checked for exec after it was found
+
+// The process table is a sparse snapshot of /proc, indexed by a hash table with
+// chained buckets. Entries are reused from one pid_read() call to the next, memory
+// usage depends on the number of running processes, not on /proc/sys/kernel/pid_max.
 Process *pids = NULL;
-int max_pids=32769;
+static Process **pids_hash = NULL;
+static unsigned pids_hash_size = 0;
+static unsigned pids_cnt = 0;
+static unsigned pids_gen = 0;
+static int pids_from_table = 0;	// the table was loaded from firemon --daemon
+
+static inline unsigned pid_hash(pid_t pid) {
+	return ((unsigned) pid * 2654435761U) & (pids_hash_size - 1);
+}
 
-// get the memory associated with this pid
-void pid_getmem(unsigned pid, unsigned *rss, unsigned *shared) {
-	// open stat file
-	char *file;
-	if (asprintf(&file, "/proc/%u/statm", pid) == -1)
-		errExit("asprintf");
+static void pid_hash_grow(void) {
+	unsigned size = (pids_hash_size) ? pids_hash_size * 2 : PIDS_HASH_INIT;
+	Process **old = pids_hash;
+	unsigned old_size = pids_hash_size;
 
-	FILE *fp = fopen(file, "r");
-	if (!fp) {
-		free(file);
-		return;
-	}
-	free(file);
+	pids_hash = calloc(size, sizeof(Process *));
+	if (!pids_hash)
+		errExit("calloc");
+	pids_hash_size = size;
 
-	unsigned a, b, c;
-	if (3 != fscanf(fp, "%u %u %u", &a, &b, &c)) {
-		fclose(fp);
-		return;
+	unsigned i;
+	for (i = 0; i < old_size; i++) {
+		Process *ptr = old[i];
+		while (ptr) {
+			Process *next = ptr->hnext;
+			unsigned h = pid_hash(ptr->pid);
+			ptr->hnext = pids_hash[h];
+			pids_hash[h] = ptr;
+			ptr = next;
+		}
 	}
-	*rss += b;
-	*shared += c;
-	fclose(fp);
+	free(old);
 }
 
+Process *pid_find(pid_t pid) {
+	if (!pids_hash)
+		return NULL;
 
-void pid_get_cpu_time(unsigned pid, unsigned *utime, unsigned *stime) {
-	// open stat file
-	char *file;
-	if (asprintf(&file, "/proc/%u/stat", pid) == -1)
-		errExit("asprintf");
-
-	FILE *fp = fopen(file, "r");
-	if (!fp) {
-		free(file);
-		return;
+	Process *ptr = pids_hash[pid_hash(pid)];
+	while (ptr) {
+		if (ptr->pid == pid)
+			return ptr;
+		ptr = ptr->hnext;
 	}
-	free(file);
+	return NULL;
+}
 
-	char line[PIDS_BUFLEN];
-	if (fgets(line, PIDS_BUFLEN - 1, fp)) {
-		char *ptr = line;
-		// jump 13 fields
-		int i;
-		for (i = 0; i < 13; i++) {
-			while (*ptr != ' ' && *ptr != '\t' && *ptr != '\0')
-				ptr++;
-			if (*ptr == '\0')
-				goto myexit;
-			ptr++;
+// add a process in the hash table, the caller is responsible for the sorted list
+static Process *pid_hash_add(pid_t pid) {
+	if (pids_cnt >= pids_hash_size * 2)
+		pid_hash_grow();
+
+	Process *ptr = calloc(1, sizeof(Process));
+	if (!ptr)
+		errExit("calloc");
+	ptr->pid = pid;
+	unsigned h = pid_hash(pid);
+	ptr->hnext = pids_hash[h];
+	pids_hash[h] = ptr;
+	pids_cnt++;
+	return ptr;
+}
+
+static void pid_free(Process *ptr) {
+	if (ptr->user)
+		free(ptr->user);
+	if (ptr->cmd)
+		free(ptr->cmd);
+	free(ptr);
+}
+
+// remove all processes
+static void pid_clear(void) {
+	unsigned i;
+	for (i = 0; i < pids_hash_size; i++) {
+		Process *ptr = pids_hash[i];
+		while (ptr) {
+			Process *next = ptr->hnext;
+			pid_free(ptr);
+			ptr = next;
 		}
-		if (2 != sscanf(ptr, "%u %u", utime, stime))
-			goto myexit;
+		pids_hash[i] = NULL;
 	}
+	pids = NULL;
+	pids_cnt = 0;
+}
 
-myexit:
-	fclose(fp);
+// find a process, or add a new one to the table
+Process *pid_insert(pid_t pid) {
+	Process *ptr = pid_find(pid);
+	if (ptr)
+		return ptr;
+
+	ptr = pid_hash_add(pid);
+	ptr->gen = pids_gen;
+
+	// insert in the sorted list
+	Process **link = &pids;
+	while (*link && (*link)->pid < pid)
+		link = &(*link)->next;
+	ptr->next = *link;
+	*link = ptr;
+	return ptr;
 }
 
-unsigned long long pid_get_start_time(unsigned pid) {
-	// open stat file
-	char *file;
-	if (asprintf(&file, "/proc/%u/stat", pid) == -1)
-		errExit("asprintf");
+static void pid_add_child(Process *parent, Process *ptr) {
+	ptr->sibling = NULL;
+	if (parent->last_child)
+		parent->last_child->sibling = ptr;
+	else
+		parent->child = ptr;
+	parent->last_child = ptr;
+}
 
-	FILE *fp = fopen(file, "r");
-	if (!fp) {
-		free(file);
-		return 0;
+static void pid_remove_child(Process *parent, Process *ptr) {
+	Process **link = &parent->child;
+	Process *prev = NULL;
+	while (*link && *link != ptr) {
+		prev = *link;
+		link = &(*link)->sibling;
 	}
-	free(file);
+	if (!*link)
+		return;
+	*link = ptr->sibling;
+	if (parent->last_child == ptr)
+		parent->last_child = prev;
+}
 
-	char line[PIDS_BUFLEN];
-	unsigned long long retval = 0;
-	if (fgets(line, PIDS_BUFLEN - 1, fp)) {
-		char *ptr = line;
-		// jump 21 fields
-		int i;
-		for (i = 0; i < 21; i++) {
-			while (*ptr != ' ' && *ptr != '\t' && *ptr != '\0')
-				ptr++;
-			if (*ptr == '\0')
-				goto myexit;
-			ptr++;
-		}
-		if (1 != sscanf(ptr, "%llu", &retval))
-			goto myexit;
+void pid_remove(pid_t pid) {
+	if (!pids_hash)
+		return;
+
+	Process **link = &pids_hash[pid_hash(pid)];
+	while (*link && (*link)->pid != pid)
+		link = &(*link)->hnext;
+	Process *ptr = *link;
+	if (!ptr)
+		return;
+	*link = ptr->hnext;
+
+	// detach the process from the tree
+	Process *parent = pid_find(ptr->parent);
+	if (parent)
+		pid_remove_child(parent, ptr);
+	Process *child = ptr->child;
+	while (child) {
+		Process *next = child->sibling;
+		child->sibling = NULL;
+		child = next;
 	}
 
-myexit:
-	fclose(fp);
-	return retval;
+	link = &pids;
+	while (*link && *link != ptr)
+		link = &(*link)->next;
+	if (*link)
+		*link = ptr->next;
+
+	pids_cnt--;
+	pid_free(ptr);
 }
 
 char *pid_get_user_name(uid_t uid) {
@@ -166,35 +241,134 @@ doexit:
 	return rv;
 }
 
-// todo: RUN_FIREJAIL_NAME_DIR is borrowed from src/firejail/firejail.h
-// move it in a common place
-#define RUN_FIREJAIL_NAME_DIR	"/run/firejail/name"
+// /proc directory, open for the lifetime of the program
+static int pid_procfd(void) {
+	static int procfd = -1;
+	if (procfd == -1) {
+		procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (procfd == -1) {
+			fprintf(stderr, "Error: cannot open /proc directory\n");
+			exit(1);
+		}
+	}
+	return procfd;
+}
 
-static void print_elem(unsigned index, int nowrap) {
-	// get terminal size
-	struct winsize sz;
-	int col = 0;
-	if (isatty(STDIN_FILENO)) {
-		if (!ioctl(0, TIOCGWINSZ, &sz))
-			col  = sz.ws_col;
+// read a small /proc/PID file using a single read() into the caller's buffer
+ssize_t pid_read_file(pid_t pid, const char *name, char *buf, size_t size) {
+	char fname[32];
+	snprintf(fname, sizeof(fname), "%d/%s", pid, name);
+	int fd = openat(pid_procfd(), fname, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	ssize_t len = read(fd, buf, size - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+	return len;
+}
+
+// read /proc/PID/stat: state, parent, program type, cpu times and start time
+// return 0 if ok, -1 if the process is gone
+static int pid_read_stat(Process *ptr) {
+	char buf[PIDS_BUFLEN];
+	if (pid_read_file(ptr->pid, "stat", buf, sizeof(buf)) == -1)
+		return -1;
+
+	// pid (comm) state ppid ... - comm can contain spaces and parenthesis
+	char *comm = strchr(buf, '(');
+	char *ptr1 = strrchr(buf, ')');
+	if (!comm || !ptr1 || ptr1[1] != ' ') {
+		fprintf(stderr, "Error: cannot read /proc file\n");
+		exit(1);
+	}
+	comm++;
+	*ptr1 = '\0';
+
+	// fields 3 to 22
+	char state;
+	int parent;
+	unsigned long long start_time;
+	if (sscanf(ptr1 + 2, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %u %u %*d %*d %*d %*d %*d %*d %llu",
+	           &state, &parent, &ptr->cpu_utime, &ptr->cpu_stime, &start_time) != 5) {
+		fprintf(stderr, "Error: cannot read /proc file\n");
+		exit(1);
+	}
+	ptr->zombie = (state == 'Z');
+	ptr->parent = parent;
+	ptr->stat_gen = pids_gen;
+
+	// a new start time means the pid was reused by a new process
+	if (ptr->start_time != start_time) {
+		ptr->start_time = start_time;
+		ptr->type = 0;
+		ptr->age = 0;
+		ptr->uid_valid = 0;
 	}
 
-	// indent
-	char indent[(pids[index].level - 1) * 2 + 1];
-	memset(indent, ' ', sizeof(indent));
-	indent[(pids[index].level - 1) * 2] = '\0';
+	// look for firejail executable name; comm changes on exec,
+	// the program type is stable only after the process was seen twice
+	if (strncmp(ptr->comm, comm, sizeof(ptr->comm) - 1) != 0) {
+		strncpy(ptr->comm, comm, sizeof(ptr->comm) - 1);
+		ptr->type = 0;
+	}
+	if (ptr->type == 0 || ptr->age < 2) {
+		if (strncmp(comm, "firejail", 8) == 0 && !pid_proc_cmdline_x11_xpra_xephyr(ptr->pid))
+			ptr->type = 1;
+		else
+			ptr->type = -1;
+	}
 
-	// get data
-	uid_t uid = pids[index].uid;
-	char *cmd = pid_proc_cmdline(index);
-	char *user = pid_get_user_name(uid);
-	char *user_allocated = user;
+	return 0;
+}
 
-	// extract sandbox name - pid == index
-	char *sandbox_name = "";
-	char *sandbox_name_allocated = NULL;
+// Cheap check for a process that was already investigated. The /proc/PID inode
+// comes with readdir and changes when the pid is reused. /proc/PID/comm changes
+// on exec; it is read only while the process is young, the window where a shell
+// or a launcher execs firejail after fork.
+// return 1 if /proc/PID/stat needs to be read again
+static int pid_changed(Process *ptr, ino_t ino) {
+	if (ptr->ino != ino)
+		return 1;
+	if (ptr->age >= PIDS_EXEC_AGE)
+		return 0;
+
+	char buf[32];
+	if (pid_read_file(ptr->pid, "comm", buf, sizeof(buf)) == -1)
+		return 1;
+	char *end = strchr(buf, '\n');
+	if (end)
+		*end = '\0';
+	return strncmp(ptr->comm, buf, sizeof(ptr->comm) - 1) != 0;
+}
+
+// refresh cpu times, start time and memory for a process
+// return 0 if ok, -1 if the process is gone
+int pid_read_stats(Process *ptr) {
+	if (pid_read_stat(ptr) == -1)
+		return -1;
+
+	char buf[128];
+	unsigned size;
+	if (pid_read_file(ptr->pid, "statm", buf, sizeof(buf)) == -1 ||
+	    sscanf(buf, "%u %u %u", &size, &ptr->rss, &ptr->shared) != 3) {
+		ptr->rss = 0;
+		ptr->shared = 0;
+	}
+	return 0;
+}
+
+// todo: RUN_FIREJAIL_NAME_DIR is borrowed from src/firejail/firejail.h
+// move it in a common place
+#define RUN_FIREJAIL_NAME_DIR	"/run/firejail/name"
+
+// return the name of the sandbox, or NULL if the sandbox was not started with --name
+char *pid_get_sandbox_name(pid_t pid) {
+	char *sandbox_name = NULL;
 	char *fname;
-	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_NAME_DIR, index) == -1)
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_NAME_DIR, pid) == -1)
 		errExit("asprintf");
 	struct stat s;
 	if (stat(fname, &s) == 0) {
@@ -203,7 +377,6 @@ static void print_elem(unsigned index, int nowrap) {
 			sandbox_name = malloc(s.st_size + 1);
 			if (!sandbox_name)
 				errExit("malloc");
-			sandbox_name_allocated = sandbox_name;
 			char *rv = fgets(sandbox_name, s.st_size + 1, fp);
 			if (!rv)
 				*sandbox_name = '\0';
@@ -216,6 +389,36 @@ static void print_elem(unsigned index, int nowrap) {
 		}
 	}
 	free(fname);
+	return sandbox_name;
+}
+
+static void print_elem(unsigned index, int nowrap) {
+	Process *proc = pid_find(index);
+	if (!proc)
+		return;
+
+	// get terminal size
+	struct winsize sz;
+	int col = 0;
+	if (isatty(STDIN_FILENO)) {
+		if (!ioctl(0, TIOCGWINSZ, &sz))
+			col  = sz.ws_col;
+	}
+
+	// indent
+	char indent[(proc->level - 1) * 2 + 1];
+	memset(indent, ' ', sizeof(indent));
+	indent[(proc->level - 1) * 2] = '\0';
+
+	// get data
+	uid_t uid = proc->uid;
+	char *cmd = pid_proc_cmdline(index);
+	char *user = pid_get_user_name(uid);
+	char *user_allocated = user;
+
+	// extract sandbox name - pid == index
+	char *sandbox_name_allocated = pid_get_sandbox_name(index);
+	char *sandbox_name = (sandbox_name_allocated) ? sandbox_name_allocated : "";
 
 	if (user ==NULL)
 		user = "";
@@ -238,7 +441,7 @@ static void print_elem(unsigned index, int nowrap) {
 		free(cmd);
 	}
 	else {
-		if (pids[index].zombie)
+		if (proc->zombie)
 			printf("%s%u: (zombie)\n", indent, index);
 		else
 			printf("%s%u:\n", indent, index);
@@ -256,16 +459,19 @@ void pid_print_tree(unsigned index, unsigned parent, int nowrap) {
 	// Remove unused parameter warning
 	(void)parent;
 
-	unsigned i;
-	for (i = index + 1; i < (unsigned)max_pids; i++) {
-		if (pids[i].parent == (pid_t)index)
-			pid_print_tree(i, index, nowrap);
-	}
+	Process *proc = pid_find(index);
+	if (!proc)
+		return;
 
-	for (i = 0; i < index; i++) {
-		if (pids[i].parent == (pid_t)index)
-			pid_print_tree(i, index, nowrap);
+	// children started after pid wrap-around are printed last
+	Process *ptr;
+	for (ptr = proc->child; ptr; ptr = ptr->sibling) {
+		if (ptr->pid > (pid_t) index)
+			pid_print_tree(ptr->pid, index, nowrap);
 	}
+
+	for (ptr = proc->child; ptr && ptr->pid < (pid_t) index; ptr = ptr->sibling)
+		pid_print_tree(ptr->pid, index, nowrap);
 }
 
 void pid_print_list(unsigned index, int nowrap) {
@@ -274,49 +480,176 @@ void pid_print_list(unsigned index, int nowrap) {
 
 // recursivity!!!
 void pid_store_cpu(unsigned index, unsigned parent, unsigned *utime, unsigned *stime) {
-	if (pids[index].level == 1) {
+	Process *proc = pid_find(index);
+	if (!proc)
+		return;
+
+	if (proc->level == 1) {
 		*utime = 0;
 		*stime = 0;
 	}
+	if (proc->stat_gen != pids_gen)
+		pid_read_stat(proc);
 
 	// Remove unused parameter warning
 	(void)parent;
 
-	unsigned utmp = 0;
-	unsigned stmp = 0;
-	pid_get_cpu_time(index, &utmp, &stmp);
-	*utime += utmp;
-	*stime += stmp;
+	*utime += proc->cpu_utime;
+	*stime += proc->cpu_stime;
 
-	unsigned i;
-	for (i = index + 1; i < (unsigned)max_pids; i++) {
-		if (pids[i].parent == (pid_t)index)
-			pid_store_cpu(i, index, utime, stime);
+	Process *ptr;
+	for (ptr = proc->child; ptr; ptr = ptr->sibling)
+		pid_store_cpu(ptr->pid, index, utime, stime);
+
+	if (proc->level == 1) {
+		proc->utime = *utime;
+		proc->stime = *stime;
+	}
+}
+
+static short pid_level(Process *ptr, pid_t mon_pid) {
+	if (ptr->level_gen == pids_gen)
+		return ptr->level;
+	ptr->level_gen = pids_gen;
+
+	if (ptr->type == 1 && (mon_pid == 0 || mon_pid == ptr->pid))
+		ptr->level = 1;
+	else
+		ptr->level = -1;
+
+	// a firejail child inherits the parent level
+	Process *parent = (ptr->parent != ptr->pid) ? pid_find(ptr->parent) : NULL;
+	if (parent && pid_level(parent, mon_pid) > 0)
+		ptr->level = parent->level + 1;
+
+	return ptr->level;
+}
+
+static void pid_build_tree(void) {
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		ptr->child = NULL;
+		ptr->last_child = NULL;
+	}
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		Process *parent = (ptr->parent != ptr->pid) ? pid_find(ptr->parent) : NULL;
+		if (parent)
+			pid_add_child(parent, ptr);
+		else
+			ptr->sibling = NULL;
+	}
+}
+
+// Check the daemon that published the table is still running. No lock is taken on
+// the table file, a daemon starting at the same time would fail to get its own lock.
+static int pid_table_daemon_alive(pid_t pid) {
+	if (pid <= 0)
+		return 0;
+	if (kill(pid, 0) == -1 && errno != EPERM)
+		return 0;
+
+	// the pid could have been reused by another program
+	char buf[32];
+	if (pid_read_file(pid, "comm", buf, sizeof(buf)) == -1)
+		return 0;
+	return strcmp(buf, "firemon\n") == 0;
+}
+
+// load the process table published by firemon --daemon
+// return 0 if ok, -1 if the daemon is not running
+static int pid_table_load(pid_t mon_pid) {
+	int fd = open(PID_TABLE_FILE, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	struct stat s;
+	if (fstat(fd, &s) == -1 || s.st_uid != 0 || (size_t) s.st_size < sizeof(PidTable)) {
+		close(fd);
+		return -1;
+	}
+	PidTable *table = mmap(NULL, sizeof(PidTable), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (table == MAP_FAILED)
+		return -1;
+	if (table->magic != PID_TABLE_MAGIC || !pid_table_daemon_alive(table->daemon)) {
+		munmap(table, sizeof(PidTable));
+		return -1;
 	}
 
-	if (pids[index].level == 1) {
-		pids[index].utime = *utime;
-		pids[index].stime = *stime;
+	// copy the entries, try again if the daemon was updating the table
+	PidTableEntry *entry = malloc(sizeof(table->entry));
+	if (!entry)
+		errExit("malloc");
+	uint32_t cnt = 0;
+	int i;
+	for (i = 0; i < 1000; i++) {
+		uint32_t seq = table->seq;
+		__sync_synchronize();
+		if ((seq & 1) == 0) {
+			cnt = table->cnt;
+			if (cnt > PID_TABLE_MAX)
+				cnt = PID_TABLE_MAX;
+			memcpy(entry, table->entry, cnt * sizeof(PidTableEntry));
+			__sync_synchronize();
+			if (table->seq == seq)
+				break;
+		}
+		usleep(100);
+	}
+	munmap(table, sizeof(PidTable));
+	if (i == 1000) {
+		free(entry);
+		return -1;
+	}
+
+	if (pids_hash == NULL)
+		pid_hash_grow();
+	pid_clear();
+	pids_gen++;
+	pids_from_table = 1;
+
+	Process **tail = &pids;
+	uint32_t j;
+	for (j = 0; j < cnt; j++) {
+		if (mon_pid && entry[j].sandbox != mon_pid)
+			continue;
+		Process *ptr = pid_hash_add(entry[j].pid);
+		ptr->parent = entry[j].parent;
+		ptr->level = entry[j].level;
+		ptr->uid = entry[j].uid;
+		ptr->uid_valid = 1;
+		ptr->sandbox = entry[j].sandbox;
+		ptr->type = (ptr->level == 1) ? 1 : -1;
+		ptr->age = 255;
+		ptr->gen = pids_gen;
+		ptr->level_gen = pids_gen;
+		*tail = ptr;
+		tail = &ptr->next;
 	}
+	*tail = NULL;
+	free(entry);
+
+	pid_build_tree();
+	return 0;
 }
 
 // mon_pid: pid of sandbox to be monitored, 0 if all sandboxes are included
 void pid_read(pid_t mon_pid) {
-	if (pids == NULL) {
-		FILE *fp = fopen("/proc/sys/kernel/pid_max", "r");
-		if (fp) {
-			int val;
-			if (fscanf(fp, "%d", &val) == 1) {
-				if (val >= max_pids)
-					max_pids = val + 1;
-			}
-			fclose(fp);
-		}
-		pids = malloc(sizeof(Process) * max_pids);
-		if (pids == NULL)
-			errExit("malloc");
+	if (pid_table_load(mon_pid) == 0)
+		return;
+	pid_scan(mon_pid);
+}
+
+// Build the process table from /proc. Only the processes that appeared since the last call,
+// the processes that are part of a sandbox, and the processes that lost their parent are read.
+void pid_scan(pid_t mon_pid) {
+	if (pids_hash == NULL)
+		pid_hash_grow();
+	if (pids_from_table) {
+		pid_clear();
+		pids_from_table = 0;
 	}
-	memset(pids, 0, sizeof(Process) * max_pids);
+	pids_gen++;
 	pid_t mypid = getpid();
 
 	DIR *dir;
@@ -328,13 +661,13 @@ void pid_read(pid_t mon_pid) {
 			exit(1);
 		}
 	}
-
-	pid_t child = -1;
+	// rebuild the sorted list - /proc is walked in ascending pid order
+	Process *head = NULL;
+	Process **tail = &head;
 	struct dirent *entry;
 	char *end;
-	while (child < 0 && (entry = readdir(dir))) {
+	while ((entry = readdir(dir))) {
 		pid_t pid = strtol(entry->d_name, &end, 10);
-		pid %= max_pids;
 		if (end == entry->d_name || *end)
 			continue;
 		if (pid == mypid)
@@ -344,82 +677,62 @@ void pid_read(pid_t mon_pid) {
 		if (pid == 1)
 			continue;
 
-		// open stat file
-		char *file;
-		if (asprintf(&file, "/proc/%u/status", pid) == -1)
-			errExit("asprintf");
+		Process *ptr = pid_find(pid);
+		if (!ptr)
+			ptr = pid_hash_add(pid);
 
-		FILE *fp = fopen(file, "r");
-		if (!fp) {
-			free(file);
-			continue;
+		if (ptr->type == 0 || ptr->age < 2 || ptr->level > 0 ||
+		    pid_changed(ptr, entry->d_ino)) {
+			ptr->ino = entry->d_ino;
+			if (pid_read_stat(ptr) == -1)
+				continue;
 		}
+		if (ptr->age < 255)
+			ptr->age++;
+		ptr->gen = pids_gen;
 
-		// look for firejail executable name
-		char buf[PIDS_BUFLEN];
-		while (fgets(buf, PIDS_BUFLEN - 1, fp)) {
-			if (strncmp(buf, "Name:", 5) == 0) {
-				char *ptr = buf + 5;
-				while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
-					ptr++;
-				}
-				if (*ptr == '\0') {
-					fprintf(stderr, "Error: cannot read /proc file\n");
-					exit(1);
-				}
-
-				if ((strncmp(ptr, "firejail", 8) == 0) && (mon_pid == 0 || mon_pid == pid)) {
-					if (pid_proc_cmdline_x11_xpra_xephyr(pid))
-						pids[pid].level = -1;
-					else
-						pids[pid].level = 1;
-				}
-				else
-					pids[pid].level = -1;
-			}
-			if (strncmp(buf, "State:", 6) == 0) {
-				if (strstr(buf, "(zombie)"))
-					pids[pid].zombie = 1;
-			}
-			else if (strncmp(buf, "PPid:", 5) == 0) {
-				char *ptr = buf + 5;
-				while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
-					ptr++;
-				}
-				if (*ptr == '\0') {
-					fprintf(stderr, "Error: cannot read /proc file\n");
-					exit(1);
-				}
-				unsigned parent = atoi(ptr);
-				parent %= max_pids;
-				if (pids[parent].level > 0) {
-					pids[pid].level = pids[parent].level + 1;
-				}
-				pids[pid].parent = parent;
-			}
-			else if (strncmp(buf, "Uid:", 4) == 0) {
-				char *ptr = buf + 5;
-				while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
-					ptr++;
-				}
-				if (*ptr == '\0') {
-					fprintf(stderr, "Error: cannot read /proc file\n");
-					exit(1);
-				}
-				pids[pid].uid = atoi(ptr);
-				break;
+		*tail = ptr;
+		tail = &ptr->next;
+	}
+	*tail = NULL;
+
+	// remove the processes that are gone
+	unsigned i;
+	for (i = 0; i < pids_hash_size; i++) {
+		Process **link = &pids_hash[i];
+		while (*link) {
+			Process *ptr = *link;
+			if (ptr->gen != pids_gen) {
+				*link = ptr->hnext;
+				pids_cnt--;
+				pid_free(ptr);
 			}
+			else
+				link = &ptr->hnext;
 		}
-		fclose(fp);
-		free(file);
+	}
+	pids = head;
+
+	// reparented processes
+	Process *ptr;
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (ptr->parent > 1 && pid_find(ptr->parent) == NULL)
+			pid_read_stat(ptr);
 	}
 	closedir(dir);
 
-	pid_t pid;
-	for (pid = 0; pid < max_pids; pid++) {
-		int parent = pids[pid].parent;
-		if (pids[parent].level > 0) {
-			pids[pid].level = pids[parent].level + 1;
+	// build the process tree
+	pid_build_tree();
+
+	// process levels; uid and fresh statistics are needed only for sandbox processes
+	for (ptr = pids; ptr; ptr = ptr->next) {
+		if (pid_level(ptr, mon_pid) > 0) {
+			if (ptr->stat_gen != pids_gen)
+				pid_read_stat(ptr);
+			if (!ptr->uid_valid) {
+				ptr->uid = pid_get_uid(ptr->pid);
+				ptr->uid_valid = 1;
+			}
 		}
 	}
 }
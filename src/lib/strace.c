@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "../include/common.h"
+#include "../include/strace.h"
+#include <ctype.h>
+
+#define MAXBUF 4096
+
+int strace_read(const char *fname, void (*callback)(const char *name, unsigned long long calls, void *arg), void *arg) {
+	FILE *fp = fopen(fname, "r");
+	if (!fp)
+		return -1;
+
+	char buf[MAXBUF];
+	int summary = 0;
+	while (fgets(buf, MAXBUF, fp)) {
+		// remove \n
+		char *ptr = strchr(buf, '\n');
+		if (ptr)
+			*ptr = '\0';
+
+		// strace -c summary:
+		// % time     seconds  usecs/call     calls    errors syscall
+		// ------ ----------- ----------- --------- --------- ----------------
+		//  45.16    0.000028           1        19           mmap
+		if (*buf == '%' && strstr(buf, "calls") && strstr(buf, "syscall")) {
+			summary = 1;
+			continue;
+		}
+		if (summary) {
+			if (*buf == '-' || *buf == '\0')
+				continue;
+			char *tok[8];
+			int cnt = 0;
+			char *saveptr;
+			for (ptr = strtok_r(buf, " \t", &saveptr); ptr && cnt < 8; ptr = strtok_r(NULL, " \t", &saveptr))
+				tok[cnt++] = ptr;
+			if (cnt < 5 || strcmp(tok[cnt - 1], "total") == 0)
+				continue;
+			callback(tok[cnt - 1], strtoull(tok[3], NULL, 10), arg);
+			continue;
+		}
+
+		// strace output, possibly with process IDs:
+		// [pid  1234] openat(AT_FDCWD, "/etc/passwd", O_RDONLY|O_CLOEXEC) = 3
+		// 1234  read(3, ...
+		ptr = buf;
+		if (strncmp(ptr, "[pid", 4) == 0) {
+			ptr = strchr(ptr, ']');
+			if (!ptr)
+				continue;
+			ptr++;
+		}
+		while (isdigit(*ptr) || *ptr == '.' || *ptr == ':' || *ptr == ' ')
+			ptr++;
+
+		// skip signals, exits and resumed calls
+		char *start = ptr;
+		while (islower(*ptr) || isdigit(*ptr) || *ptr == '_')
+			ptr++;
+		if (ptr == start || *ptr != '(')
+			continue;
+		*ptr = '\0';
+		callback(start, 1, arg);
+	}
+
+	fclose(fp);
+	return 0;
+}
@@ -17,7 +17,8 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
-#include "fsec_print.h"
+#include "../include/common.h"
+#include "../include/syscall_list.h"
 #include <sys/syscall.h>
 
 typedef struct {
@@ -45,3 +46,27 @@ const char *syscall_find_nr(int nr) {
 
 	return NULL;
 }
+
+// return -1 if error, or syscall number
+int syscall_find_name(const char *name) {
+	int i;
+	int elems = sizeof(syslist) / sizeof(syslist[0]);
+	for (i = 0; i < elems; i++) {
+		if (strcmp(name, syslist[i].name) == 0)
+			return syslist[i].nr;
+	}
+
+	return -1;
+}
+
+int syscall_nr_max(void) {
+	int i;
+	int max = 0;
+	int elems = sizeof(syslist) / sizeof(syslist[0]);
+	for (i = 0; i < elems; i++) {
+		if (syslist[i].nr > max)
+			max = syslist[i].nr;
+	}
+
+	return max;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014-2018 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "../include/common.h"
+#include "../include/tree_plan.h"
+
+void freq_profile_add(FreqProfile *prof, uint32_t nr, unsigned long long calls) {
+	assert(prof);
+	int i;
+	for (i = 0; i < prof->cnt && prof->entry[i].nr < nr; i++);
+	if (i < prof->cnt && prof->entry[i].nr == nr) {
+		prof->entry[i].calls += calls;
+		return;
+	}
+
+	if (prof->cnt == prof->size) {
+		prof->size = (prof->size) ? prof->size * 2 : 64;
+		prof->entry = realloc(prof->entry, prof->size * sizeof(Freq));
+		if (!prof->entry)
+			errExit("realloc");
+	}
+	memmove(&prof->entry[i + 1], &prof->entry[i], (prof->cnt - i) * sizeof(Freq));
+	prof->entry[i].nr = nr;
+	prof->entry[i].calls = calls;
+	prof->cnt++;
+}
+
+void freq_profile_free(FreqProfile *prof) {
+	assert(prof);
+	free(prof->entry);
+	memset(prof, 0, sizeof(FreqProfile));
+}
+
+void tree_count_calls(Segment *segs, int cnt, const FreqProfile *prof) {
+	assert(segs);
+	unsigned long long calls = 0;
+	int j = 0;
+	int i;
+	for (i = 0; i < cnt; i++) {
+		segs[i].calls = calls;
+		for (; prof && j < prof->cnt && (i == cnt - 1 || prof->entry[j].nr < segs[i + 1].start); j++)
+			calls += prof->entry[j].calls;
+	}
+	segs[cnt].calls = calls;
+}
+
+// Every segment counts also as a small fraction of a call, this keeps the syscalls not in
+// the profile in a balanced tree.
+static inline unsigned long long plan_weight(const Segment *segs, int cnt, int lo, int hi) {
+	return (segs[hi + 1].calls - segs[lo].calls) * cnt + (hi - lo + 1);
+}
+
+// The optimal tree is found with the classic dynamic programming algorithm, using Knuth's
+// bound on the position of the root: split[lo * cnt + hi] is the first segment on the right
+// side of the tree for segments lo to hi.
+void tree_plan(TreePlan *plan, const Segment *segs, int cnt) {
+	assert(plan);
+	assert(segs);
+	free(plan->split);
+	plan->split = NULL;
+	plan->cnt = cnt;
+	if (segs[cnt].calls == 0)
+		return;	// no profile, or no calls in this range of syscalls
+
+	int n = cnt;
+	int *split = malloc(n * n * sizeof(int));
+	unsigned long long *cost = malloc(n * n * sizeof(unsigned long long));
+	if (!split || !cost)
+		errExit("malloc");
+
+	int len;
+	for (len = 1; len <= n; len++) {
+		int lo;
+		for (lo = 0; lo + len <= n; lo++) {
+			int hi = lo + len - 1;
+			if (len == 1) {
+				cost[lo * n + hi] = 0;
+				split[lo * n + hi] = lo;
+				continue;
+			}
+
+			int first = (len == 2) ? hi : split[lo * n + hi - 1];
+			int last = (len == 2) ? hi : split[(lo + 1) * n + hi];
+			if (first < lo + 1)
+				first = lo + 1;
+			unsigned long long best = ~0ULL;
+			int k;
+			for (k = first; k <= last; k++) {
+				unsigned long long c = cost[lo * n + k - 1] + cost[k * n + hi];
+				if (c < best) {
+					best = c;
+					split[lo * n + hi] = k;
+				}
+			}
+			cost[lo * n + hi] = best + plan_weight(segs, n, lo, hi);
+		}
+	}
+
+	free(cost);
+	plan->split = split;
+}
+
+int tree_split(const TreePlan *plan, int lo, int hi) {
+	assert(plan);
+	if (plan->split)
+		return plan->split[lo * plan->cnt + hi];
+	return (lo + hi + 1) / 2;
+}
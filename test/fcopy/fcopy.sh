@@ -27,6 +27,9 @@ echo "TESTING: fcopy file (test/fcopy/filecopy.exp)"
 echo "TESTING: fcopy link (test/fcopy/linkcopy.exp)"
 ./linkcopy.exp
 
+echo "TESTING: fcopy batch (test/fcopy/batch.exp)"
+./batch.exp
+
 echo "TESTING: fcopy trailing char (test/copy/trailing.exp)"
 ./trailing.exp
 
@@ -58,6 +58,15 @@ else
         echo "TESTING SKIP: protocol, running only on x86_64"
 fi
 
+echo "TESTING: fsec-bench (test/filters/fsec-bench.exp)"
+./fsec-bench.exp
+
+echo "TESTING: fseccomp frequency profile (test/filters/fseccomp-freq.exp)"
+./fseccomp-freq.exp
+
+echo "TESTING: fseccomp sbox (test/filters/fseccomp-sbox.exp)"
+./fseccomp-sbox.exp
+
 echo "TESTING: seccomp bad empty (test/filters/seccomp-bad-empty.exp)"
 ./seccomp-bad-empty.exp
 
@@ -74,6 +83,9 @@ fi
 echo "TESTING: seccomp errno (test/filters/seccomp-errno.exp)"
 ./seccomp-errno.exp
 
+echo "TESTING: seccomp link (test/filters/seccomp-link.exp)"
+./seccomp-link.exp
+
 echo "TESTING: seccomp su (test/filters/seccomp-su.exp)"
 ./seccomp-su.exp
 
@@ -79,6 +79,15 @@ echo "TESTING: blacklist file (test/fs/option_blacklist_file.exp)"
 echo "TESTING: blacklist glob (test/fs/option_blacklist_glob.exp)"
 ./option_blacklist_glob.exp
 
+echo "TESTING: blacklist glob hidden files (test/fs/option_blacklist_glob2.exp)"
+./option_blacklist_glob2.exp
+
+echo "TESTING: noblacklist (test/fs/option_noblacklist.exp)"
+./option_noblacklist.exp
+
+echo "TESTING: mount plan (test/fs/mount-plan.exp)"
+./mount-plan.exp
+
 echo "TESTING: bind as user (test/fs/option_bind_user.exp)"
 ./option_bind_user.exp
 
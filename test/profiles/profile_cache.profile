@@ -0,0 +1,2 @@
+include ${HOME}/firejail-profile-cache.local
+blacklist /tmp/firejailtestdir1
@@ -32,3 +32,6 @@ echo "TESTING: profile read-only links (test/profiles/profile_readonly.exp)"
 echo "TESTING: profile no permissions (test/profiles/profile_noperm.exp)"
 ./profile_noperm.exp
 
+
+echo "TESTING: profile cache (test/profiles/profile_cache.exp)"
+./profile_cache.exp
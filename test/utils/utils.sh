@@ -135,3 +135,9 @@ echo "TESTING: firemon interface (test/utils/firemon-interface.exp)"
 
 echo "TESTING: firemon name (test/utils/firemon-name.exp)"
 ./firemon-name.exp
+
+echo "TESTING: firemon format (test/utils/firemon-format.exp)"
+./firemon-format.exp
+
+echo "TESTING: firemon daemon (test/utils/firemon-daemon.exp)"
+./firemon-daemon.exp